@@ -0,0 +1,129 @@
+/*
+    EBNF Compiler
+    Copyright (C) 2019  Ekkehard Morgenstern
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+    Contact Info:
+    E-Mail: ekkehard@ekkehardmorgenstern.de
+    Mail: Ekkehard Morgenstern, Mozartstr. 1, 76744 Woerth am Rhein, Germany, Europe
+*/
+
+// times the string regex of json.ebnf on one long string, stepping its
+// DFA through the shared byte class map as emitted, and through the same
+// DFA expanded to one column per byte; the string is BENCH_MIB MiB (default
+// 256) of pseudo-random printable ASCII and escapes, and the best of
+// BENCH_RUNS runs is printed
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "json.h"
+
+#ifndef BENCH_MIB
+#define BENCH_MIB   256
+#endif
+#ifndef BENCH_RUNS
+#define BENCH_RUNS  5
+#endif
+
+static double now( void ) {
+    struct timespec ts;
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+    return (double) ts.tv_sec + (double) ts.tv_nsec * 1e-9;
+}
+
+static int string_regex( void ) {
+    int i = 0;
+    while ( JSON_NODE_CLASS(i) != NC_PRODUCTION ||
+        JSON_NODE_TYPE(i) != NT_STRING ) ++i;
+    return JSON_AUX( JSON_BRANCH(i,0) );
+}
+
+static long match_classes( const regexinfo_t* info, const unsigned char* p,
+    size_t n ) {
+    const dfastate_t (*trans)[DFA_CLASSES] = &json_dfaTrans[ info->states ];
+    const unsigned char* accept = &json_dfaAccept[ info->states ];
+    unsigned st = 0;
+    long len = accept[0] ? 0 : -1;
+    for ( size_t i=0; i < n; ) {
+        st = trans[st][ json_byteClass[ p[i++] ] ];
+        if ( st == DFA_DEAD ) break;
+        if ( accept[st] ) len = (long) i;
+    }
+    return len;
+}
+
+static long match_bytes( const dfastate_t (*trans)[256],
+    const unsigned char* accept, const unsigned char* p, size_t n ) {
+    unsigned st = 0;
+    long len = accept[0] ? 0 : -1;
+    for ( size_t i=0; i < n; ) {
+        st = trans[st][ p[i++] ];
+        if ( st == DFA_DEAD ) break;
+        if ( accept[st] ) len = (long) i;
+    }
+    return len;
+}
+
+int main( void ) {
+    const regexinfo_t* info = &json_regexes[ string_regex() ];
+    size_t n = (size_t) BENCH_MIB << 20;
+    unsigned char* p = malloc( n );
+    dfastate_t (*trans)[256] = malloc( sizeof(*trans) *
+        (size_t) info->numStates );
+    unsigned r = 12345U;
+    double best[2] = { 0.0, 0.0 };
+    long a = 0, b = 0;
+    if ( p == 0 || trans == 0 ) { perror( "malloc" ); return EXIT_FAILURE; }
+    for ( int s=0; s < info->numStates; ++s ) {
+        for ( int c=0; c < 256; ++c ) {
+            trans[s][c] = json_dfaTrans[ info->states + s ][ json_byteClass[c] ];
+        }
+    }
+    p[0] = '"';
+    for ( size_t i=1; i + 2U < n; ++i ) {
+        r = r * 1103515245U + 12345U;
+        p[i] = (unsigned char) ( ' ' + ( r >> 16 ) % 95U );
+        if ( p[i] == '"' || p[i] == '\\' ) {
+            p[i++] = '\\';
+            p[i]   = (unsigned char) ( r & 1U ? '"' : 'n' );
+        }
+    }
+    p[n-2U] = '"';
+    p[n-1U] = 'x';
+    for ( int run=0; run < BENCH_RUNS; ++run ) {
+        double t0 = now(), t1, t2;
+        a  = match_classes( info, p, n );
+        t1 = now();
+        b  = match_bytes( (const dfastate_t (*)[256]) trans,
+            &json_dfaAccept[ info->states ], p, n );
+        t2 = now();
+        if ( run == 0 || t1 - t0 < best[0] ) best[0] = t1 - t0;
+        if ( run == 0 || t2 - t1 < best[1] ) best[1] = t2 - t1;
+    }
+    printf( "classes: %d MiB string, %d states, %d classes (%zu table "
+        "bytes), %.3f s; 256 columns (%zu table bytes), %.3f s\n",
+        BENCH_MIB, info->numStates, DFA_CLASSES, sizeof(dfastate_t) *
+        DFA_CLASSES * (size_t) info->numStates, best[0],
+        sizeof(*trans) * (size_t) info->numStates, best[1] );
+    free( trans );
+    free( p );
+    if ( a != (long) n - 1L || b != a ) {
+        fprintf( stderr, "classes: match lengths %ld and %ld, expected %zu\n",
+            a, b, n - 1U );
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
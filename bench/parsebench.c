@@ -0,0 +1,227 @@
+/*
+    EBNF Compiler
+    Copyright (C) 2019  Ekkehard Morgenstern
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+    Contact Info:
+    E-Mail: ekkehard@ekkehardmorgenstern.de
+    Mail: Ekkehard Morgenstern, Mozartstr. 1, 76744 Woerth am Rhein, Germany, Europe
+*/
+
+// recognizes a generated JSON document with a backtracking parser that
+// only reads the tables of json.ebnf through the accessor macros, so the
+// same source is built against every table layout and node order; the
+// document is BENCH_MIB MiB (default 64), and the best of BENCH_RUNS runs
+// is printed under the name given as the first argument
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "json.h"
+
+#ifndef BENCH_MIB
+#define BENCH_MIB   64
+#endif
+#ifndef BENCH_RUNS
+#define BENCH_RUNS  5
+#endif
+
+#define NO_MATCH    ((size_t) -1)
+
+static const unsigned char* in;
+static size_t               inLen;
+
+static double now( void ) {
+    struct timespec ts;
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+    return (double) ts.tv_sec + (double) ts.tv_nsec * 1e-9;
+}
+
+static size_t match_regex( int regex, size_t pos ) {
+    // the end of the longest match of a regex DFA at pos, or NO_MATCH
+    const regexinfo_t* info = &json_regexes[regex];
+    size_t end = json_dfaAccept[ info->states ] ? pos : NO_MATCH;
+    unsigned st = 0;
+    while ( pos < inLen ) {
+        unsigned set = json_dfaSpan[ info->states + st ];
+        if ( set != SPAN_NONE ) {
+            pos += json_span( json_spanSets[set], in + pos, inLen - pos );
+            if ( json_dfaAccept[ info->states + st ] ) end = pos;
+            if ( pos == inLen ) break;
+        }
+        st = json_dfaTrans[ info->states + st ][ json_byteClass[ in[pos++] ] ];
+        if ( st == DFA_DEAD ) break;
+        if ( json_dfaAccept[ info->states + st ] ) end = pos;
+    }
+    return end;
+}
+
+static size_t match_trie( int state, size_t pos ) {
+    // the end of the longest literal of a trie at pos, or NO_MATCH
+    size_t end = NO_MATCH;
+    while ( pos < inLen ) {
+        const triestate_t* ts = &json_trieStates[state];
+        int next = -1;
+        for ( int k=0; k < ts->numEdges; ++k ) {
+            if ( json_trieEdges[ ts->edges + k ].chr == in[pos] ) {
+                next = json_trieEdges[ ts->edges + k ].target;
+                break;
+            }
+        }
+        if ( next < 0 ) break;
+        state = next;
+        ++pos;
+        if ( json_trieStates[state].accept >= 0 ) end = pos;
+    }
+    return end;
+}
+
+static size_t match( int node, size_t pos ) {
+    // the end of node matched at pos (ordered choice, greedy
+    // repetition), or NO_MATCH
+    size_t r;
+    switch ( JSON_NODE_CLASS(node) ) {
+        case NC_PRODUCTION:
+            return match( JSON_BRANCH(node,0), pos );
+        case NC_MANDATORY:
+            for ( int k=0; k < JSON_NUM_BRANCHES(node) && pos != NO_MATCH;
+                ++k ) {
+                pos = match( JSON_BRANCH(node,k), pos );
+            }
+            return pos;
+        case NC_ALTERNATIVE:
+            for ( int k=0; k < JSON_NUM_BRANCHES(node); ++k ) {
+                r = match( JSON_BRANCH(node,k), pos );
+                if ( r != NO_MATCH ) return r;
+            }
+            return NO_MATCH;
+        case NC_OPTIONAL:
+            r = match( JSON_BRANCH(node,0), pos );
+            return r != NO_MATCH ? r : pos;
+        case NC_OPTIONAL_REPETITIVE:
+            while ( ( r = match( JSON_BRANCH(node,0), pos ) ) != NO_MATCH &&
+                r != pos ) pos = r;
+            return pos;
+        case NC_COUNTED_REPETITIVE: {
+            const repeatinfo_t* rep = &json_repeats[ JSON_AUX(node) ];
+            for ( int n=0; rep->max < 0 || n < rep->max; ++n ) {
+                r = match( JSON_BRANCH(node,0), pos );
+                if ( r == NO_MATCH ) return n >= rep->min ? pos : NO_MATCH;
+                pos = r;
+            }
+            return pos;
+        }
+        case NC_LITERAL_SET:
+            pos += json_skip( 0, in + pos, inLen - pos );
+            return match_trie( JSON_AUX(node), pos );
+        case NC_TERMINAL:
+            pos += json_skip( 0, in + pos, inLen - pos );
+            if ( JSON_TERM_TYPE(node) == TT_REGEX ) {
+                return match_regex( JSON_AUX(node), pos );
+            }
+            if ( JSON_TERM_TYPE(node) == TT_STRING ) {
+                size_t len = (size_t) JSON_TEXT_LEN(node);
+                if ( len > inLen - pos ||
+                    memcmp( in + pos, JSON_TEXT(node), len ) != 0 ) {
+                    return NO_MATCH;
+                }
+                return pos + len;
+            }
+            return NO_MATCH;
+        default:
+            return NO_MATCH;
+    }
+}
+
+static unsigned r = 12345U;
+
+static unsigned rnd( unsigned n ) {
+    r = r * 1103515245U + 12345U;
+    return ( r >> 16 ) % n;
+}
+
+static size_t make_value( char* p, int depth ) {
+    static const char* words[] = { "alpha", "bravo", "charlie", "del\\\"ta",
+        "echo", "fox\\\\trot" };
+    unsigned k = depth > 3 ? 2U + rnd( 3U ) : rnd( 5U );
+    size_t n = 0;
+    switch ( k ) {
+        case 0:
+            n += (size_t) sprintf( p, "{ \"id\": %u, \"name\": \"%s\", "
+                "\"child\": ", rnd( 100000U ), words[ rnd( 6U ) ] );
+            n += make_value( p + n, depth + 1 );
+            n += (size_t) sprintf( p + n, ", \"tags\": " );
+            n += make_value( p + n, depth + 1 );
+            p[n++] = '}';
+            break;
+        case 1: {
+            unsigned m = 1U + rnd( 4U );
+            p[n++] = '[';
+            for ( unsigned i=0; i < m; ++i ) {
+                if ( i > 0U ) { p[n++] = ','; p[n++] = ' '; }
+                n += make_value( p + n, depth + 1 );
+            }
+            p[n++] = ']';
+            break;
+        }
+        case 2:
+            n += (size_t) sprintf( p, "\"%s\"", words[ rnd( 6U ) ] );
+            break;
+        case 3:
+            n += (size_t) sprintf( p, "-%u.%ue+%u", rnd( 1000U ), rnd( 100U ),
+                rnd( 10U ) );
+            break;
+        default:
+            n += (size_t) sprintf( p, "%s", rnd( 2U ) ? "true" : "null" );
+            break;
+    }
+    return n;
+}
+
+int main( int argc, char** argv ) {
+    size_t size = (size_t) BENCH_MIB << 20, n = 0;
+    char* doc = malloc( size );
+    double best = 0.0;
+    int start = 0;
+    if ( doc == 0 ) { perror( "malloc" ); return EXIT_FAILURE; }
+    doc[n++] = '[';
+    while ( n + 65536U < size ) {
+        n += make_value( doc + n, 0 );
+        doc[n++] = ',';
+        doc[n++] = '\n';
+    }
+    n += (size_t) sprintf( doc + n, "null]\n" );
+    in    = (const unsigned char*) doc;
+    inLen = n;
+    while ( JSON_NODE_CLASS(start) != NC_PRODUCTION ||
+        JSON_NODE_TYPE(start) != NT_VALUE ) ++start;
+    for ( int run=0; run < BENCH_RUNS; ++run ) {
+        double t = now();
+        size_t end = match( start, 0 );
+        t = now() - t;
+        if ( end != NO_MATCH ) end += json_skip( 0, in + end, inLen - end );
+        if ( end != inLen ) {
+            fprintf( stderr, "parse: stopped at offset %zu of %zu\n", end,
+                inLen );
+            return EXIT_FAILURE;
+        }
+        if ( run == 0 || t < best ) best = t;
+    }
+    printf( "parse: %-17s %zu MiB, %.3f s, %.0f MB/s\n",
+        argc > 1 ? argv[1] : "", n >> 20, best, (double) n / best / 1e6 );
+    free( doc );
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,97 @@
+/*
+    EBNF Compiler
+    Copyright (C) 2019  Ekkehard Morgenstern
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+    Contact Info:
+    E-Mail: ekkehard@ekkehardmorgenstern.de
+    Mail: Ekkehard Morgenstern, Mozartstr. 1, 76744 Woerth am Rhein, Germany, Europe
+*/
+
+// times finding the records of search.ebnf in a synthetic web server log
+// with one error record per thousand lines, with search_search() and by
+// comparing the record's FIRST literals at every offset; the log is
+// BENCH_MIB MiB (default 256) and generated in memory
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "search.h"
+
+#ifndef BENCH_MIB
+#define BENCH_MIB   256
+#endif
+
+static double now( void ) {
+    struct timespec ts;
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+    return (double) ts.tv_sec + (double) ts.tv_nsec * 1e-9;
+}
+
+static size_t make_log( char* p, size_t size ) {
+    static const char* levels[] = { "info", "debug", "notice", "trace" };
+    unsigned r = 12345U;
+    size_t n = 0;
+    while ( n + 256U <= size ) {
+        r = r * 1103515245U + 12345U;
+        if ( ( r >> 8 ) % 1000U == 0U ) {
+            n += (size_t) sprintf( p + n, "2026-10-16 12:%02u:%02u web-%u "
+                "ERROR: E%04u upstream timed out after %u ms\n",
+                ( r >> 4 ) % 60U, ( r >> 10 ) % 60U, r % 32U,
+                ( r >> 3 ) % 10000U, r % 5000U );
+        } else {
+            n += (size_t) sprintf( p + n, "2026-10-16 12:%02u:%02u web-%u "
+                "%s: GET /api/v1/items/%u status=200 bytes=%u "
+                "referer=https://example.com/page\n",
+                ( r >> 4 ) % 60U, ( r >> 10 ) % 60U, r % 32U,
+                levels[ ( r >> 12 ) & 3U ], r % 100000U, ( r >> 7 ) % 65536U );
+        }
+    }
+    return n;
+}
+
+int main( void ) {
+    static const char* first[] = { "ERROR", "FATAL", "WARNING", "panic(" };
+    size_t size = (size_t) BENCH_MIB << 20, n, a = 0, b = 0;
+    char* log = malloc( size );
+    const unsigned char* p = (const unsigned char*) log;
+    double t0, t1, t2;
+    if ( log == 0 ) { perror( "malloc" ); return EXIT_FAILURE; }
+    n  = make_log( log, size );
+    t0 = now();
+    for ( size_t i=0; i < n; ++i ) {
+        for ( size_t k=0; k < sizeof(first) / sizeof(first[0]); ++k ) {
+            size_t len = strlen( first[k] );
+            if ( len <= n - i && memcmp( p + i, first[k], len ) == 0 ) {
+                ++a;
+                break;
+            }
+        }
+    }
+    t1 = now();
+    for ( size_t i = search_search( p, n, 0 ); i < n;
+        i = search_search( p, n, i + 1U ) ) ++b;
+    t2 = now();
+    printf( "search: %zu MiB log, %zu candidates, every offset %.3f s, "
+        "search %.3f s (%.1fx)\n", n >> 20, b, t1 - t0, t2 - t1,
+        ( t1 - t0 ) / ( t2 - t1 ) );
+    free( log );
+    if ( a != b ) {
+        fprintf( stderr, "search: %zu candidates at every offset\n", a );
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
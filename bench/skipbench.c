@@ -0,0 +1,92 @@
+/*
+    EBNF Compiler
+    Copyright (C) 2019  Ekkehard Morgenstern
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+    Contact Info:
+    E-Mail: ekkehard@ekkehardmorgenstern.de
+    Mail: Ekkehard Morgenstern, Mozartstr. 1, 76744 Woerth am Rhein, Germany, Europe
+*/
+
+// times skipping blank lines with a comment every 4 KiB (skip.ebnf), with
+// skip_skip() and by taking longest matches of the skip DFA alone; the
+// input is BENCH_MIB MiB (default 256) of pseudo-random " \t\r\n"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "skip.h"
+
+#ifndef BENCH_MIB
+#define BENCH_MIB   256
+#endif
+
+static double now( void ) {
+    struct timespec ts;
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+    return (double) ts.tv_sec + (double) ts.tv_nsec * 1e-9;
+}
+
+static size_t dfa_skip( const unsigned char* p, size_t n ) {
+    const dfastate_t (*trans)[DFA_CLASSES] =
+        &skip_dfaTrans[ skip_skipDfa.states ];
+    const unsigned char* accept = &skip_dfaAccept[ skip_skipDfa.states ];
+    size_t i = 0;
+    for ( ;; ) {
+        unsigned st = skip_skipModes[0];
+        size_t j, end;
+        for ( j = end = i; j < n; ) {
+            st = trans[st][ skip_byteClass[ p[j++] ] ];
+            if ( st == DFA_DEAD ) break;
+            if ( accept[st] ) end = j;
+        }
+        if ( end == i ) return i;
+        i = end;
+    }
+}
+
+int main( void ) {
+    static const char comment[] = "-- a comment line\n";
+    size_t n = (size_t) BENCH_MIB << 20, a, b;
+    unsigned char* p = malloc( n );
+    unsigned r = 12345U;
+    double t0, t1, t2;
+    if ( p == 0 ) { perror( "malloc" ); return EXIT_FAILURE; }
+    for ( size_t i=0; i < n; ++i ) {
+        unsigned k;
+        r = r * 1103515245U + 12345U;
+        k = ( r >> 16 ) % 100U;
+        p[i] = k < 70U ? ' ' : k < 85U ? '\n' : k < 95U ? '\t' : '\r';
+    }
+    for ( size_t i=4096; i + sizeof(comment) < n; i += 4096 ) {
+        memcpy( p + i, comment, sizeof(comment) - 1U );
+    }
+    p[n-1U] = 'x';
+    t0 = now();
+    a  = dfa_skip( p, n );
+    t1 = now();
+    b  = skip_skip( 0, p, n );
+    t2 = now();
+    printf( "skip: %d MiB, DFA %.3f s, skip %.3f s (%.1fx)\n", BENCH_MIB,
+        t1 - t0, t2 - t1, ( t1 - t0 ) / ( t2 - t1 ) );
+    free( p );
+    if ( a != n - 1U || b != n - 1U ) {
+        fprintf( stderr, "skip: skipped %zu and %zu bytes, expected %zu\n",
+            a, b, n - 1U );
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,87 @@
+/*
+    EBNF Compiler
+    Copyright (C) 2019  Ekkehard Morgenstern
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+    Contact Info:
+    E-Mail: ekkehard@ekkehardmorgenstern.de
+    Mail: Ekkehard Morgenstern, Mozartstr. 1, 76744 Woerth am Rhein, Germany, Europe
+*/
+
+// times the longest match of /[a-z0-9-]+/ (span.ebnf) on one long run,
+// stepping the DFA byte by byte and with span_span() in looping states;
+// the run is BENCH_MIB MiB (default 256) of pseudo-random bytes of the set
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "span.h"
+
+#ifndef BENCH_MIB
+#define BENCH_MIB   256
+#endif
+
+static double now( void ) {
+    struct timespec ts;
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+    return (double) ts.tv_sec + (double) ts.tv_nsec * 1e-9;
+}
+
+static long dfa_match( const unsigned char* p, size_t n, int useSpan ) {
+    const regexinfo_t* info = &span_regexes[0];
+    unsigned st = 0;
+    long len = span_dfaAccept[ info->states ] ? 0 : -1;
+    for ( size_t i=0; ; ) {
+        unsigned set = span_dfaSpan[ info->states + st ];
+        if ( useSpan && set != SPAN_NONE ) {
+            i += span_span( span_spanSets[set], p + i, n - i );
+            if ( span_dfaAccept[ info->states + st ] ) len = (long) i;
+        }
+        if ( i == n ) break;
+        st = span_dfaTrans[ info->states + st ][ span_byteClass[ p[i++] ] ];
+        if ( st == DFA_DEAD ) break;
+        if ( span_dfaAccept[ info->states + st ] ) len = (long) i;
+    }
+    return len;
+}
+
+int main( void ) {
+    static const char set[] = "abcdefghijklmnopqrstuvwxyz0123456789-";
+    size_t n = (size_t) BENCH_MIB << 20;
+    unsigned char* p = malloc( n + 1U );
+    unsigned r = 12345U;
+    double t0, t1, t2;
+    long a, b;
+    if ( p == 0 ) { perror( "malloc" ); return EXIT_FAILURE; }
+    for ( size_t i=0; i < n; ++i ) {
+        r = r * 1103515245U + 12345U;
+        p[i] = (unsigned char) set[ ( r >> 16 ) % ( sizeof(set) - 1U ) ];
+    }
+    p[n] = '.';
+    t0 = now();
+    a  = dfa_match( p, n + 1U, 0 );
+    t1 = now();
+    b  = dfa_match( p, n + 1U, 1 );
+    t2 = now();
+    printf( "span: %d MiB run, DFA %.3f s, span scan %.3f s (%.1fx)\n",
+        BENCH_MIB, t1 - t0, t2 - t1, ( t1 - t0 ) / ( t2 - t1 ) );
+    free( p );
+    if ( a != (long) n || b != (long) n ) {
+        fprintf( stderr, "span: match lengths %ld and %ld, expected %zu\n",
+            a, b, n );
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
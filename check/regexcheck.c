@@ -0,0 +1,269 @@
+/*
+    EBNF Compiler
+    Copyright (C) 2019  Ekkehard Morgenstern
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+    Contact Info:
+    E-Mail: ekkehard@ekkehardmorgenstern.de
+    Mail: Ekkehard Morgenstern, Mozartstr. 1, 76744 Woerth am Rhein, Germany, Europe
+*/
+
+// runs the regexes of regextest.ebnf on inputs with known longest matches:
+// the DFA, the DFA with span scans, and the matcher named in each regex's
+// hint (span, shift-and or lazy DFA) must all agree with the expected
+// length; exits with EXIT_FAILURE if one doesn't
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "regextest.h"
+
+#define TEXT(s)     s, sizeof(s) - 1U
+
+#define LONG_REGEX_LEN  271     // bytes between the slashes of long-regex
+
+typedef struct _regexcase_t {
+    nodetype_t      production;
+    const char*     text;
+    size_t          len;
+    long            match;      // length of the longest match, or -1
+} regexcase_t;
+
+static const regexcase_t cases[] = {
+    { NT_SINGLE,        TEXT("a"),                      1 },
+    { NT_SINGLE,        TEXT("ab"),                     1 },
+    { NT_SINGLE,        TEXT("b"),                      -1 },
+    { NT_SINGLE,        TEXT(""),                       -1 },
+    { NT_SEQUENCE,      TEXT("abcd"),                   3 },
+    { NT_SEQUENCE,      TEXT("abd"),                    -1 },
+    { NT_ANY,           TEXT("a.c"),                    3 },
+    { NT_ANY,           TEXT("ac"),                     -1 },
+    { NT_CLASS,         TEXT("c"),                      1 },
+    { NT_CLASS,         TEXT("d"),                      -1 },
+    { NT_RANGE,         TEXT("_"),                      1 },
+    { NT_RANGE,         TEXT("5"),                      1 },
+    { NT_RANGE,         TEXT("Z"),                      -1 },
+    { NT_NEGATED,       TEXT("x"),                      1 },
+    { NT_NEGATED,       TEXT("\""),                     -1 },
+    { NT_NEGATED,       TEXT("\\"),                     -1 },
+    { NT_DASH_LAST,     TEXT("-"),                      1 },
+    { NT_DASH_LAST,     TEXT("+"),                      1 },
+    { NT_DASH_LAST,     TEXT(","),                      -1 },
+    { NT_STAR,          TEXT("ac"),                     2 },
+    { NT_STAR,          TEXT("abbbc"),                  5 },
+    { NT_STAR,          TEXT("abb"),                    -1 },
+    { NT_PLUS,          TEXT("abbc"),                   4 },
+    { NT_PLUS,          TEXT("ac"),                     -1 },
+    { NT_OPTIONAL,      TEXT("ac"),                     2 },
+    { NT_OPTIONAL,      TEXT("abc"),                    3 },
+    { NT_OPTIONAL,      TEXT("abbc"),                   -1 },
+    { NT_STACKED,       TEXT(""),                       0 },
+    { NT_STACKED,       TEXT("aab"),                    3 },
+    { NT_STACKED,       TEXT("b"),                      1 },
+    { NT_STACKED,       TEXT("x"),                      0 },
+    { NT_ALTERN,        TEXT("abd"),                    3 },
+    { NT_ALTERN,        TEXT("xy"),                     1 },
+    { NT_ALTERN,        TEXT("ab"),                     -1 },
+    { NT_GROUP,         TEXT("ababc"),                  5 },
+    { NT_GROUP,         TEXT("c"),                      1 },
+    { NT_GROUP,         TEXT("abac"),                   -1 },
+    { NT_GROUP_ALT,     TEXT("xabcay"),                 6 },
+    { NT_GROUP_ALT,     TEXT("xbcy"),                   4 },
+    { NT_GROUP_ALT,     TEXT("xy"),                     -1 },
+    { NT_NESTED,        TEXT("d"),                      1 },
+    { NT_NESTED,        TEXT("acd"),                    3 },
+    { NT_NESTED,        TEXT("bcd"),                    3 },
+    { NT_NESTED,        TEXT("cd"),                     -1 },
+    { NT_GROUP_OPT,     TEXT("b"),                      1 },
+    { NT_GROUP_OPT,     TEXT("aaab"),                   4 },
+    { NT_GROUP_OPT,     TEXT("aa"),                     -1 },
+    { NT_ESC_META,      TEXT(".*+?()[]|/\\"),           11 },
+    { NT_ESC_META,      TEXT("x"),                      -1 },
+    { NT_ESC_CTRL,      TEXT("\t\n\r\f\v\0"),           6 },
+    { NT_ESC_CTRL,      TEXT("\t\n\r\f\v"),             -1 },
+    { NT_ESC_HEX,       TEXT("A~\xff"),                 3 },
+    { NT_ESC_HEX,       TEXT("A~"),                     -1 },
+    { NT_ESC_CLASS,     TEXT("12 ab"),                  5 },
+    { NT_ESC_CLASS,     TEXT("12"),                     2 },
+    { NT_ESC_CLASS,     TEXT("a1"),                     -1 },
+    { NT_ESC_NEGATED,   TEXT("a1 "),                    3 },
+    { NT_ESC_NEGATED,   TEXT("1ab"),                    -1 },
+    { NT_ESC_IN_CC,     TEXT("1 _-]x"),                 5 },
+    { NT_ESC_IN_CC,     TEXT("x"),                      -1 },
+    { NT_HEX_RANGE,     TEXT("\x1f"),                   1 },
+    { NT_HEX_RANGE,     TEXT(" "),                      -1 },
+    { NT_NUMBER,        TEXT("-12.5e+3x"),              8 },
+    { NT_NUMBER,        TEXT("0123"),                   1 },
+    { NT_NUMBER,        TEXT("1."),                     1 },
+    { NT_NUMBER,        TEXT("3e"),                     1 },
+    { NT_NUMBER,        TEXT("-"),                      -1 },
+    { NT_STRING,        TEXT("\"a\\\"b\"c"),            6 },
+    { NT_STRING,        TEXT("\"abc"),                  -1 },
+    { NT_COMMENT,       TEXT("/* x **/y"),              8 },
+    { NT_COMMENT,       TEXT("/* x *"),                 -1 },
+    { NT_EXACT,         TEXT("beefy"),                  4 },
+    { NT_EXACT,         TEXT("bee"),                    -1 },
+    { NT_COUNT_RANGE,   TEXT("aab"),                    3 },
+    { NT_COUNT_RANGE,   TEXT("aaaab"),                  5 },
+    { NT_COUNT_RANGE,   TEXT("aaaaab"),                 -1 },
+    { NT_COUNT_RANGE,   TEXT("ab"),                     -1 },
+    { NT_AT_LEAST,      TEXT("ababab"),                 6 },
+    { NT_AT_LEAST,      TEXT("ababc"),                  5 },
+    { NT_AT_LEAST,      TEXT("ab"),                     -1 },
+    { NT_ZERO_COUNT,    TEXT("xy"),                     2 },
+    { NT_ZERO_COUNT,    TEXT("xa"),                     1 },
+    { NT_NESTED_COUNT,  TEXT("abaab"),                  5 },
+    { NT_NESTED_COUNT,  TEXT("ccc"),                    3 },
+    { NT_NESTED_COUNT,  TEXT("cc"),                     -1 },
+    { NT_NESTED_COUNT,  TEXT("aabb"),                   -1 },
+    { NT_ESC_BRACE,     TEXT("{a}"),                    3 },
+    { NT_ESC_BRACE,     TEXT("a}"),                     -1 },
+    { NT_GREEK,         TEXT("αβΩx"),                   6 },
+    { NT_GREEK,         TEXT("é"),                      -1 },
+    { NT_CODE_POINTS,   TEXT("éaΑ_Z"),                  6 },
+    { NT_CODE_POINTS,   TEXT("Z"),                      -1 },
+    { NT_NON_ASCII,     TEXT("é"),                      2 },
+    { NT_NON_ASCII,     TEXT("a"),                      -1 },
+    { NT_NON_ASCII,     TEXT("\x80"),                   -1 },
+    { NT_UTF8_REPEAT,   TEXT("ééa"),                    4 },
+    { NT_UTF8_REPEAT,   TEXT("\xc3"),                   -1 },
+    { NT_ASTRAL,        TEXT("\xf0\x9f\x98\x80"),       4 },
+    { NT_ASTRAL,        TEXT("\xf0\x9f\x98"),           -1 },
+    { NT_LONG_REGEX,    TEXT("alpha-one-nine"),         14 },
+    { NT_LONG_REGEX,    TEXT("zulu-"),                  4 },
+    { NT_LONG_REGEX,    TEXT("nin"),                    -1 },
+};
+
+static lazydfa_t lazy;
+
+static int terminal_of( nodetype_t production ) {
+    // the node of the regex terminal that production consists of, or -1
+    int n = (int) ( sizeof(regextest_parsingTable) /
+        sizeof(regextest_parsingTable[0]) );
+    for ( int i=0; i < n; ++i ) {
+        if ( REGEXTEST_NODE_CLASS(i) == NC_PRODUCTION &&
+            REGEXTEST_NODE_TYPE(i) == production ) {
+            return REGEXTEST_BRANCH(i,0);
+        }
+    }
+    return -1;
+}
+
+static int regex_of( nodetype_t production ) {
+    int node = terminal_of( production );
+    return node < 0 ? -1 : REGEXTEST_AUX(node);
+}
+
+static long dfa_match( int regex, const unsigned char* p, size_t n,
+    int useSpan ) {
+    // the longest match of the regex's DFA, or -1
+    const regexinfo_t* info = &regextest_regexes[regex];
+    unsigned st = 0;
+    long len = regextest_dfaAccept[ info->states ] ? 0 : -1;
+    for ( size_t i=0; ; ) {
+        unsigned set = regextest_dfaSpan[ info->states + st ];
+        if ( useSpan && set != SPAN_NONE ) {
+            i += regextest_span( regextest_spanSets[set], p + i, n - i );
+            if ( regextest_dfaAccept[ info->states + st ] ) len = (long) i;
+        }
+        if ( i == n ) break;
+        st = regextest_dfaTrans[ info->states + st ]
+            [ regextest_byteClass[ p[i++] ] ];
+        if ( st == DFA_DEAD ) break;
+        if ( regextest_dfaAccept[ info->states + st ] ) len = (long) i;
+    }
+    return len;
+}
+
+static long hint_match( int regex, const unsigned char* p, size_t n ) {
+    // the longest match of the matcher named in the regex's hint
+    const regexhint_t* hint = &regextest_regexHints[regex];
+    size_t len;
+    switch ( hint->matcher ) {
+        case MK_SPAN:
+            len = regextest_span( regextest_spanSets[ hint->firstSet ], p, n );
+            return len > 0U ? (long) len : -1;
+        case MK_SHIFT_AND:
+            return regextest_shift_and( &regextest_shiftAnd[ hint->shiftAnd ],
+                p, n );
+        case MK_LAZY_DFA:
+            regextest_lazy_init( &lazy, regex );
+            return regextest_lazy_match( &lazy, p, n );
+        default:
+            return dfa_match( regex, p, n, 0 );
+    }
+}
+
+static int check( const char* name, size_t i, long got, long want ) {
+    if ( got == want ) return 0;
+    fprintf( stderr, "case %zu: %s matched %ld bytes, expected %ld\n", i,
+        name, got, want );
+    return 1;
+}
+
+int main( void ) {
+    static unsigned char lazyText[121];
+    int failed = 0, numCases = 0;
+    for ( size_t i=0; i < sizeof(cases) / sizeof(cases[0]); ++i ) {
+        const regexcase_t*   c = &cases[i];
+        const unsigned char* p = (const unsigned char*) c->text;
+        int regex = regex_of( c->production );
+        if ( regex < 0 || regextest_regexes[regex].numStates == 0 ) {
+            fprintf( stderr, "case %zu: no DFA\n", i );
+            ++failed;
+            continue;
+        }
+        failed += check( "DFA", i, dfa_match( regex, p, c->len, 0 ),
+            c->match );
+        failed += check( "span scan", i, dfa_match( regex, p, c->len, 1 ),
+            c->match );
+        failed += check( "hint matcher", i, hint_match( regex, p, c->len ),
+            c->match );
+        ++numCases;
+    }
+    // lazy-dfa has no DFA; ab repeated makes the lazy DFA flush its cache
+    {
+        int regex = regex_of( NT_LAZY_DFA );
+        memset( lazyText, 'b', sizeof(lazyText) );
+        lazyText[0] = 'a';
+        failed += check( "lazy DFA", 0, hint_match( regex, lazyText, 71U ),
+            71 );
+        failed += check( "lazy DFA", 1, hint_match( regex, lazyText + 1, 71U ),
+            -1 );
+        for ( size_t i=0; i < 120U; ++i ) lazyText[i] = "ab"[ i & 1U ];
+        failed += check( "lazy DFA", 2, hint_match( regex, lazyText, 120U ),
+            119 );
+        if ( regextest_regexHints[regex].matcher != MK_LAZY_DFA ) {
+            fprintf( stderr, "lazy-dfa isn't matched by a lazy DFA\n" );
+            ++failed;
+        }
+        numCases += 3;
+    }
+    // the text of a regex is kept in full, however long
+    {
+        static const char tail[] = "|eight|nine))*";
+        int node = terminal_of( NT_LONG_REGEX );
+        int len  = REGEXTEST_TEXT_LEN(node);
+        if ( len != LONG_REGEX_LEN || memcmp( REGEXTEST_TEXT(node) + len -
+            ( sizeof(tail) - 1U ), tail, sizeof(tail) - 1U ) != 0 ) {
+            fprintf( stderr, "long-regex has a text of %d bytes, expected "
+                "%d\n", len, LONG_REGEX_LEN );
+            ++failed;
+        }
+        ++numCases;
+    }
+    printf( "regexcheck: %d failures in %d cases\n", failed, numCases );
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,85 @@
+/*
+    EBNF Compiler
+    Copyright (C) 2019  Ekkehard Morgenstern
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+    Contact Info:
+    E-Mail: ekkehard@ekkehardmorgenstern.de
+    Mail: Ekkehard Morgenstern, Mozartstr. 1, 76744 Woerth am Rhein, Germany, Europe
+*/
+
+// runs the regexes of utf8.ebnf on whole inputs: they must match valid
+// UTF-8 only; exits with EXIT_FAILURE if one doesn't
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "utf8.h"
+
+typedef struct _utf8case_t {
+    int             regex;
+    const char*     text;
+    int             match;
+} utf8case_t;
+
+static const utf8case_t cases[] = {
+    { 0, "\xc3\xa9",            1 },    // U+00E9
+    { 0, "\xe2\x82\xac",        1 },    // U+20AC
+    { 0, "\xf0\x9f\x98\x80",    1 },    // U+1F600
+    { 0, "\xf4\x8f\xbf\xbf",    1 },    // U+10FFFF
+    { 0, "a",                   0 },
+    { 0, "\x80",                0 },    // lone continuation byte
+    { 0, "\xbf",                0 },
+    { 0, "\xc3",                0 },    // truncated
+    { 0, "\xc0\x80",            0 },    // overlong
+    { 0, "\xe0\x80\x80",        0 },
+    { 0, "\xed\xa0\x80",        0 },    // surrogates
+    { 0, "\xed\xbf\xbf",        0 },
+    { 0, "\xf4\x90\x80\x80",    0 },    // above U+10FFFF
+    { 0, "\xf8\x88\x80\x80\x80", 0 },
+    { 0, "\xff",                0 },
+    { 1, "\xc3\xa9" "b",        1 },
+    { 1, "\xc3\xa9\xc3\xa9",    1 },
+    { 1, "\xc3\xa9" "a",        0 },
+    { 1, "\xc3\xa9\x80",        0 },
+    { 1, "\xc3\xa9\xed\xbf\xbf", 0 },
+};
+
+static int full_match( int regex, const unsigned char* p, size_t n ) {
+    const regexinfo_t* info = &utf8_regexes[regex];
+    unsigned st = 0;
+    for ( size_t i=0; i < n; ++i ) {
+        st = utf8_dfaTrans[ info->states + st ][ utf8_byteClass[ p[i] ] ];
+        if ( st == DFA_DEAD ) return 0;
+    }
+    return utf8_dfaAccept[ info->states + st ] != 0;
+}
+
+int main( void ) {
+    int failed = 0;
+    for ( size_t i=0; i < sizeof(cases) / sizeof(cases[0]); ++i ) {
+        const utf8case_t* c = &cases[i];
+        int m = full_match( c->regex, (const unsigned char*) c->text,
+            strlen( c->text ) );
+        if ( m != c->match ) {
+            fprintf( stderr, "regex %d %s case %zu\n", c->regex,
+                c->match ? "rejects" : "accepts", i );
+            ++failed;
+        }
+    }
+    printf( "utf8check: %d of %zu cases failed\n", failed,
+        sizeof(cases) / sizeof(cases[0]) );
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -30,40 +30,49 @@
 /*
 language syntax:
 
+SKIP blank        := /[ \t\r\n]+/ | '--' { /[^\n]/ } .
+
 TOKEN hexadecimal := /\$[0-9a-fA-F]+/ .
 
 TOKEN identifier  := /[a-z0-9-]+/ .
 TOKEN str-literal := /'[^']+'/ | /"[^"]+"/ .
 
--- during parsing of regular expressions, whitespace skipping will be disabled
-TOKEN re-any      := '.' .
-TOKEN re-chr      := '\' /./ | /[^\/.*?[(|]/ .
+-- regular expressions are scanned in their own lexer mode, "regex"
+TOKEN:regex re-any      := '.' .
+TOKEN:regex re-hex      := /[0-9a-fA-F]/ .
+TOKEN:regex re-esc      := '\' ( 'x' re-hex re-hex | 'u' ( re-hex re-hex re-hex
+                           re-hex | '{' { re-hex }*1,6 '}' ) | /./ ) .
+TOKEN:regex re-utf8     := /[\xc2-\xf4][\x80-\xbf]+/ .
+TOKEN:regex re-chr      := re-esc | re-utf8 | /[^\/.*+?[()|{]/ .
 
-TOKEN re-cc-chr   := '\' /./ | /[^\\\]]/ .
-TOKEN re-cc-rng   := re-cc-chr '-' re-cc-chr .
-TOKEN re-cc-item  := re-cc-rng | re-cc-chr .
-TOKEN re-cc-items := re-cc-item { re-cc-item } .
-TOKEN re-cc       := '[' [ '^' ] re-cc-items ']' .
+TOKEN:regex re-cc-chr   := re-esc | re-utf8 | /[^\\\]]/ .
+TOKEN:regex re-cc-rng   := re-cc-chr '-' re-cc-chr .
+TOKEN:regex re-cc-item  := re-cc-rng | re-cc-chr .
+TOKEN:regex re-cc-items := re-cc-item { re-cc-item } .
+TOKEN:regex re-cc       := '[' [ '^' ] re-cc-items ']' .
 
-TOKEN re-base-expr   := re-cc | re-chr | re-any | '(' re-expr ')' .
-TOKEN re-repeat-expr := re-base-expr [ '+' | '*' | '?' ] .
-TOKEN re-and-expr    := re-repeat-expr { re-repeat-expr } .
-TOKEN re-or-expr     := re-and-expr { '|' re-and-expr } .
-TOKEN re-expr        := re-or-expr .
-TOKEN regex          := '/' re-expr '/' .
+TOKEN:regex re-base-expr   := re-cc | re-chr | re-any | '(' re-expr ')' .
+TOKEN:regex re-count       := '{' /[0-9]+/ [ ',' [ /[0-9]+/ ] ] '}' .
+TOKEN:regex re-repeat-expr := re-base-expr { '+' | '*' | '?' | re-count } .
+TOKEN:regex re-and-expr    := re-repeat-expr { re-repeat-expr } .
+TOKEN:regex re-or-expr     := re-and-expr { '|' re-and-expr } .
+TOKEN:regex re-expr        := re-or-expr .
+TOKEN regex                := '/' re-expr '/' .
 
 bin-field-type := 'BYTE' | 'WORD' | 'DWORD' | 'QWORD' .
 
 bin-match   := hexadecimal | bin-field-type [ ':' identifier |
                '*' identifier ] .
 
+count       := /[0-9]+/ [ ',' [ /[0-9]+/ ] ] .
 base-expr   := identifier | str-literal | regex | bin-match |
-               '(' expr ')' | '[' expr ']' | '{' expr '}' .
+               '(' expr ')' | '[' expr ']' | '{' expr '}' [ '*' count ] .
 and-expr    := base-expr { base-expr } .
 or-expr     := and-expr { '|' and-expr } .
 expr        := or-expr .
 
-production  := [ 'TOKEN' ] identifier ':=' expr '.' .
+production  := [ ( 'TOKEN' | 'SKIP' ) [ ':' identifier ] ] identifier ':='
+               expr '.' .
 prod-list   := production { production } .
 
 */
@@ -95,6 +104,8 @@ typedef enum _token_t {
     T_BIN_FIELD,
     T_BIN_FIELD_COUNT,
     T_BIN_FIELD_TIMES,
+    T_LITERAL_SET,
+    T_COUNT_EXPR,
 } token_t;
 
 static const char* token2text( token_t token ) {
@@ -106,6 +117,7 @@ static const char* token2text( token_t token ) {
         case T_REG_EX:      return "T_REG_EX";
         case T_BRACK_EXPR:  return "T_BRACK_EXPR";
         case T_BRACE_EXPR:  return "T_BRACE_EXPR";
+        case T_COUNT_EXPR:  return "T_COUNT_EXPR";
         case T_AND_EXPR:    return "T_AND_EXPR";
         case T_OR_EXPR:     return "T_OR_EXPR";
         case T_EXPR:        return "T_EXPR";
@@ -115,6 +127,7 @@ static const char* token2text( token_t token ) {
         case T_BIN_FIELD:   return "T_BIN_FIELD";
         case T_BIN_FIELD_COUNT:   return "T_BIN_FIELD_COUNT";
         case T_BIN_FIELD_TIMES:   return "T_BIN_FIELD_TIMES";
+        case T_LITERAL_SET: return "T_LITERAL_SET";
     }
 }
 
@@ -128,7 +141,22 @@ typedef struct _treenode_t {
     char*                   nodeTypeEnum;
     int                     id;
     int                     branchesIx;
+    int                     aux;
+    int                     textOff;
+    int                     textLen;
+    int                     nodeType;       // value of nodeTypeEnum
+    int                     nfaBase;
+    int                     nfaCount;
+    int                     nfaStart;
+    struct _renode_t*       re;             // T_REG_EX: the parsed regex
+    int                     minCount;       // T_COUNT_EXPR: the counts
+    int                     maxCount;       // (-1: no limit)
     int                     refCnt;
+    int                     regular;
+    int                     first;          // see first_literals()
+    int                     lexerMode;
+    bool                    isToken;
+    bool                    isSkip;         // SKIP production
     bool                    branchesOutput;
     bool                    implOutput;
 } treenode_t;
@@ -169,7 +197,8 @@ static void dump_tree_node( treenode_t* node, int indent ) {
     if ( node->text == 0 ) {
         printf( "%-*.*s%s\n", indent, indent, "", token2text(node->token) );
     } else {
-        printf( "%-*.*s%s '%s'\n", indent, indent, "", token2text(node->token), node->text );
+        printf( "%-*.*s%s '%s'%s\n", indent, indent, "", token2text(node->token), node->text,
+            node->isToken ? " TOKEN" : node->isSkip ? " SKIP" : "" );
     }
     for ( size_t i=0; i < node->numBranches; ++i ) {
         dump_tree_node( node->branches[i], indent+2 );
@@ -187,7 +216,22 @@ static treenode_t* create_node( token_t token, const char* text ) {
     node->nodeTypeEnum = 0;
     node->id           = -1;
     node->branchesIx   = -1;
+    node->aux          = -1;
+    node->textOff      = 0;
+    node->textLen      = -1;
+    node->nodeType     = 0;
+    node->nfaBase      = -1;
+    node->nfaCount     = 0;
+    node->nfaStart     = -1;
+    node->re           = 0;
+    node->minCount     = 0;
+    node->maxCount     = -1;
     node->refCnt       = 1;
+    node->regular      = -1;
+    node->first        = -1;
+    node->lexerMode    = 0;
+    node->isToken      = false;
+    node->isSkip       = false;
     node->branchesOutput = false;
     node->implOutput     = false;
     return node;
@@ -237,8 +281,9 @@ static char rngbuf[64];
 static int  wpos = 0;
 static int  rpos = 0;
 
-static char regex[256];
-static int  repos = 0;
+static char* regex      = 0;
+static int   repos      = 0;
+static int   regexAlloc = 0;
 
 static char pbbuf[256]; // putback buffer
 static int  pbpos = -1;
@@ -258,7 +303,9 @@ static void printrng() {
 }
 
 static void putback( int c ) {
-    if ( pbpos < 255 ) pbbuf[++pbpos] = (char) c;
+    // EOF isn't stored: it would come back as byte 255, and the next
+    // fgetc() returns EOF again anyway
+    if ( c != EOF && pbpos < 255 ) pbbuf[++pbpos] = (char) c;
 }
 
 static int rdch0( void ) {
@@ -271,22 +318,10 @@ static int rdch0( void ) {
 static void rdch( void ) {
 RETRY:
     ch = rdch0();
-REEVALUATE:
     if ( ch == EOF ) return;
     if ( lno == 0 ) { ++lno; chx = 0; }
     if ( ch == '\r' ) goto RETRY;
     if ( ch == '\n' ) { ++lno; chx = 0; goto RETRY; }
-    if ( ch == '-'  ) {
-        ch = rdch0();
-        if ( ch != '-' ) {
-            putback( ch );
-            ch = '-';
-        } else {
-            // -- comment
-            do { ch = rdch0(); } while ( ch != '\n' && ch != EOF );
-            goto REEVALUATE;
-        }
-    }
     ++chx;
     storech();
 }
@@ -302,8 +337,30 @@ static void report( const char* fmt, ... ) {
     exit( EXIT_FAILURE );
 }
 
+static void report2( const char* fmt, ... ) {
+    va_list ap;
+    va_start( ap, fmt );
+    fprintf( stderr, "? " );
+    vfprintf( stderr, fmt, ap );
+    fprintf( stderr, "\n" );
+    va_end( ap );
+    exit( EXIT_FAILURE );
+}
+
 static void skip_whitespace( void ) {
-    while ( ch == ' ' || ch == '\t' ) rdch();
+    // SKIP blank := /[ \t\r\n]+/ | '--' { /[^\n]/ } .  (rdch() drops
+    // line breaks; comments are only recognized here, so '--' can be a
+    // literal)
+    for (;;) {
+        while ( ch == ' ' || ch == '\t' ) rdch();
+        if ( ch != '-' ) return;
+        int c = rdch0();
+        if ( c != '-' ) { putback( c ); return; }
+        do { c = rdch0(); } while ( c != '\n' && c != EOF );
+        if ( c == EOF ) { ch = EOF; return; }
+        putback( c );
+        rdch();
+    }
 }
 
 static treenode_t* read_hexadecimal( void ) {
@@ -325,14 +382,21 @@ static treenode_t* read_hexadecimal( void ) {
 }
 
 static treenode_t* read_identifier( void ) {
-    // identifier := /[a-z0-9-]+/ .
+    // identifier := /[a-z0-9-]+/ .  (stops before a '--' comment)
     char tmp[256];
     int  ix = 0;
-    do {
+    for (;;) {
         if ( ix < 255 ) tmp[ix++] = (char) ch;
         rdch();
-    } while ( ( ch >= '0' && ch <= '9' ) || ( ch >= 'a' && ch <= 'z' ) ||
-        ch == '-' );
+        if ( ch == '-' ) {
+            int c = rdch0();
+            putback( c );
+            if ( c == '-' ) break;
+        } else if ( !( ch >= '0' && ch <= '9' ) &&
+            !( ch >= 'a' && ch <= 'z' ) ) {
+            break;
+        }
+    }
     tmp[ix] = '\0';
     return create_node( T_IDENTIFIER, tmp );
 }
@@ -353,151 +417,823 @@ static treenode_t* read_str_literal( void ) {
 }
 
 static void store_regex_char( char c ) {
-    if ( repos < 255 ) regex[repos++] = (char) c;
+    if ( repos >= regexAlloc ) {
+        regexAlloc = regexAlloc ? regexAlloc * 2 : 256;
+        xrealloc( (void**)(&regex), (size_t) regexAlloc );
+    }
+    regex[repos++] = c;
 }
 
-static bool read_re_any( void ) {
-    // re-any := '.' .
-    if ( ch != '.' ) return false;
-    store_regex_char( '.' );
+// -- regular expression AST --------------------------------------------------
+
+// a regular expression is first read into a tree of renode_t, from which its
+// NFA (and anything else that needs its structure) is built.
+
+typedef enum _retype_t {
+    RE_SET,             // one byte out of 'set'
+    RE_CONCAT,          // left, then right
+    RE_ALTERN,          // left or right
+    RE_STAR,            // left, any number of times
+    RE_PLUS,            // left, at least once
+    RE_OPT,             // left, at most once
+    RE_REPEAT           // left, min to max times (max -1: no limit)
+} retype_t;
+
+typedef struct _renode_t {
+    retype_t            type;
+    unsigned char       set[32];    // bit c&7 of set[c>>3] for each byte c
+    struct _renode_t*   left;
+    struct _renode_t*   right;
+    int                 min;        // RE_REPEAT: the counts
+    int                 max;
+} renode_t;
+
+// the counts of a counted repetition are limited, as its NFA holds one copy
+// of the repeated expression per count; so is the NFA of a whole regex, as
+// nested counts multiply
+#define MAX_REPEAT_COUNT    1000
+#define MAX_REGEX_NFA       32768
+
+static void set_add_range( unsigned char set[32], int from, int to ) {
+    for ( int c=from; c <= to; ++c ) set[c>>3] |= (unsigned char)( 1U << (c&7) );
+}
+
+static bool set_has( const unsigned char set[32], int c ) {
+    return ( set[c>>3] & ( 1U << (c&7) ) ) != 0;
+}
+
+static renode_t* new_re_node( retype_t type, renode_t* left, renode_t* right ) {
+    renode_t* re = (renode_t*) xmalloc( sizeof(renode_t) );
+    re->type  = type;
+    memset( re->set, 0, sizeof(re->set) );
+    re->left  = left;
+    re->right = right;
+    re->min   = 0;
+    re->max   = -1;
+    return re;
+}
+
+// Unicode code points (from \u escapes and UTF-8 encoded characters in the
+// source) match their UTF-8 encoding.  The readers below return code points
+// with RE_CODE_POINT or'ed in, to tell them from bytes (\xHH).  A regex
+// with a code point is a UTF-8 regex: its classes with a code point, and
+// its negated classes, are classes of code points, so that they never match
+// invalid UTF-8.  Negated byte classes are only known to be such once the
+// whole regex has been read, so they are converted afterwards.
+
+#define RE_CODE_POINT   0x1000000
+#define RE_NEG_CLASS    (-3)        // \D, \W or \S
+#define MAX_CODE_POINT  0x10ffff
+
+typedef struct _cprange_t {
+    int                 lo;
+    int                 hi;
+} cprange_t;
+
+// a character class being read: bytes and ASCII characters go to set, code
+// points above 0x7f to ranges
+typedef struct _reclass_t {
+    unsigned char       set[32];
+    cprange_t*          ranges;
+    int                 numRanges;
+    bool                negClass;   // has \D, \W or \S
+    bool                codePoints; // has a code point
+} reclass_t;
+
+// a negated class without code points, kept as a byte set until it is known
+// whether the regex is a UTF-8 regex
+typedef struct _renegclass_t {
+    renode_t*           node;
+    unsigned char       set[32];    // the class before negation
+    bool                negClass;
+} renegclass_t;
+
+static bool          reUtf8          = false;   // the regex has a code point
+static renegclass_t* reNegClasses    = 0;
+static int           numReNegClasses = 0;
+static int           reNegClassAlloc = 0;
+
+static int utf8_encode( int cp, unsigned char b[4] ) {
+    if ( cp < 0x80 ) {
+        b[0] = (unsigned char) cp;
+        return 1;
+    }
+    if ( cp < 0x800 ) {
+        b[0] = (unsigned char)( 0xc0 | cp >> 6 );
+        b[1] = (unsigned char)( 0x80 | ( cp & 0x3f ) );
+        return 2;
+    }
+    if ( cp < 0x10000 ) {
+        b[0] = (unsigned char)( 0xe0 | cp >> 12 );
+        b[1] = (unsigned char)( 0x80 | ( ( cp >> 6 ) & 0x3f ) );
+        b[2] = (unsigned char)( 0x80 | ( cp & 0x3f ) );
+        return 3;
+    }
+    b[0] = (unsigned char)( 0xf0 | cp >> 18 );
+    b[1] = (unsigned char)( 0x80 | ( ( cp >> 12 ) & 0x3f ) );
+    b[2] = (unsigned char)( 0x80 | ( ( cp >> 6 ) & 0x3f ) );
+    b[3] = (unsigned char)( 0x80 | ( cp & 0x3f ) );
+    return 4;
+}
+
+static renode_t* re_concat( renode_t* left, renode_t* right ) {
+    return left ? new_re_node( RE_CONCAT, left, right ) : right;
+}
+
+static renode_t* re_altern( renode_t* left, renode_t* right ) {
+    return left ? new_re_node( RE_ALTERN, left, right ) : right;
+}
+
+static renode_t* re_bytes( const unsigned char* b, int n ) {
+    renode_t* re = 0;
+    for ( int i=0; i < n; ++i ) {
+        renode_t* set = new_re_node( RE_SET, 0, 0 );
+        set_add_range( set->set, b[i], b[i] );
+        re = re_concat( re, set );
+    }
+    return re;
+}
+
+static renode_t* re_utf8_range( renode_t* re, int lo, int hi ) {
+    // adds the UTF-8 encodings of the code points lo to hi (above 0x7f, no
+    // surrogates) to re as alternatives; each one is a sequence of byte
+    // ranges, so lo and hi are split until all their encodings have the
+    // same length and every byte range but the first spans whole blocks
+    static const int lengthEnd[] = { 0x7ff, 0xffff };
+    for ( int k=0; k < 2; ++k ) {
+        if ( lo <= lengthEnd[k] && hi > lengthEnd[k] ) {
+            re = re_utf8_range( re, lo, lengthEnd[k] );
+            return re_utf8_range( re, lengthEnd[k] + 1, hi );
+        }
+    }
+    unsigned char a[4], b[4];
+    int n = utf8_encode( lo, a );
+    for ( int i=1; i < n; ++i ) {
+        int m = ( 1 << ( 6 * i ) ) - 1;
+        if ( ( lo & ~m ) == ( hi & ~m ) ) continue;
+        if ( ( lo & m ) != 0 ) {
+            re = re_utf8_range( re, lo, lo | m );
+            return re_utf8_range( re, ( lo | m ) + 1, hi );
+        }
+        if ( ( hi & m ) != m ) {
+            re = re_utf8_range( re, lo, ( hi & ~m ) - 1 );
+            return re_utf8_range( re, hi & ~m, hi );
+        }
+    }
+    utf8_encode( hi, b );
+    renode_t* seq = 0;
+    for ( int i=0; i < n; ++i ) {
+        renode_t* set = new_re_node( RE_SET, 0, 0 );
+        set_add_range( set->set, a[i], b[i] );
+        seq = re_concat( seq, set );
+    }
+    return re_altern( re, seq );
+}
+
+static void class_add_range( reclass_t* cls, int lo, int hi ) {
+    // adds the code points lo to hi
+    if ( lo < 0x80 ) set_add_range( cls->set, lo, hi < 0x7f ? hi : 0x7f );
+    if ( hi < 0x80 ) return;
+    xrealloc( (void**)(&cls->ranges), sizeof(cprange_t) *
+        (size_t)( cls->numRanges + 1 ) );
+    cls->ranges[cls->numRanges].lo = lo < 0x80 ? 0x80 : lo;
+    cls->ranges[cls->numRanges].hi = hi;
+    cls->numRanges++;
+}
+
+static int compare_cp_ranges( const void* a, const void* b ) {
+    const cprange_t* x = (const cprange_t*) a;
+    const cprange_t* y = (const cprange_t*) b;
+    return x->lo - y->lo;
+}
+
+static renode_t* re_unicode_class( reclass_t* cls, bool negate ) {
+    // a class with code points above 0x7f: its bytes above 0x7f count as
+    // the code points U+0080 to U+00FF, and \D, \W and \S include all code
+    // points above U+00FF.  The ASCII part stays a single byte set, so
+    // ASCII input takes one DFA transition per character as before.
+    for ( int c=0x80; c < 0x100; ++c ) {
+        if ( set_has( cls->set, c ) ) class_add_range( cls, c, c );
+    }
+    if ( cls->negClass ) class_add_range( cls, 0x100, MAX_CODE_POINT );
+    for ( int i=0x10; i < 0x20; ++i ) cls->set[i] = 0;
+    if ( cls->numRanges > 0 ) {
+        qsort( cls->ranges, (size_t) cls->numRanges, sizeof(cprange_t),
+            compare_cp_ranges );
+    }
+    renode_t* re = 0;
+    if ( negate ) {
+        for ( int i=0; i < 0x10; ++i ) cls->set[i] = (unsigned char) ~cls->set[i];
+    }
+    for ( int i=0; i < 0x10; ++i ) {
+        if ( cls->set[i] == 0 ) continue;
+        re = new_re_node( RE_SET, 0, 0 );
+        memcpy( re->set, cls->set, 0x10 );
+        break;
+    }
+    // walk the code points above 0x7f in order, emitting every maximal run
+    // that is in the class (or, if negated, not in it), without surrogates
+    int next = 0x80;
+    for ( int i=0; i <= cls->numRanges; ++i ) {
+        int lo = i < cls->numRanges ? cls->ranges[i].lo : MAX_CODE_POINT + 1;
+        int hi = i < cls->numRanges ? cls->ranges[i].hi : MAX_CODE_POINT;
+        if ( hi < next ) continue;
+        if ( lo < next ) lo = next;
+        int from = negate ? next : lo, to = negate ? lo - 1 : hi;
+        next = hi + 1;
+        if ( from > to ) continue;
+        if ( from < 0xd800 ) re = re_utf8_range( re, from, to < 0xd7ff ? to : 0xd7ff );
+        if ( to > 0xdfff ) re = re_utf8_range( re, from > 0xe000 ? from : 0xe000, to );
+    }
+    free( cls->ranges );
+    if ( re == 0 ) report( "empty character class in regular expression" );
+    return re;
+}
+
+static int read_re_hex_digit( void ) {
+    if ( !isxdigit( ch ) ) {
+        report( "hexadecimal digit expected after '\\x' or '\\u' in regular expression" );
+    }
+    int d = isdigit( ch ) ? ch - '0' : tolower( ch ) - 'a' + 10;
+    store_regex_char( (char) ch );
     rdch();
-    return true;
+    return d;
 }
 
-static bool read_re_chr( void ) {
-    // re-chr := '\' /./ | /[^\/.*?[(|]/ .
-    if ( ch == '\\' ) {
-        rdch();
-        if ( ch == EOF ) report( "unexpected end of file" );
-        store_regex_char( '\\' );
+static int read_re_code_point( void ) {
+    // after '\u': re-hex re-hex re-hex re-hex | '{' { re-hex }*1,6 '}'
+    int cp = 0;
+    if ( ch != '{' ) {
+        for ( int i=0; i < 4; ++i ) cp = cp * 16 + read_re_hex_digit();
     } else {
-        switch ( ch ) {
-            case EOF:
-                report( "unexpected end of file" );
-            case '/': case '.': case '*': case '?': case '[': case '(': case '|':
-                return false;
-            default: break;
+        store_regex_char( '{' );
+        rdch();
+        int n = 0;
+        do {
+            cp = cp * 16 + read_re_hex_digit();
+        } while ( ++n < 6 && ch != '}' );
+        if ( ch != '}' ) report( "'}' expected after code point in regular expression" );
+        store_regex_char( '}' );
+        rdch();
+    }
+    if ( cp > MAX_CODE_POINT || ( cp >= 0xd800 && cp <= 0xdfff ) ) {
+        report( "bad code point U+%04X in regular expression", cp );
+    }
+    return cp;
+}
+
+static int read_re_esc( unsigned char set[32] ) {
+    // re-esc := '\' ( 'x' re-hex re-hex | 'u' ( re-hex re-hex re-hex
+    //           re-hex | '{' { re-hex }*1,6 '}' ) | /./ ) .
+    // adds the escaped byte, or class, to set; returns the byte, -1 for a
+    // class (\d, \w, \s), RE_NEG_CLASS for their negations \D, \W and \S,
+    // or for a \u escape, RE_CODE_POINT | the code point (which is not
+    // added to set)
+    if ( ch != '\\' ) return -1;
+    store_regex_char( '\\' );
+    rdch();
+    int c = ch;
+    if ( c == EOF ) report( "unexpected end of file" );
+    store_regex_char( (char) c );
+    rdch();
+    switch ( c ) {
+        case 'n': c = '\n'; break;
+        case 't': c = '\t'; break;
+        case 'r': c = '\r'; break;
+        case 'f': c = '\f'; break;
+        case 'v': c = '\v'; break;
+        case '0': c = 0;    break;
+        case 'x':
+            c  = read_re_hex_digit() * 16;
+            c += read_re_hex_digit();
+            break;
+        case 'u':
+            reUtf8 = true;
+            return RE_CODE_POINT | read_re_code_point();
+        case 'd': case 'D': case 'w': case 'W': case 's': case 'S': {
+            unsigned char cls[32];
+            memset( cls, 0, sizeof(cls) );
+            if ( c == 'd' || c == 'D' ) {
+                set_add_range( cls, '0', '9' );
+            } else if ( c == 'w' || c == 'W' ) {
+                set_add_range( cls, '0', '9' );
+                set_add_range( cls, 'A', 'Z' );
+                set_add_range( cls, 'a', 'z' );
+                set_add_range( cls, '_', '_' );
+            } else {
+                set_add_range( cls, '\t', '\r' );
+                set_add_range( cls, ' ', ' ' );
+            }
+            for ( int i=0; i < 32; ++i ) {
+                set[i] |= isupper( c ) ? (unsigned char) ~cls[i] : cls[i];
+            }
+            return isupper( c ) ? RE_NEG_CLASS : -1;
         }
+        default: break;
     }
-    store_regex_char( (char) ch );
+    set_add_range( set, c & 255, c & 255 );
+    return c & 255;
+}
+
+static renode_t* read_re_any( void ) {
+    // re-any := '.' .
+    if ( ch != '.' ) return 0;
+    store_regex_char( '.' );
     rdch();
-    return true;
+    renode_t* re = new_re_node( RE_SET, 0, 0 );
+    set_add_range( re->set, 0, '\n'-1 );
+    set_add_range( re->set, '\n'+1, 255 );
+    return re;
 }
 
-static bool read_re_cc_chr( void ) {
-    // re-cc-chr := '\' /./ | /[^\\\]]/ .
-    if ( ch == '\\' ) {
+static int read_re_utf8( unsigned char b[4], int* numBytes ) {
+    // re-utf8 := /[\xc2-\xf4][\x80-\xbf]+/ .
+    // reads a byte above 0x7f and the continuation bytes that belong to it
+    // into b; returns the code point if they are valid UTF-8, or -1
+    int n = ch >= 0xf0 ? 4 : ch >= 0xe0 ? 3 : ch >= 0xc0 ? 2 : 1;
+    int cp = ch & ( 0x7f >> n ), k = 0;
+    for (;;) {
+        b[k++] = (unsigned char) ch;
+        store_regex_char( (char) ch );
         rdch();
-        if ( ch == EOF ) report( "unexpected end of file" );
-        store_regex_char( '\\' );
+        if ( k == n || ch < 0x80 || ch > 0xbf ) break;
+        cp = cp << 6 | ( ch & 0x3f );
+    }
+    *numBytes = k;
+    if ( n == 1 || k < n || b[0] > 0xf4 || cp > MAX_CODE_POINT ||
+        ( cp >= 0xd800 && cp <= 0xdfff ) ||
+        cp < ( n == 2 ? 0x80 : n == 3 ? 0x800 : 0x10000 ) ) {
+        return -1;
+    }
+    return cp;
+}
+
+static renode_t* read_re_chr( void ) {
+    // re-chr := re-esc | re-utf8 | /[^\/.*+?[()|{]/ .
+    switch ( ch ) {
+        case EOF:
+            report( "unexpected end of file" );
+        case '/': case '.': case '*': case '+': case '?': case '[': case '(':
+        case ')': case '|': case '{':
+            return 0;
+        default: break;
+    }
+    unsigned char b[4]; int n;
+    if ( ch >= 0x80 ) {
+        // a character is repeated as a whole, even if it isn't valid UTF-8
+        if ( read_re_utf8( b, &n ) >= 0 ) reUtf8 = true;
+        return re_bytes( b, n );
+    }
+    renode_t* re = new_re_node( RE_SET, 0, 0 );
+    if ( ch == '\\' ) {
+        int c = read_re_esc( re->set );
+        if ( c >= RE_CODE_POINT ) {
+            n = utf8_encode( c & ~RE_CODE_POINT, b );
+            free( re );
+            return re_bytes( b, n );
+        }
     } else {
-        switch ( ch ) {
-            case EOF:
-                report( "unexpected end of file" );
-            case '\\': case ']':
-                return false;
-            default: break;
+        store_regex_char( (char) ch );
+        set_add_range( re->set, ch & 255, ch & 255 );
+        rdch();
+    }
+    return re;
+}
+
+static int read_re_cc_chr( reclass_t* cls ) {
+    // re-cc-chr := re-esc | re-utf8 | /[^\\\]]/ .
+    // adds the byte, code point or class to cls; returns what read_re_esc
+    // returns, or -2 if there is none
+    switch ( ch ) {
+        case EOF:
+            report( "unexpected end of file" );
+        case ']':
+            return -2;
+        case '\\': {
+            int c = read_re_esc( cls->set );
+            if ( c == RE_NEG_CLASS ) cls->negClass = true;
+            if ( c < RE_CODE_POINT ) return c;
+            class_add_range( cls, c & ~RE_CODE_POINT, c & ~RE_CODE_POINT );
+            cls->codePoints = true;
+            return c;
         }
+        default: break;
+    }
+    if ( ch >= 0x80 ) {
+        unsigned char b[4]; int n;
+        int cp = read_re_utf8( b, &n );
+        if ( cp >= 0 ) {
+            class_add_range( cls, cp, cp );
+            cls->codePoints = true;
+            return RE_CODE_POINT | cp;
+        }
+        for ( int i=0; i < n; ++i ) set_add_range( cls->set, b[i], b[i] );
+        return n == 1 ? b[0] : -1;
     }
+    int c = ch & 255;
     store_regex_char( (char) ch );
+    set_add_range( cls->set, c, c );
     rdch();
-    return true;
+    return c;
 }
 
-static bool read_re_cc_item( void ) {
+static bool read_re_cc_item( reclass_t* cls ) {
     // re-cc-rng  := re-cc-chr '-' re-cc-chr .
     // re-cc-item := re-cc-rng | re-cc-chr .
     // -or-
     // re-cc-item := re-cc-chr [ '-' re-cc-chr ] .
-    if ( !read_re_cc_chr() ) return false;;
-    if ( ch == '-' ) {
-        store_regex_char( '-' );
-        rdch();
-        if ( !read_re_cc_chr() ) report( "bad character class in regular expression" );
+    // (a '-' right before the closing ']' stands for itself; a range with
+    // a code point at either end is a range of code points)
+    int from = read_re_cc_chr( cls );
+    if ( from == -2 ) return false;
+    if ( ch != '-' ) return true;
+    store_regex_char( '-' );
+    rdch();
+    if ( ch == ']' ) {
+        set_add_range( cls->set, '-', '-' );
+        return true;
+    }
+    reclass_t tmp;
+    memset( &tmp, 0, sizeof(tmp) );
+    int to = read_re_cc_chr( &tmp );
+    free( tmp.ranges );
+    if ( to == -2 ) report( "bad character class in regular expression" );
+    if ( from < 0 || to < 0 || ( to & ~RE_CODE_POINT ) < ( from & ~RE_CODE_POINT ) ) {
+        report( "bad range in character class" );
+    }
+    if ( ( from | to ) & RE_CODE_POINT ) {
+        class_add_range( cls, from & ~RE_CODE_POINT, to & ~RE_CODE_POINT );
+        cls->codePoints = true;
+    } else {
+        set_add_range( cls->set, from, to );
     }
     return true;
 }
 
-static bool read_re_cc_items( void ) {
+static renode_t* read_re_cc( void ) {
     // re-cc-items := re-cc-item { re-cc-item } .
-    if ( !read_re_cc_item() ) return false;
-    while ( read_re_cc_item() );
-    return true;
-}
-
-static bool read_re_cc( void ) {
     // re-cc := '[' [ '^' ] re-cc-items ']' .
-    if ( ch != '[' ) return false;
+    if ( ch != '[' ) return 0;
     store_regex_char( '[' );
     rdch();
+    bool negate = false;
     if ( ch == '^' ) {
         store_regex_char( '^' );
         rdch();
+        negate = true;
     }
-    if ( !read_re_cc_items() || ch != ']' ) report( "bad character class in regular expression" );
+    reclass_t cls;
+    memset( &cls, 0, sizeof(cls) );
+    if ( !read_re_cc_item( &cls ) ) report( "bad character class in regular expression" );
+    while ( read_re_cc_item( &cls ) );
     store_regex_char( ']' );
     rdch();
-    return true;
+    if ( cls.codePoints ) {
+        reUtf8 = true;
+        return re_unicode_class( &cls, negate );
+    }
+    renode_t* re = new_re_node( RE_SET, 0, 0 );
+    for ( int i=0; i < 32; ++i ) {
+        re->set[i] = negate ? (unsigned char) ~cls.set[i] : cls.set[i];
+    }
+    if ( negate ) {
+        if ( numReNegClasses >= reNegClassAlloc ) {
+            reNegClassAlloc = reNegClassAlloc ? reNegClassAlloc * 2 : 16;
+            xrealloc( (void**)(&reNegClasses), sizeof(renegclass_t) *
+                (size_t) reNegClassAlloc );
+        }
+        renegclass_t* neg = &reNegClasses[numReNegClasses++];
+        neg->node     = re;
+        memcpy( neg->set, cls.set, sizeof(neg->set) );
+        neg->negClass = cls.negClass;
+    }
+    return re;
 }
 
-static bool read_re_expr( void );
+static renode_t* read_re_expr( void );
 
-static bool read_re_base_expr( void ) {
+static renode_t* read_re_base_expr( void ) {
     // re-base-expr := re-cc | re-chr | re-any | '(' re-expr ')' .
-    if ( read_re_cc() || read_re_chr() || read_re_any() ) return true;
-    if ( ch != '(' ) return false;
+    renode_t* re;
+    if ( ( re = read_re_cc() ) != 0 || ( re = read_re_chr() ) != 0 ||
+        ( re = read_re_any() ) != 0 ) return re;
+    if ( ch != '(' ) return 0;
     store_regex_char( '(' );
     rdch();
-    if ( !read_re_expr() || ch != ')' ) report( "expression expected in regular expression" );
+    if ( ( re = read_re_expr() ) == 0 ) report( "expression expected in regular expression" );
+    if ( ch != ')' ) report( "')' expected in regular expression" );
     store_regex_char( ')' );
     rdch();
-    return true;
+    return re;
+}
+
+static int read_re_count_number( void ) {
+    // /[0-9]+/ ; returns -1 if there is none
+    if ( !isdigit( ch ) ) return -1;
+    int n = 0;
+    do {
+        n = n * 10 + ( ch - '0' );
+        if ( n > MAX_REPEAT_COUNT ) {
+            report( "repetition count exceeds %d", MAX_REPEAT_COUNT );
+        }
+        store_regex_char( (char) ch );
+        rdch();
+    } while ( isdigit( ch ) );
+    return n;
+}
+
+static long re_nfa_states( const renode_t* re ) {
+    // the number of NFA states push_re_frag() creates for re, or more than
+    // MAX_REGEX_NFA if that is exceeded
+    long l = re->left ? re_nfa_states( re->left ) : 0;
+    switch ( re->type ) {
+        case RE_SET:    return 2;
+        case RE_CONCAT: l += re_nfa_states( re->right ); break;
+        case RE_ALTERN: l += re_nfa_states( re->right ) + 2; break;
+        case RE_STAR:
+        case RE_PLUS:
+        case RE_OPT:    l += 2; break;
+        case RE_REPEAT: {
+            long copies = re->max < 0 ? ( re->min > 0 ? re->min : 1 ) : re->max;
+            l = copies * l + ( re->max < 0 ? 2 : re->max > re->min ?
+                re->max - re->min + 1 : copies == 0 ? 1 : 0 );
+            break;
+        }
+    }
+    return l > MAX_REGEX_NFA ? MAX_REGEX_NFA + 1 : l;
+}
+
+static renode_t* read_re_count( renode_t* left ) {
+    // re-count := '{' /[0-9]+/ [ ',' [ /[0-9]+/ ] ] '}' .
+    store_regex_char( '{' );
+    rdch();
+    renode_t* re = new_re_node( RE_REPEAT, left, 0 );
+    re->min = re->max = read_re_count_number();
+    if ( re->min < 0 ) report( "repetition count expected after '{' in regular expression" );
+    if ( ch == ',' ) {
+        store_regex_char( ',' );
+        rdch();
+        re->max = read_re_count_number();
+        if ( re->max >= 0 && re->max < re->min ) {
+            report( "maximum repetition count is less than the minimum in "
+                "regular expression" );
+        }
+    }
+    if ( ch != '}' ) report( "'}' expected in regular expression" );
+    store_regex_char( '}' );
+    rdch();
+    if ( re_nfa_states( re ) > MAX_REGEX_NFA ) {
+        report( "counted repetition expands to more than %d NFA states",
+            MAX_REGEX_NFA );
+    }
+    return re;
 }
 
-static bool read_re_repeat_expr( void ) {
-    // re-repeat-expr := re-base-expr [ '+' | '*' | '?' ] .
-    if ( !read_re_base_expr() ) return false;
-    if ( ch == '+' || ch == '*' || ch == '?' ) {
+static renode_t* read_re_repeat_expr( void ) {
+    // re-repeat-expr := re-base-expr { '+' | '*' | '?' | re-count } .
+    renode_t* re = read_re_base_expr();
+    if ( re == 0 ) return 0;
+    while ( ch == '+' || ch == '*' || ch == '?' || ch == '{' ) {
+        if ( ch == '{' ) {
+            re = read_re_count( re );
+            continue;
+        }
         store_regex_char( (char) ch );
+        re = new_re_node( ch == '+' ? RE_PLUS : ch == '*' ? RE_STAR : RE_OPT,
+            re, 0 );
         rdch();
     }
-    return true;
+    return re;
 }
 
-static bool read_re_and_expr( void ) {
+static renode_t* read_re_and_expr( void ) {
     // re-and-expr := re-repeat-expr { re-repeat-expr } .
-    if ( !read_re_repeat_expr() ) return false;
-    while ( read_re_repeat_expr() );
-    return true;
+    renode_t* re = read_re_repeat_expr();
+    if ( re == 0 ) return 0;
+    renode_t* next;
+    while ( ( next = read_re_repeat_expr() ) != 0 ) {
+        re = new_re_node( RE_CONCAT, re, next );
+    }
+    return re;
 }
 
-static bool read_re_or_expr( void ) {
+static renode_t* read_re_or_expr( void ) {
     // re-or-expr := re-and-expr { '|' re-and-expr } .
-    if ( !read_re_and_expr() ) return false;
-    do {
-        if ( ch != '|' ) break;
+    renode_t* re = read_re_and_expr();
+    if ( re == 0 ) return 0;
+    while ( ch == '|' ) {
         store_regex_char( '|' );
         rdch();
-        if ( !read_re_and_expr() ) report( "expression expected in regular expression" );
-    } while ( true );
-    return true;
+        renode_t* next = read_re_and_expr();
+        if ( next == 0 ) report( "expression expected in regular expression" );
+        re = new_re_node( RE_ALTERN, re, next );
+    }
+    return re;
 }
 
-static bool read_re_expr( void ) {
+static renode_t* read_re_expr( void ) {
     // re-expr := re-or-expr .
     return read_re_or_expr();
 }
 
+// -- regular expression NFA --------------------------------------------------
+
+// a Thompson NFA is built from the tree of every regular expression: each
+// push_*_frag function pushes one fragment onto refrags, after popping the
+// fragments it combines.
+
+typedef struct _nfastate_t {
+    bool            consuming;  // consumes one byte out of 'set', then 'out'
+    unsigned char   set[32];
+    int             out;        // successor, or -1
+    int             out1;       // second epsilon successor, or -1
+    int             tag;        // accepting state: what is accepted, or -1
+} nfastate_t;
+
+typedef struct _nfafrag_t {
+    int             start;
+    int             end;        // epsilon state whose 'out' is still open
+} nfafrag_t;
+
+static nfastate_t* nfaStates     = 0;
+static int         numNfaStates  = 0;
+static int         nfaStateAlloc = 0;
+
+static nfafrag_t   refrags[256];
+static int         numRefrags = 0;
+
+static int new_nfa_state( bool consuming, int out, int out1 ) {
+    if ( numNfaStates >= nfaStateAlloc ) {
+        nfaStateAlloc = nfaStateAlloc ? nfaStateAlloc * 2 : 256;
+        xrealloc( (void**)(&nfaStates), sizeof(nfastate_t) *
+            (size_t) nfaStateAlloc );
+    }
+    nfastate_t* st = &nfaStates[numNfaStates];
+    memset( st->set, 0, sizeof(st->set) );
+    st->consuming = consuming;
+    st->out       = out;
+    st->out1      = out1;
+    st->tag       = -1;
+    return numNfaStates++;
+}
+
+static void push_frag( int start, int end ) {
+    if ( numRefrags >= 256 ) report( "regular expression nested too deeply" );
+    refrags[numRefrags].start = start;
+    refrags[numRefrags].end   = end;
+    ++numRefrags;
+}
+
+static nfafrag_t pop_frag( void ) {
+    return refrags[--numRefrags];
+}
+
+static void push_set_frag( const unsigned char set[32] ) {
+    int e = new_nfa_state( false, -1, -1 );
+    int s = new_nfa_state( true, e, -1 );
+    memcpy( nfaStates[s].set, set, 32U );
+    push_frag( s, e );
+}
+
+static void push_concat_frag( void ) {
+    nfafrag_t b = pop_frag(), a = pop_frag();
+    nfaStates[a.end].out = b.start;
+    push_frag( a.start, b.end );
+}
+
+static void push_altern_frag( void ) {
+    nfafrag_t b = pop_frag(), a = pop_frag();
+    int e = new_nfa_state( false, -1, -1 );
+    int s = new_nfa_state( false, a.start, b.start );
+    nfaStates[a.end].out = e;
+    nfaStates[b.end].out = e;
+    push_frag( s, e );
+}
+
+static void push_repeat_frag( int op ) {
+    nfafrag_t a = pop_frag();
+    int e = new_nfa_state( false, -1, -1 );
+    int s = new_nfa_state( false, a.start, e );
+    switch ( op ) {
+        case '*': nfaStates[a.end].out = s; push_frag( s, e );       break;
+        case '+': nfaStates[a.end].out = s; push_frag( a.start, e ); break;
+        default:  nfaStates[a.end].out = e; push_frag( s, e );       break;
+    }
+}
+
+static void push_empty_frag( void ) {
+    int e = new_nfa_state( false, -1, -1 );
+    push_frag( e, e );
+}
+
+static void push_counted_frag( int min, int max,
+    void (*push_copy)( const void* ), const void* what ) {
+    // pushes min copies of a fragment, then max-min optional ones, each
+    // skipping all of the rest (or, if max is -1, one repeated copy);
+    // push_copy pushes a fresh copy of the fragment for what.  Regexes are
+    // checked against MAX_REGEX_NFA when they are read, TOKEN and SKIP
+    // productions by push_production_frag(); the checks here only stop
+    // nested counts from expanding far beyond that before
+    int n = 0, base = numNfaStates;
+    for ( int i=0; i < min - ( max < 0 ? 1 : 0 ); ++i ) {
+        push_copy( what );
+        if ( n++ > 0 ) push_concat_frag();
+        if ( numNfaStates - base > MAX_REGEX_NFA ) {
+            report2( "counted repetition expands to more than %d NFA states",
+                MAX_REGEX_NFA );
+        }
+    }
+    if ( max < 0 ) {
+        push_copy( what );
+        push_repeat_frag( min > 0 ? '+' : '*' );
+        if ( n++ > 0 ) push_concat_frag();
+    } else if ( max > min ) {
+        int e = new_nfa_state( false, -1, -1 );
+        for ( int i=min; i < max; ++i ) {
+            push_copy( what );
+            if ( numNfaStates - base > MAX_REGEX_NFA ) {
+                report2( "counted repetition expands to more than %d NFA "
+                    "states", MAX_REGEX_NFA );
+            }
+            nfafrag_t a = pop_frag();
+            push_frag( new_nfa_state( false, a.start, e ), a.end );
+            if ( n++ > 0 ) push_concat_frag();
+        }
+        nfafrag_t a = pop_frag();
+        nfaStates[a.end].out = e;
+        push_frag( a.start, e );
+    }
+    if ( n == 0 ) push_empty_frag();
+}
+
+static void push_re_frag( const renode_t* re );
+
+static void push_re_copy( const void* re ) {
+    push_re_frag( (const renode_t*) re );
+}
+
+static void push_re_frag( const renode_t* re ) {
+    switch ( re->type ) {
+        case RE_SET:
+            push_set_frag( re->set );
+            break;
+        case RE_CONCAT:
+            push_re_frag( re->left );
+            push_re_frag( re->right );
+            push_concat_frag();
+            break;
+        case RE_ALTERN:
+            push_re_frag( re->left );
+            push_re_frag( re->right );
+            push_altern_frag();
+            break;
+        case RE_STAR: push_re_frag( re->left ); push_repeat_frag( '*' ); break;
+        case RE_PLUS: push_re_frag( re->left ); push_repeat_frag( '+' ); break;
+        case RE_OPT:  push_re_frag( re->left ); push_repeat_frag( '?' ); break;
+        case RE_REPEAT:
+            push_counted_frag( re->min, re->max, push_re_copy, re->left );
+            break;
+    }
+}
+
 static treenode_t* read_regex( void ) {
     // regex := '/' re-expr '/' .
-    if ( ch != '/' ) return false;
+    if ( ch != '/' ) return 0;
     rdch();
     repos = 0;
-    if ( !read_re_expr() ) report( "regular expression expected" );
+    reUtf8 = false;
+    numReNegClasses = 0;
+    renode_t* re = read_re_expr();
+    if ( re == 0 ) report( "regular expression expected" );
     if ( ch != '/' ) report( "delimiter '/' expected after regular expression" );
     rdch();
-    regex[repos] = '\0';
-    return create_node( T_REG_EX, regex );
+    if ( reUtf8 ) {
+        for ( int i=0; i < numReNegClasses; ++i ) {
+            renegclass_t* neg = &reNegClasses[i];
+            reclass_t cls;
+            memset( &cls, 0, sizeof(cls) );
+            memcpy( cls.set, neg->set, sizeof(cls.set) );
+            cls.negClass = neg->negClass;
+            renode_t* cp = re_unicode_class( &cls, true );
+            *neg->node = *cp;
+            free( cp );
+        }
+    }
+    if ( re_nfa_states( re ) > MAX_REGEX_NFA ) {
+        report( "regular expression expands to more than %d NFA states",
+            MAX_REGEX_NFA );
+    }
+    store_regex_char( '\0' );
+    treenode_t* node = create_node( T_REG_EX, regex );
+    node->re       = re;
+    numRefrags     = 0;
+    node->nfaBase  = numNfaStates;
+    push_re_frag( re );
+    nfafrag_t frag = pop_frag();
+    node->nfaCount = numNfaStates - node->nfaBase;
+    node->nfaStart = frag.start;
+    nfaStates[frag.end].tag = 0;
+    return node;
 }
 
 static treenode_t* read_expr( void );
@@ -524,14 +1260,47 @@ static treenode_t* read_brack_expr( void ) {
     return node;
 }
 
+static int read_count_number( void ) {
+    // /[0-9]+/ ; returns -1 if there is none
+    skip_whitespace();
+    if ( !isdigit( ch ) ) return -1;
+    int n = 0;
+    do {
+        n = n * 10 + ( ch - '0' );
+        if ( n > MAX_REPEAT_COUNT ) {
+            report( "repetition count exceeds %d", MAX_REPEAT_COUNT );
+        }
+        rdch();
+    } while ( isdigit( ch ) );
+    return n;
+}
+
 static treenode_t* read_brace_expr( void ) {
-    // '{' expr '}'
+    // '{' expr '}' [ '*' count ]
+    // count := /[0-9]+/ [ ',' [ /[0-9]+/ ] ] .
     rdch();
     treenode_t* expr = read_expr();
     if ( expr == 0 ) report( "expression expected after '{'" );
     if ( ch != '}' ) report( "closing brace '}' expected" );
     rdch();
-    treenode_t* node = create_node( T_BRACE_EXPR, 0 );
+    skip_whitespace();
+    if ( ch != '*' ) {
+        treenode_t* node = create_node( T_BRACE_EXPR, 0 );
+        add_branch( node, expr );
+        return node;
+    }
+    rdch();
+    treenode_t* node = create_node( T_COUNT_EXPR, 0 );
+    node->minCount = node->maxCount = read_count_number();
+    if ( node->minCount < 0 ) report( "repetition count expected after '*'" );
+    skip_whitespace();
+    if ( ch == ',' ) {
+        rdch();
+        node->maxCount = read_count_number();
+        if ( node->maxCount >= 0 && node->maxCount < node->minCount ) {
+            report( "maximum repetition count is less than the minimum" );
+        }
+    }
     add_branch( node, expr );
     return node;
 }
@@ -584,7 +1353,7 @@ static treenode_t* read_bin_match( void ) {
 
 static treenode_t* read_base_expr( void ) {
     // base-expr := identifier | str-literal | regex | bin-match | '(' expr ')'
-    //              | '[' expr ']' | '{' expr '}' .
+    //              | '[' expr ']' | '{' expr '}' [ '*' count ] .
     skip_whitespace();
     switch ( ch ) {
         case '\'': case '"':    return read_str_literal();
@@ -646,20 +1415,50 @@ static treenode_t* read_expr( void ) {
 }
 
 
+// lexer modes; mode 0, "main", holds all tokens declared without a mode
+static char** lexerModes    = 0;
+static int    numLexerModes = 0;
+
+static int lexer_mode( const char* name ) {
+    if ( numLexerModes == 0 ) {
+        lexerModes = (char**) xmalloc( sizeof(char*) );
+        lexerModes[ numLexerModes++ ] = xstrdup( "main" );
+    }
+    for ( int i=0; i < numLexerModes; ++i ) {
+        if ( strcmp( lexerModes[i], name ) == 0 ) return i;
+    }
+    xrealloc( (void**)(&lexerModes), sizeof(char*) *
+        (size_t)( numLexerModes + 1 ) );
+    lexerModes[ numLexerModes ] = xstrdup( name );
+    return numLexerModes++;
+}
+
 static treenode_t* read_production( void ) {
-    // production  := [ 'TOKEN' ] identifier ':=' expr '.' .
+    // production  := [ ( 'TOKEN' | 'SKIP' ) [ ':' identifier ] ] identifier
+    //                ':=' expr '.' .
     skip_whitespace();
     char tmp[6]; int pos = 0;
-    tmp[0] = '\0'; bool token = false;
+    tmp[0] = '\0'; bool token = false, skip = false; int lexerMode = 0;
     switch ( ch ) {
         case 'T':
+        case 'S':
             do {
                 tmp[pos++] = (char) ch;
                 rdch();
             } while ( pos < 5 && ch >= 'A' && ch <= 'Z' );
             tmp[pos] = '\0';
-            if ( strcmp( tmp, "TOKEN" ) == 0 ) {
-                token = true;
+            token = strcmp( tmp, "TOKEN" ) == 0;
+            skip  = strcmp( tmp, "SKIP" ) == 0;
+            if ( token || skip ) {
+                if ( ch == ':' ) {
+                    rdch();
+                    if ( !( ( ch >= '0' && ch <= '9' ) || ( ch >= 'a' && ch <= 'z' ) ) ) {
+                        report( "lexer mode name expected after '%s:'", tmp );
+                    }
+                    treenode_t* mode = read_identifier();
+                    lexerMode = lexer_mode( mode->text );
+                    delete_node( mode );
+                }
                 break;
             }
             putback( ch );
@@ -691,6 +1490,9 @@ static treenode_t* read_production( void ) {
     if ( ch != '.' ) report( "'.' expected" );
     rdch();
     treenode_t* node = create_node( T_PRODUCTION, ident->text );
+    node->isToken   = token;
+    node->isSkip    = skip;
+    node->lexerMode = lexerMode;
     delete_node( ident );
     add_branch( node, expr );
     return node;
@@ -739,401 +1541,4154 @@ static void deduplicate_literals( treenode_t** pBranch, treenode_t* node ) {
     }
 }
 
-static FILE* impfp = 0;
-static FILE* hdrfp = 0;
-static char  impfile[256] = { 0, }, hdrfile[256] = { 0, };
-static const char* fileStem = 0;
-
-static void help( void ) {
-    printf( "%s",
-        "usage: ebnfcomp [options] <file-stem>\n"
-        "options:\n"
-        "    --help, -h                 (this)\n"
-        "    --tree, -t                 output syntax tree\n"
-        "    --asm , -a                 output assembly language, not C\n"
-        "default behavior:\n"
-        "    compiles EBNF specified on standard input to internal form,\n"
-        "    then outputs C or assembly language code for a parsing table to\n"
-        "    a header and implementation file named using <file-stem>.\n"
-    );
+static void detect_literal_sets( treenode_t* node ) {
+    // alternatives consisting only of string literals, like
+    // 'BYTE' | 'WORD' | 'DWORD' | 'QWORD', are matched through a trie
+    if ( node == 0 ) return;
+    if ( node->token == T_OR_EXPR && node->numBranches >= 2U ) {
+        size_t i;
+        for ( i=0; i < node->numBranches; ++i ) {
+            if ( node->branches[i]->token != T_STR_LITERAL ) break;
+        }
+        if ( i == node->numBranches ) {
+            node->token = T_LITERAL_SET;
+            return;
+        }
+    }
+    for ( size_t i=0; i < node->numBranches; ++i ) {
+        detect_literal_sets( node->branches[i] );
+    }
 }
 
-static void name_to_C_enum( char buf[256], const char* name ) {
-    snprintf( buf, 256U, "NT_%s", name );
-    size_t len = strlen( buf );
-    for ( size_t i=0U; i < len; ++i ) {
-        if ( buf[i] == '-' ) buf[i] = '_';
-        if ( buf[i] >= 'a' && buf[i] <= 'z' ) buf[i] -= 'a'-'A';
+// -- literal set tries -------------------------------------------------------
+
+typedef struct _triestate_t {
+    int         accept;     // node id of the literal ending here, or -1
+    int         child[256]; // state index, or 0 for none (root is never a child)
+    int         numEdges;
+    int         edges;
+} triestate_t;
+
+static triestate_t* trieStates    = 0;
+static int          numTrieStates = 0;
+static int          trieStateAlloc = 0;
+static int          numTrieEdges  = 0;
+
+static int new_trie_state( void ) {
+    if ( numTrieStates >= trieStateAlloc ) {
+        trieStateAlloc = trieStateAlloc ? trieStateAlloc * 2 : 64;
+        xrealloc( (void**)(&trieStates), sizeof(triestate_t) *
+            (size_t) trieStateAlloc );
     }
+    triestate_t* st = &trieStates[numTrieStates];
+    memset( st, 0, sizeof(triestate_t) );
+    st->accept = -1;
+    return numTrieStates++;
 }
 
-static bool is_export_node( treenode_t* node ) {
+static int build_literal_trie( treenode_t* node ) {
+    int root = new_trie_state();
+    for ( size_t i=0; i < node->numBranches; ++i ) {
+        treenode_t* lit = node->branches[i];
+        int st = root;
+        for ( const char* p = lit->text; *p != '\0'; ++p ) {
+            int c = (unsigned char) *p;
+            if ( trieStates[st].child[c] == 0 ) {
+                int nst = new_trie_state();
+                trieStates[st].child[c] = nst;
+            }
+            st = trieStates[st].child[c];
+        }
+        // the first of duplicate alternatives wins, as in sequential matching
+        if ( trieStates[st].accept == -1 ) trieStates[st].accept = lit->id;
+    }
+    // edges are laid out contiguously per state, sorted by character
+    for ( int st = root; st < numTrieStates; ++st ) {
+        trieStates[st].edges = numTrieEdges;
+        for ( int c=0; c < 256; ++c ) {
+            if ( trieStates[st].child[c] ) trieStates[st].numEdges++;
+        }
+        numTrieEdges += trieStates[st].numEdges;
+    }
+    return root;
+}
+
+// -- counted repetitions -----------------------------------------------------
+
+// the counts of every counted repetition ('{' expr '}' '*' count) go to
+// <stem>_repeats, which the node refers to by its aux field, so a parser
+// matches the repeated expression in a loop with a counter.
+
+typedef struct _repeatcount_t {
+    int         min;
+    int         max;        // -1: no limit
+} repeatcount_t;
+
+static repeatcount_t* repeatCounts    = 0;
+static int            numRepeatCounts = 0;
+
+static int add_repeat_count( int min, int max ) {
+    xrealloc( (void**)(&repeatCounts), sizeof(repeatcount_t) *
+        (size_t)( numRepeatCounts + 1 ) );
+    repeatCounts[numRepeatCounts].min = min;
+    repeatCounts[numRepeatCounts].max = max;
+    return numRepeatCounts++;
+}
+
+// -- regular expression DFA --------------------------------------------------
+
+// the NFA of every regular expression terminal is determinised by subset
+// construction and then minimised using Hopcroft's partition refinement.
+// accepting NFA states carry a tag; a DFA state accepts the lowest tag among
+// its NFA states, so the lexer can give earlier tokens priority.  A regex
+// whose DFA would need more than lazyDfaLimit states (--lazy-dfa) gets no
+// DFA at all; it is matched from its NFA, building DFA states on demand.
+// Minimisation numbers the states breadth-first in byte order, which makes
+// equal languages give identical tables, so regexes that are written
+// differently but match the same (like /[0-9a-f]+/ and /[a-f0-9]+/) share
+// one DFA and everything derived from it.
+
+#define MAX_DFA_STATES 4096
+
+typedef struct _dfa_t {
+    int         numStates;
+    int*        trans;      // numStates x 256, -1 for no transition
+    int*        accept;     // accepted tag, or -1
+    int         numStarts;  // the first start state is state 0
+    int*        starts;     // start states, or -1 if nothing can match
+    bool        lazy;       // too many states, see lazyDfaLimit
+} dfa_t;
+
+static dfa_t*   dfas      = 0;
+static int      numDfas   = 0;
+static int      dfaAlloc  = 0;
+static int      numDfaStatesTotal = 0;
+static int      lazyDfaLimit      = MAX_DFA_STATES;
+
+static void nfa_closure( unsigned* set, int base, int count, int* stack ) {
+    int sp = 0;
+    for ( int w=0; w < ( count + 31 ) / 32; ++w ) {
+        for ( unsigned m = set[w]; m != 0U; m &= m - 1U ) {
+            stack[sp++] = w * 32 + __builtin_ctz( m );
+        }
+    }
+    while ( sp > 0 ) {
+        nfastate_t* st = &nfaStates[ base + stack[--sp] ];
+        if ( st->consuming ) continue;
+        int outs[2] = { st->out, st->out1 };
+        for ( int k=0; k < 2; ++k ) {
+            if ( outs[k] < 0 ) continue;
+            int i = outs[k] - base;
+            if ( set[i>>5] & ( 1U << (i&31) ) ) continue;
+            set[i>>5] |= 1U << (i&31);
+            stack[sp++] = i;
+        }
+    }
+}
+
+typedef struct _subsets_t {
+    unsigned*   sets;       // one NFA state set per DFA state
+    size_t      words;
+    int         alloc;
+    unsigned*   hashes;     // the hash of each set
+    int*        table;      // open addressing by hash: DFA state, or -1
+    int         tableSize;  // a power of 2, at least twice the states
+} subsets_t;
+
+static unsigned subset_hash( const unsigned* set, size_t words ) {
+    // FNV-1a over the words of set
+    unsigned h = 2166136261U;
+    for ( size_t i=0; i < words; ++i ) h = ( h ^ set[i] ) * 16777619U;
+    return h;
+}
+
+static void subset_rehash( subsets_t* ss, int numStates ) {
+    ss->tableSize = ss->tableSize ? ss->tableSize * 2 : 64;
+    xrealloc( (void**)(&ss->table), sizeof(int) * (size_t) ss->tableSize );
+    for ( int i=0; i < ss->tableSize; ++i ) ss->table[i] = -1;
+    for ( int t=0; t < numStates; ++t ) {
+        int i = (int)( ss->hashes[t] & (unsigned)( ss->tableSize - 1 ) );
+        while ( ss->table[i] >= 0 ) i = ( i + 1 ) & ( ss->tableSize - 1 );
+        ss->table[i] = t;
+    }
+}
+
+static int subset_state( dfa_t* dfa, subsets_t* ss, const unsigned* set,
+    int base, int limit ) {
+    // the DFA state of set, or -1 if that would be more than limit states
+    unsigned h = subset_hash( set, ss->words );
+    int i = (int)( h & (unsigned)( ss->tableSize - 1 ) ), t;
+    while ( ( t = ss->table[i] ) >= 0 ) {
+        if ( ss->hashes[t] == h && memcmp( &ss->sets[ (size_t) t *
+            ss->words ], set, sizeof(unsigned) * ss->words ) == 0 ) return t;
+        i = ( i + 1 ) & ( ss->tableSize - 1 );
+    }
+    t = dfa->numStates;
+    if ( t >= limit ) return -1;
+    if ( t >= ss->alloc ) {
+        ss->alloc = ss->alloc ? ss->alloc * 2 : 16;
+        xrealloc( (void**)(&ss->sets), sizeof(unsigned) * ss->words *
+            (size_t) ss->alloc );
+        xrealloc( (void**)(&ss->hashes), sizeof(unsigned) *
+            (size_t) ss->alloc );
+        xrealloc( (void**)(&dfa->trans), sizeof(int) * 256U *
+            (size_t) ss->alloc );
+        xrealloc( (void**)(&dfa->accept), sizeof(int) * (size_t) ss->alloc );
+    }
+    memcpy( &ss->sets[ (size_t) t * ss->words ], set,
+        sizeof(unsigned) * ss->words );
+    ss->hashes[t] = h;
+    ss->table[i]  = t;
+    int tag = -1;
+    for ( size_t w=0; w < ss->words; ++w ) {
+        for ( unsigned m = set[w]; m != 0U; m &= m - 1U ) {
+            int g = nfaStates[ base + (int) w * 32 + __builtin_ctz( m ) ].tag;
+            if ( g >= 0 && ( tag < 0 || g < tag ) ) tag = g;
+        }
+    }
+    dfa->accept[t] = tag;
+    dfa->numStates++;
+    if ( 2 * dfa->numStates > ss->tableSize ) subset_rehash( ss, dfa->numStates );
+    return t;
+}
+
+static bool determinise( int base, int count, const int* starts,
+    int numStarts, int limit, dfa_t* dfa ) {
+    // false if the DFA would need more than limit states
+    subsets_t ss;
+    ss.sets      = 0;
+    ss.words     = ( (size_t) count + 31U ) / 32U;
+    ss.alloc     = 0;
+    ss.hashes    = 0;
+    ss.table     = 0;
+    ss.tableSize = 0;
+    subset_rehash( &ss, 0 );
+    int*      stack = (int*) xmalloc( sizeof(int) * (size_t) count );
+    int*      moves = (int*) xmalloc( sizeof(int) * (size_t) count );
+    unsigned* next  = (unsigned*) xmalloc( sizeof(unsigned) * ss.words );
+    dfa->numStates  = 0;
+    dfa->trans      = 0;
+    dfa->accept     = 0;
+    dfa->numStarts  = numStarts;
+    dfa->starts     = (int*) xmalloc( sizeof(int) * (size_t) numStarts );
+    dfa->lazy       = false;
+    bool fits       = true;
+    for ( int k=0; k < numStarts; ++k ) {
+        dfa->starts[k] = -1;
+        if ( starts[k] < 0 ) continue;
+        int start = starts[k] - base;
+        memset( next, 0, sizeof(unsigned) * ss.words );
+        next[start>>5] |= 1U << (start&31);
+        nfa_closure( next, base, count, stack );
+        dfa->starts[k] = subset_state( dfa, &ss, next, base, limit );
+        if ( dfa->starts[k] < 0 ) fits = false;
+    }
+    for ( int d=0; fits && d < dfa->numStates; ++d ) {
+        // the consuming NFA states of d, so that each byte only looks at
+        // those
+        const unsigned* cur = &ss.sets[ (size_t) d * ss.words ];
+        int numMoves = 0;
+        for ( size_t w=0; w < ss.words; ++w ) {
+            for ( unsigned m = cur[w]; m != 0U; m &= m - 1U ) {
+                int i = (int) w * 32 + __builtin_ctz( m );
+                if ( nfaStates[ base + i ].consuming ) moves[numMoves++] = i;
+            }
+        }
+        for ( int c=0; c < 256; ++c ) {
+            // move on c, then close
+            bool any = false;
+            for ( int k=0; k < numMoves; ++k ) {
+                nfastate_t* st = &nfaStates[ base + moves[k] ];
+                if ( !set_has( st->set, c ) ) continue;
+                if ( !any ) memset( next, 0, sizeof(unsigned) * ss.words );
+                int j = st->out - base;
+                next[j>>5] |= 1U << (j&31);
+                any = true;
+            }
+            int t = -1;
+            if ( any ) {
+                nfa_closure( next, base, count, stack );
+                t = subset_state( dfa, &ss, next, base, limit );
+                if ( t < 0 ) { fits = false; break; }
+            }
+            dfa->trans[ d*256 + c ] = t;
+        }
+    }
+    free( ss.sets ); free( ss.hashes ); free( ss.table );
+    free( stack ); free( moves ); free( next );
+    if ( !fits ) {
+        free( dfa->trans ); free( dfa->accept );
+        dfa->trans = dfa->accept = 0;
+        dfa->numStates = 0;
+        for ( int k=0; k < numStarts; ++k ) dfa->starts[k] = -1;
+    }
+    return fits;
+}
+
+static void minimise( dfa_t* dfa ) {
+    // complete the automaton with a sink state, then refine the partition
+    // by accepted tag until it is stable (Hopcroft)
+    int n = dfa->numStates, N = n + 1, sink = n;
+    int* elems  = (int*) xmalloc( sizeof(int) * (size_t) N );
+    int* loc    = (int*) xmalloc( sizeof(int) * (size_t) N );
+    int* blk    = (int*) xmalloc( sizeof(int) * (size_t) N );
+    int* first  = (int*) xmalloc( sizeof(int) * (size_t) N );
+    int* len    = (int*) xmalloc( sizeof(int) * (size_t) N );
+    int* marked = (int*) xmalloc( sizeof(int) * (size_t) N );
+    int* work   = (int*) xmalloc( sizeof(int) * (size_t) N );
+    bool* inWork = (bool*) xmalloc( sizeof(bool) * (size_t) N );
+    int* touched  = (int*) xmalloc( sizeof(int) * (size_t) N );
+    int* splitter = (int*) xmalloc( sizeof(int) * (size_t) N );
+    int* invStart = (int*) xmalloc( sizeof(int) * ( 256U * (size_t) N + 1U ) );
+    int* inv      = (int*) xmalloc( sizeof(int) * 256U * (size_t) N );
+    int  numBlocks = 0, numWork = 0;
+
+    // inverse transitions, grouped by ( character, target )
+    memset( invStart, 0, sizeof(int) * ( 256U * (size_t) N + 1U ) );
+    for ( int s=0; s < N; ++s ) {
+        for ( int c=0; c < 256; ++c ) {
+            int t = s == sink ? sink : dfa->trans[ s*256 + c ];
+            if ( t < 0 ) t = sink;
+            invStart[ c*N + t + 1 ]++;
+        }
+    }
+    for ( int i=0; i < 256*N; ++i ) invStart[i+1] += invStart[i];
+    for ( int s=0; s < N; ++s ) {
+        for ( int c=0; c < 256; ++c ) {
+            int t = s == sink ? sink : dfa->trans[ s*256 + c ];
+            if ( t < 0 ) t = sink;
+            inv[ invStart[ c*N + t ] ] = s;
+            invStart[ c*N + t ]++;
+        }
+    }
+    for ( int i=256*N; i > 0; --i ) invStart[i] = invStart[i-1];
+    invStart[0] = 0;
+
+    // initial partition
+    int pos = 0;
+    for ( int s=0; s < N; ++s ) blk[s] = -1;
+    for ( int r=0; r < N; ++r ) {
+        if ( blk[r] >= 0 ) continue;
+        int tag = r == sink ? -1 : dfa->accept[r];
+        int start = pos;
+        for ( int s=r; s < N; ++s ) {
+            if ( blk[s] >= 0 || ( s == sink ? -1 : dfa->accept[s] ) != tag ) continue;
+            elems[pos] = s; loc[s] = pos; blk[s] = numBlocks; ++pos;
+        }
+        first[numBlocks] = start; len[numBlocks] = pos - start;
+        marked[numBlocks] = 0;
+        work[numWork++] = numBlocks; inWork[numBlocks] = true;
+        ++numBlocks;
+    }
+
+    while ( numWork > 0 ) {
+        int a = work[--numWork];
+        inWork[a] = false;
+        int alen = len[a];
+        memcpy( splitter, &elems[ first[a] ], sizeof(int) * (size_t) alen );
+        for ( int c=0; c < 256; ++c ) {
+            int numTouched = 0;
+            for ( int k=0; k < alen; ++k ) {
+                int t = splitter[k];
+                for ( int j = invStart[ c*N + t ]; j < invStart[ c*N + t + 1 ]; ++j ) {
+                    int s = inv[j], b = blk[s];
+                    // move s into the marked prefix of its block
+                    int p = first[b] + marked[b], q = loc[s];
+                    int o = elems[p];
+                    elems[p] = s; loc[s] = p;
+                    elems[q] = o; loc[o] = q;
+                    if ( marked[b]++ == 0 ) touched[numTouched++] = b;
+                }
+            }
+            for ( int k=0; k < numTouched; ++k ) {
+                int b = touched[k], m = marked[b];
+                marked[b] = 0;
+                if ( m == len[b] ) continue;
+                int nb = numBlocks++;
+                first[nb] = first[b]; len[nb] = m; marked[nb] = 0; inWork[nb] = false;
+                first[b] += m; len[b] -= m;
+                for ( int i = first[nb]; i < first[nb] + m; ++i ) {
+                    blk[ elems[i] ] = nb;
+                }
+                if ( inWork[b] || len[nb] <= len[b] ) {
+                    work[numWork++] = nb; inWork[nb] = true;
+                } else {
+                    work[numWork++] = b; inWork[b] = true;
+                }
+            }
+        }
+    }
+
+    // renumber the blocks breadth-first from the start states, dropping the
+    // block of the sink (it holds all states that cannot reach acceptance)
+    int* order = loc; // reused: block -> new state number
+    for ( int b=0; b < numBlocks; ++b ) order[b] = -1;
+    int numNew = 0;
+    int sinkBlk = blk[sink];
+    for ( int k=0; k < dfa->numStarts; ++k ) {
+        int b = dfa->starts[k] < 0 ? sinkBlk : blk[ dfa->starts[k] ];
+        if ( b != sinkBlk && order[b] < 0 ) {
+            order[b] = numNew; work[numNew++] = b;
+        }
+        dfa->starts[k] = b == sinkBlk ? -1 : order[b];
+    }
+    for ( int i=0; i < numNew; ++i ) {
+        int s = elems[ first[ work[i] ] ];
+        for ( int c=0; c < 256; ++c ) {
+            int t = dfa->trans[ s*256 + c ];
+            if ( t < 0 || blk[t] == sinkBlk || order[ blk[t] ] >= 0 ) continue;
+            order[ blk[t] ] = numNew; work[numNew++] = blk[t];
+        }
+    }
+    int*  trans  = (int*) xmalloc( sizeof(int) * 256U * (size_t) numNew );
+    int*  accept = (int*) xmalloc( sizeof(int) * (size_t) numNew );
+    for ( int i=0; i < numNew; ++i ) {
+        int s = elems[ first[ work[i] ] ];
+        accept[i] = dfa->accept[s];
+        for ( int c=0; c < 256; ++c ) {
+            int t = dfa->trans[ s*256 + c ];
+            trans[ i*256 + c ] = ( t < 0 || blk[t] == sinkBlk ) ? -1 :
+                order[ blk[t] ];
+        }
+    }
+    free( dfa->trans ); free( dfa->accept );
+    dfa->trans = trans; dfa->accept = accept; dfa->numStates = numNew;
+    free( elems ); free( loc ); free( blk ); free( first ); free( len );
+    free( marked ); free( work ); free( inWork ); free( touched );
+    free( splitter ); free( invStart ); free( inv );
+}
+
+static int build_dfa( int base, int count, const int* starts, int numStarts,
+    const char* what, bool lazyOk ) {
+    if ( numDfas >= dfaAlloc ) {
+        dfaAlloc = dfaAlloc ? dfaAlloc * 2 : 16;
+        xrealloc( (void**)(&dfas), sizeof(dfa_t) * (size_t) dfaAlloc );
+    }
+    dfa_t* dfa = &dfas[numDfas];
+    if ( !determinise( base, count, starts, numStarts,
+        lazyOk ? lazyDfaLimit : MAX_DFA_STATES, dfa ) ) {
+        if ( !lazyOk ) {
+            report2( "%s needs more than %d DFA states", what, MAX_DFA_STATES );
+        }
+        dfa->lazy = true;
+        return numDfas++;
+    }
+    minimise( dfa );
+    numDfaStatesTotal += dfa->numStates;
+    return numDfas++;
+}
+
+static int numSharedDfas = 0;
+
+static bool same_dfa( const dfa_t* a, const dfa_t* b ) {
+    return !a->lazy && !b->lazy && a->numStates == b->numStates &&
+        memcmp( a->accept, b->accept, sizeof(int) *
+        (size_t) a->numStates ) == 0 && memcmp( a->trans, b->trans,
+        sizeof(int) * 256U * (size_t) a->numStates ) == 0;
+}
+
+static int build_regex_dfa( treenode_t* node ) {
+    char what[300];
+    snprintf( what, sizeof(what), "regular expression /%s/", node->text );
+    int d = build_dfa( node->nfaBase, node->nfaCount, &node->nfaStart, 1, what,
+        true );
+    for ( int i=0; i < d; ++i ) {
+        if ( !same_dfa( &dfas[i], &dfas[d] ) ) continue;
+        numDfaStatesTotal -= dfas[d].numStates;
+        free( dfas[d].trans ); free( dfas[d].accept ); free( dfas[d].starts );
+        --numDfas;
+        ++numSharedDfas;
+        return i;
+    }
+    return d;
+}
+
+// -- lexer -------------------------------------------------------------------
+
+// the regular TOKEN productions (built from literals, regular expressions and
+// references to other regular productions, without recursion) are combined
+// into one longest-match lexer DFA; the tag of a token is its position in
+// lexerTokens, so on a tie the production listed first wins. each lexer mode
+// only contains its own tokens and has its own start state.
+
+static treenode_t** lexerTokens    = 0;
+static int          numLexerTokens = 0;
+static int          lexerDfa       = -1;
+static int          numRegexDfas   = 0;
+
+static treenode_t* find_production( const char* name ) {
+    for ( size_t i=0; i < tree->numBranches; ++i ) {
+        treenode_t* prod = tree->branches[i];
+        if ( strcmp( prod->text, name ) == 0 ) return prod;
+    }
+    return 0;
+}
+
+static bool is_regular_production( treenode_t* prod );
+
+static bool is_regular( treenode_t* node ) {
     switch ( node->token ) {
-        case T_PRODUCTION:
         case T_STR_LITERAL:
         case T_REG_EX:
-        case T_BIN_DATA:
-        case T_BIN_FIELD:
-        case T_BIN_FIELD_COUNT:
-        case T_BIN_FIELD_TIMES:
+            return true;
         case T_AND_EXPR:
         case T_OR_EXPR:
+        case T_LITERAL_SET:
         case T_BRACK_EXPR:
         case T_BRACE_EXPR:
+        case T_COUNT_EXPR:
+            for ( size_t i=0; i < node->numBranches; ++i ) {
+                if ( !is_regular( node->branches[i] ) ) return false;
+            }
             return true;
+        case T_IDENTIFIER: {
+            treenode_t* prod = find_production( node->text );
+            return prod != 0 && is_regular_production( prod );
+        }
         default: break;
     }
     return false;
 }
 
-static bool is_name( const char* text ) {
-    const char* p = text;
-    while ( ( *p >= 'a' && *p <= 'z' ) || ( *p >= 'A' && *p <= 'Z' ) || ( *p >= '0' && *p <= '9' ) || *p == '_' ) ++p;
-    if ( *p == '\0' ) return true;
-    return false;
+static bool is_regular_production( treenode_t* prod ) {
+    // regular: -1 unknown, 0 no, 1 yes, 2 being examined (i.e. recursive)
+    if ( prod->regular == 2 ) return false;
+    if ( prod->regular >= 0 ) return prod->regular == 1;
+    prod->regular = 2;
+    bool regular = is_regular( prod->branches[0] );
+    prod->regular = regular ? 1 : 0;
+    return regular;
 }
 
-static const char* name_to_label( const char* text ) {
-    static char buf[256];
-    snprintf( buf, sizeof(buf), "%s", text );
-    char* p = buf;
-    while ( *p != '\0' ) {
-        if ( *p >= 'a' && *p <= 'z' ) *p -= 'a'-'A';
-        ++p;
+static void push_expr_frag( treenode_t* node );
+
+static void push_expr_copy( const void* node ) {
+    push_expr_frag( (treenode_t*) node );
+}
+
+static void push_expr_frag( treenode_t* node ) {
+    switch ( node->token ) {
+        case T_STR_LITERAL:
+            for ( const char* p = node->text; *p != '\0'; ++p ) {
+                unsigned char set[32];
+                memset( set, 0, 32U );
+                set_add_range( set, *p & 255, *p & 255 );
+                push_set_frag( set );
+                if ( p != node->text ) push_concat_frag();
+            }
+            break;
+        case T_REG_EX: {
+            // copy the NFA of the regular expression
+            int base = node->nfaBase, off = numNfaStates - base, end = -1;
+            for ( int i=base; i < base + node->nfaCount; ++i ) {
+                nfastate_t st = nfaStates[i];
+                int s = new_nfa_state( st.consuming,
+                    st.out  >= 0 ? st.out  + off : -1,
+                    st.out1 >= 0 ? st.out1 + off : -1 );
+                memcpy( nfaStates[s].set, st.set, 32U );
+                if ( st.tag >= 0 ) end = s;
+            }
+            push_frag( node->nfaStart + off, end );
+            break;
+        }
+        case T_AND_EXPR:
+            for ( size_t i=0; i < node->numBranches; ++i ) {
+                push_expr_frag( node->branches[i] );
+                if ( i > 0 ) push_concat_frag();
+            }
+            break;
+        case T_OR_EXPR:
+        case T_LITERAL_SET:
+            for ( size_t i=0; i < node->numBranches; ++i ) {
+                push_expr_frag( node->branches[i] );
+                if ( i > 0 ) push_altern_frag();
+            }
+            break;
+        case T_BRACK_EXPR:
+            push_expr_frag( node->branches[0] );
+            push_repeat_frag( '?' );
+            break;
+        case T_BRACE_EXPR:
+            push_expr_frag( node->branches[0] );
+            push_repeat_frag( '*' );
+            break;
+        case T_COUNT_EXPR:
+            push_counted_frag( node->minCount, node->maxCount, push_expr_copy,
+                node->branches[0] );
+            break;
+        case T_IDENTIFIER:
+            push_expr_frag( find_production( node->text )->branches[0] );
+            break;
+        default: break;
     }
-    return buf;
 }
 
-typedef struct _op2label_t {
-    const char* op;
-    const char* label;
-} op2label_t;
+static void push_production_frag( treenode_t* prod, const char* kind ) {
+    // pushes the NFA of a regular production, which must not exceed
+    // MAX_REGEX_NFA states
+    int base = numNfaStates;
+    push_expr_frag( prod->branches[0] );
+    if ( numNfaStates - base > MAX_REGEX_NFA ) {
+        report2( "%s production '%s' expands to more than %d NFA states",
+            kind, prod->text, MAX_REGEX_NFA );
+    }
+}
 
-static const char* operator_to_label( const char* text ) {
-    static const op2label_t map[] = {
-        { "<>", "NE", }, { "!=", "CNE" }, { "==", "DEQ" }, { "=", "EQ" }, { ">=", "GE" }, { "<=", "LE" }, { "<", "LT" }, { ">", "GT" },
-        { "&", "AND" }, { "&&", "LOGAND" }, { "|", "OR" }, { "||", "LOGOR" }, { ";", "SEMIC" }, { ",", "COMMA" }, { ":", "COLON" },
-        { "(", "LPAREN" }, { ")", "RPAREN" }, { "[", "LBRACK" }, { "]", "RBRACK" }, { "{", "LBRACE" }, { "}", "RBRACE" }, { "^", "XOR" },
-        { "^^", "LOGXOR" }, { "*", "STAR" }, { "**", "DBLSTAR" }, { "/", "SLASH" }, { "+", "PLUS" }, { "-", "MINUS" },
-        { ":=", "ASSIGN" }, { "::=", "ASSIGN2" }, { "~=", "APPLY" }, { "++", "PLUSPLUS" }, { "--", "MINUSMINUS" }, { "+=", "PLUSEQ" },
-        { "-=", "MINUSEQ" }, { "*=", "STAREQ" }, { "/=", "SLASHEQ" }, { "&=", "ANDEQ" }, { "|=", "OREQ" }, { "^=", "XOREQ" },
-        { ".", "DOT" }, { "!", "EXCLAM" }, { "<<", "LSHIFT" }, { ">>", "RSHIFT" }, { "%", "MODULO" }, { "%=", "MODULOEQ" },
-        { "...", "ELLIPSIS" }, { "..", "RANGE" }, { 0, 0 }
-    };
-    for ( int i=0; map[i].op; ++i ) {
-        if ( strcmp( map[i].op, text ) == 0 ) return map[i].label;
+static void build_lexer( void ) {
+    numRegexDfas = numDfas;
+    lexer_mode( "main" );
+    int base = numNfaStates;
+    int* starts = (int*) xmalloc( sizeof(int) * (size_t) numLexerModes );
+    for ( int m=0; m < numLexerModes; ++m ) {
+        numRefrags = 0;
+        for ( size_t i=0; i < tree->numBranches; ++i ) {
+            treenode_t* prod = tree->branches[i];
+            if ( !prod->isToken || prod->lexerMode != m ||
+                !is_regular_production( prod ) ) continue;
+            push_production_frag( prod, "TOKEN" );
+            nfaStates[ refrags[numRefrags-1].end ].tag = numLexerTokens;
+            xrealloc( (void**)(&lexerTokens), sizeof(treenode_t*) *
+                (size_t)( numLexerTokens + 1 ) );
+            lexerTokens[ numLexerTokens++ ] = prod;
+            if ( numRefrags > 1 ) push_altern_frag();
+        }
+        starts[m] = numRefrags ? pop_frag().start : -1;
     }
-    return 0;
+    if ( numLexerTokens > 0 ) {
+        lexerDfa = build_dfa( base, numNfaStates - base, starts, numLexerModes,
+            "lexer", false );
+    }
+    free( starts );
+}
+
+static int dfa_first_state( int dfa ) {
+    int states = 0;
+    for ( int i=0; i < dfa; ++i ) states += dfas[i].numStates;
+    return states;
+}
+
+// -- skip rules --------------------------------------------------------------
+
+// SKIP productions (regular, like TOKEN productions) say what a runtime
+// skips between tokens, typically whitespace and comments.  Those of each
+// lexer mode are combined into one longest-match DFA with a start state per
+// mode, emitted after the lexer like a regex; <stem>_skip() removes longest
+// matches until none is left.  Runs of ASCII whitespace, by far the most
+// common thing to skip, get a fast path: the blank bytes of a mode are those
+// whitespace bytes whose runs the DFA can only skip as a whole, i.e. all
+// states it reaches from the start state on them accept and die on every
+// other byte, so a runtime can skip a run without the DFA, 16 bytes at a
+// time with SSE2.
+
+#define NUM_BLANKS  6
+
+static const unsigned char blankBytes[NUM_BLANKS] = {
+    ' ', '\t', '\n', '\r', '\v', '\f'
+};
+
+static int            numSkipProds = 0;
+static int            skipDfa      = -1;
+static unsigned char* skipBlanks   = 0;     // by mode, bit k: blankBytes[k]
+
+static int bit_count( unsigned v ) {
+    int n = 0;
+    for ( ; v != 0U; v &= v - 1U ) ++n;
+    return n;
+}
+
+static bool blanks_exact( const dfa_t* dfa, int start, unsigned blanks,
+    int* stack, bool* seen ) {
+    // whether the states reached from start on bytes in blanks all accept
+    // and die on other bytes, see above
+    bool inSet[256] = { false, };
+    int sp = 0;
+    for ( int k=0; k < NUM_BLANKS; ++k ) {
+        if ( blanks & ( 1U << k ) ) inSet[ blankBytes[k] ] = true;
+    }
+    memset( seen, 0, (size_t) dfa->numStates );
+    for ( int k=0; k < NUM_BLANKS; ++k ) {
+        int t = dfa->trans[ start*256 + blankBytes[k] ];
+        if ( !( blanks & ( 1U << k ) ) ) continue;
+        if ( t < 0 ) return false;
+        if ( !seen[t] ) { seen[t] = true; stack[sp++] = t; }
+    }
+    while ( sp > 0 ) {
+        int st = stack[--sp];
+        if ( dfa->accept[st] < 0 ) return false;
+        for ( int c=0; c < 256; ++c ) {
+            int t = dfa->trans[ st*256 + c ];
+            if ( t < 0 ) continue;
+            if ( !inSet[c] ) return false;
+            if ( !seen[t] ) { seen[t] = true; stack[sp++] = t; }
+        }
+    }
+    return true;
+}
+
+static void build_skip( void ) {
+    int base = numNfaStates;
+    int* starts = (int*) xmalloc( sizeof(int) * (size_t) numLexerModes );
+    skipBlanks = (unsigned char*) xmalloc( (size_t) numLexerModes );
+    memset( skipBlanks, 0, (size_t) numLexerModes );
+    for ( int m=0; m < numLexerModes; ++m ) {
+        numRefrags = 0;
+        for ( size_t i=0; i < tree->numBranches; ++i ) {
+            treenode_t* prod = tree->branches[i];
+            if ( !prod->isSkip || prod->lexerMode != m ) continue;
+            if ( !is_regular_production( prod ) ) {
+                report2( "SKIP production '%s' is not regular", prod->text );
+            }
+            push_production_frag( prod, "SKIP" );
+            nfaStates[ refrags[numRefrags-1].end ].tag = 0;
+            ++numSkipProds;
+            if ( numRefrags > 1 ) push_altern_frag();
+        }
+        starts[m] = numRefrags ? pop_frag().start : -1;
+    }
+    if ( numSkipProds > 0 ) {
+        skipDfa = build_dfa( base, numNfaStates - base, starts, numLexerModes,
+            "SKIP productions", false );
+        const dfa_t* dfa = &dfas[skipDfa];
+        int* stack = (int*) xmalloc( sizeof(int) * (size_t) dfa->numStates );
+        bool* seen = (bool*) xmalloc( (size_t) dfa->numStates );
+        for ( int m=0; m < numLexerModes; ++m ) {
+            // the largest exact set of blank bytes; there are only 64
+            int best = 0;
+            if ( dfa->starts[m] < 0 ) continue;
+            for ( unsigned b=1U; b < ( 1U << NUM_BLANKS ); ++b ) {
+                if ( bit_count( b ) > bit_count( (unsigned) best ) &&
+                    blanks_exact( dfa, dfa->starts[m], b, stack, seen ) ) {
+                    best = (int) b;
+                }
+            }
+            skipBlanks[m] = (unsigned char) best;
+        }
+        free( stack );
+        free( seen );
+    }
+    free( starts );
+}
+
+// -- byte equivalence classes ------------------------------------------------
+
+// bytes that lead to the same state from every state of every DFA share a
+// class; the DFAs are then emitted as [state][class] tables.
+
+static unsigned char byteClass[256];
+static int           classRep[256];     // first byte of each class
+static int           numByteClasses  = 0;
+static int           dfaStateBytes   = 1;
+
+static void compute_byte_classes( void ) {
+    unsigned long long hash[256];
+    int maxStates = 0;
+    for ( int c=0; c < 256; ++c ) hash[c] = 14695981039346656037ULL;
+    for ( int i=0; i < numDfas; ++i ) {
+        if ( dfas[i].numStates > maxStates ) maxStates = dfas[i].numStates;
+        for ( int st=0; st < dfas[i].numStates; ++st ) {
+            const int* row = &dfas[i].trans[ st*256 ];
+            for ( int c=0; c < 256; ++c ) {
+                hash[c] = ( hash[c] ^ (unsigned) row[c] ) * 1099511628211ULL;
+            }
+        }
+    }
+    numByteClasses = 0;
+    for ( int c=0; c < 256; ++c ) {
+        int k;
+        for ( k=0; k < numByteClasses; ++k ) {
+            int r = classRep[k];
+            if ( hash[r] != hash[c] ) continue;
+            bool same = true;
+            for ( int i=0; same && i < numDfas; ++i ) {
+                for ( int st=0; st < dfas[i].numStates; ++st ) {
+                    const int* row = &dfas[i].trans[ st*256 ];
+                    if ( row[r] != row[c] ) { same = false; break; }
+                }
+            }
+            if ( same ) break;
+        }
+        if ( k == numByteClasses ) classRep[ numByteClasses++ ] = c;
+        byteClass[c] = (unsigned char) k;
+    }
+    // the all-ones value of the chosen width is the dead state
+    dfaStateBytes = maxStates < 255 ? 1 : 2;
+}
+
+static size_t dfa_table_bytes( void ) {
+    return 256U + (size_t) numDfaStatesTotal * (size_t) numByteClasses *
+        (size_t) dfaStateBytes;
+}
+
+static unsigned dfa_target( const dfa_t* dfa, int st, int cls ) {
+    int t = dfa->trans[ st*256 + classRep[cls] ];
+    if ( t < 0 ) return dfaStateBytes == 1 ? 0xffU : 0xffffU;
+    return (unsigned) t;
+}
+
+// -- span sets ---------------------------------------------------------------
+
+// a DFA state that loops on a set of bytes can skip the longest run of bytes
+// in that set at once and continue with the byte after it.  <stem>_dfaSpan
+// gives the set of every state in <stem>_spanSets, or SPAN_NONE; a set is a
+// 32-byte nibble table with bit (c >> 4) & 7 of entry (c >> 7) * 16 +
+// (c & 15) set for every byte c in it, which vector code tests for 16 or 32
+// bytes at a time with two shuffles, and scalar code with one load.
+
+#define MAX_SPAN_SETS   255
+#define SPAN_NONE       0xff
+
+static unsigned char (*spanSets)[32]  = 0;
+static int            numSpanSets     = 0;
+static unsigned char* dfaSpan         = 0;      // by state, like dfaAccept
+static int            numSpanStates   = 0;
+
+static void byte_set_add( unsigned char set[32], int c ) {
+    set[ ( c >> 7 ) * 16 + ( c & 15 ) ] |= (unsigned char)( 1U << ( ( c >> 4 ) & 7 ) );
+}
+
+static int intern_span_set( const unsigned char set[32] ) {
+    // index of set in spanSets, or SPAN_NONE if the table is full
+    int k;
+    for ( k=0; k < numSpanSets; ++k ) {
+        if ( memcmp( spanSets[k], set, 32U ) == 0 ) return k;
+    }
+    if ( k == MAX_SPAN_SETS ) return SPAN_NONE;
+    memcpy( spanSets[ numSpanSets++ ], set, 32U );
+    return k;
+}
+
+static void build_span_sets( void ) {
+    int row = 0;
+    spanSets = (unsigned char (*)[32]) xmalloc( 32U * MAX_SPAN_SETS );
+    dfaSpan  = (unsigned char*) xmalloc( (size_t) numDfaStatesTotal + 1U );
+    numSpanSets = numSpanStates = 0;
+    for ( int i=0; i < numDfas; ++i ) {
+        for ( int st=0; st < dfas[i].numStates; ++st, ++row ) {
+            unsigned char set[32]; int n = 0;
+            memset( set, 0, sizeof(set) );
+            for ( int c=0; c < 256; ++c ) {
+                if ( dfas[i].trans[ st*256 + c ] != st ) continue;
+                byte_set_add( set, c );
+                ++n;
+            }
+            dfaSpan[row] = n ? (unsigned char) intern_span_set( set ) :
+                SPAN_NONE;
+            numSpanStates += dfaSpan[row] != SPAN_NONE;
+        }
+    }
+}
+
+// -- regex hints -------------------------------------------------------------
+
+// <stem>_regexHints tells a runtime what every match of a regex terminal
+// must look like before it runs the DFA: the mandatory prefix (the bytes
+// the DFA can only go on with from its start state, up to 8, as a word and
+// mask like <stem>_literals), a byte that every match contains (for memchr),
+// and the set of possible first bytes (in <stem>_spanSets).  It also names
+// the cheapest matcher that is exact for the regex, see MK_*.
+
+enum {
+    MK_DFA,             // run the DFA
+    MK_SPAN,            // a run of bytes in firstSet, see <stem>_span
+    MK_SHIFT_AND,       // bit-parallel, see <stem>_shiftAnd
+    MK_LAZY_DFA         // DFA states built on demand, see <stem>_regexNfas
+};
+
+#define SHIFT_AND_NONE  0xff
+
+typedef struct _regexhint_t {
+    unsigned long long  prefix;
+    unsigned long long  mask;
+    int                 prefixLen;
+    int                 required;       // byte, or -1
+    int                 firstSet;       // spanSets index, or SPAN_NONE
+    int                 matcher;        // MK_*
+    int                 shiftAnd;       // shiftAnd index, or SHIFT_AND_NONE
+} regexhint_t;
+
+static regexhint_t* regexHints       = 0;
+static int          numRequiredBytes = 0;
+
+static bool dfa_needs_byte( const dfa_t* dfa, int b, int* stack, bool* seen ) {
+    // whether every path from the start state to an accepting state
+    // consumes byte b
+    int sp = 0;
+    memset( seen, 0, (size_t) dfa->numStates );
+    seen[0] = true; stack[sp++] = 0;
+    while ( sp > 0 ) {
+        int st = stack[--sp];
+        if ( dfa->accept[st] >= 0 ) return false;
+        for ( int c=0; c < 256; ++c ) {
+            int t = dfa->trans[ st*256 + c ];
+            if ( c == b || t < 0 || seen[t] ) continue;
+            seen[t] = true; stack[sp++] = t;
+        }
+    }
+    return true;
+}
+
+static int byte_rarity( int c ) {
+    // a guess how rare byte c is in text; memchr pays off for rare bytes
+    if ( c == ' ' || c == '\t' || c == '\n' || c == '\r' ) return 0;
+    if ( ( c >= 'a' && c <= 'z' ) || ( c >= '0' && c <= '9' ) ) return 1;
+    if ( c >= 'A' && c <= 'Z' ) return 2;
+    return 3;
+}
+
+static int dfa_prefix( const dfa_t* dfa, unsigned char* prefix, int max ) {
+    // the bytes every match starts with (up to max), as long as the DFA
+    // can only go on with one byte and doesn't accept yet
+    int st = 0, len = 0;
+    while ( len < max && dfa->accept[st] < 0 ) {
+        int next = -1, b = -1;
+        for ( int c=0; c < 256; ++c ) {
+            if ( dfa->trans[ st*256 + c ] < 0 ) continue;
+            if ( b >= 0 ) { b = -1; break; }
+            b = c; next = dfa->trans[ st*256 + c ];
+        }
+        if ( b < 0 ) break;
+        prefix[ len++ ] = (unsigned char) b;
+        st = next;
+    }
+    return len;
+}
+
+static void build_regex_hints( void ) {
+    regexHints = (regexhint_t*) xmalloc( sizeof(regexhint_t) *
+        ( (size_t) numRegexDfas + 1U ) );
+    numRequiredBytes = 0;
+    for ( int i=0; i < numRegexDfas; ++i ) {
+        const dfa_t* dfa = &dfas[i]; regexhint_t* h = &regexHints[i];
+        unsigned char set[32], prefix[8]; int n = 0;
+        h->prefix = h->mask = 0ULL;
+        h->prefixLen = 0; h->required = -1; h->firstSet = SPAN_NONE;
+        h->matcher = dfa->lazy ? MK_LAZY_DFA : MK_DFA;
+        h->shiftAnd = SHIFT_AND_NONE;
+        if ( dfa->numStates == 0 || dfa->starts[0] < 0 ) continue;
+        h->prefixLen = dfa_prefix( dfa, prefix, 8 );
+        for ( int k=0; k < h->prefixLen; ++k ) {
+            h->prefix |= (unsigned long long) prefix[k] << ( 8 * k );
+            h->mask   |= 0xffULL << ( 8 * k );
+        }
+        if ( h->prefixLen > 0 ) {
+            h->required = (int)( h->prefix & 0xffULL );
+        } else {
+            int* stack = (int*) xmalloc( sizeof(int) * (size_t) dfa->numStates );
+            bool* seen = (bool*) xmalloc( (size_t) dfa->numStates );
+            for ( int c=0; c < 256; ++c ) {
+                if ( h->required >= 0 &&
+                    byte_rarity( c ) <= byte_rarity( h->required ) ) continue;
+                if ( dfa_needs_byte( dfa, c, stack, seen ) ) h->required = c;
+            }
+            free( stack );
+            free( seen );
+        }
+        numRequiredBytes += h->required >= 0;
+        memset( set, 0, sizeof(set) );
+        for ( int c=0; c < 256; ++c ) {
+            if ( dfa->trans[c] >= 0 ) { byte_set_add( set, c ); ++n; }
+        }
+        if ( n > 0 ) h->firstSet = intern_span_set( set );
+    }
+}
+
+// -- search automaton --------------------------------------------------------
+
+// with --search, a runtime looks for records of the first production (that
+// is neither TOKEN nor SKIP) in input that is mostly something else, like
+// log files, instead of parsing all of it.  Every record starts with one of the FIRST literals of the
+// first production: a string literal or binary data it can begin with, the
+// mandatory prefix of a regex it can begin with, or else each byte that
+// regex can begin with.  They are compiled into an Aho-Corasick automaton
+// (a trie whose failure links are folded into the transitions, so it is a
+// complete DFA) that is emitted after the lexer like a regex; its accepting
+// states give the length of the longest literal that ends there, from which
+// <stem>_search() finds the next offset worth a parse in one pass.  A
+// literal with another one as its prefix adds no offsets and is left out.
+
+#define MAX_SEARCH_LITERAL  255
+
+typedef struct _searchlit_t {
+    unsigned char   text[MAX_SEARCH_LITERAL];
+    int             len;
+} searchlit_t;
+
+static bool         searchMode      = false;
+static treenode_t*  searchStart     = 0;     // the production looked for
+static searchlit_t* searchLits      = 0;
+static int          numSearchLits   = 0;
+static int          searchLitAlloc  = 0;
+static int          searchDfa       = -1;
+static int          maxSearchLen    = 0;
+
+static size_t node_text_size( treenode_t* node );
+static int node_text( treenode_t* node, char* buf );
+
+static void add_search_literal( const unsigned char* text, int len ) {
+    if ( len > MAX_SEARCH_LITERAL ) len = MAX_SEARCH_LITERAL;
+    for ( int i=0; i < numSearchLits; ++i ) {
+        if ( searchLits[i].len == len &&
+            memcmp( searchLits[i].text, text, (size_t) len ) == 0 ) return;
+    }
+    if ( numSearchLits >= searchLitAlloc ) {
+        searchLitAlloc = searchLitAlloc ? searchLitAlloc * 2 : 16;
+        xrealloc( (void**)(&searchLits), sizeof(searchlit_t) *
+            (size_t) searchLitAlloc );
+    }
+    memcpy( searchLits[numSearchLits].text, text, (size_t) len );
+    searchLits[numSearchLits++].len = len;
+}
+
+static bool regex_first_literals( treenode_t* node ) {
+    const dfa_t* dfa = &dfas[ node->aux ];
+    unsigned char prefix[MAX_SEARCH_LITERAL];
+    if ( dfa->lazy ) {
+        report2( "--search: regular expression /%s/ at the start of '%s' "
+            "has no DFA (see --lazy-dfa)", node->text, searchStart->text );
+    }
+    if ( dfa->numStates == 0 || dfa->starts[0] < 0 ) return false;
+    int len = dfa_prefix( dfa, prefix, MAX_SEARCH_LITERAL );
+    if ( len > 0 ) {
+        add_search_literal( prefix, len );
+        return false;
+    }
+    for ( int c=0; c < 256; ++c ) {
+        prefix[0] = (unsigned char) c;
+        if ( dfa->trans[c] >= 0 ) add_search_literal( prefix, 1 );
+    }
+    return dfa->accept[0] >= 0;
+}
+
+static bool first_literals( treenode_t* node ) {
+    // adds the FIRST literals of node; returns whether node can match the
+    // empty string.  node->first of a production: -1 not visited yet, 0 or 1
+    // done (and whether it can match the empty string), 2 being visited
+    // (left recursion, which adds nothing)
+    bool empty = false;
+    switch ( node->token ) {
+        case T_STR_LITERAL:
+        case T_BIN_DATA: {
+            char* buf = (char*) xmalloc( node_text_size( node ) );
+            int   len = node_text( node, buf );
+            if ( len > 0 ) {
+                add_search_literal( (const unsigned char*) buf, len );
+            }
+            free( buf );
+            return len <= 0;
+        }
+        case T_REG_EX:
+            return regex_first_literals( node );
+        case T_BIN_FIELD:
+        case T_BIN_FIELD_COUNT:
+        case T_BIN_FIELD_TIMES:
+            report2( "--search: '%s' can start with a binary field, which "
+                "matches any byte", searchStart->text );
+            break;
+        case T_AND_EXPR:
+            for ( size_t i=0; i < node->numBranches; ++i ) {
+                if ( !first_literals( node->branches[i] ) ) return false;
+            }
+            return true;
+        case T_OR_EXPR:
+        case T_LITERAL_SET:
+            for ( size_t i=0; i < node->numBranches; ++i ) {
+                if ( first_literals( node->branches[i] ) ) empty = true;
+            }
+            return empty;
+        case T_BRACK_EXPR:
+        case T_BRACE_EXPR:
+            first_literals( node->branches[0] );
+            return true;
+        case T_COUNT_EXPR:
+            return first_literals( node->branches[0] ) || node->minCount == 0;
+        case T_IDENTIFIER: {
+            treenode_t* prod = find_production( node->text );
+            if ( prod->first == 2 ) return false;
+            if ( prod->first >= 0 ) return prod->first == 1;
+            prod->first = 2;
+            empty = first_literals( prod->branches[0] );
+            prod->first = empty ? 1 : 0;
+            return empty;
+        }
+        default: break;
+    }
+    return true;
+}
+
+static int compare_search_literals( const void* a, const void* b ) {
+    const searchlit_t* x = (const searchlit_t*) a;
+    const searchlit_t* y = (const searchlit_t*) b;
+    if ( x->len != y->len ) return x->len - y->len;
+    return memcmp( x->text, y->text, (size_t) x->len );
+}
+
+static treenode_t* start_production( void ) {
+    // the first production that is neither TOKEN nor SKIP
+    for ( size_t i=0; i < tree->numBranches; ++i ) {
+        treenode_t* prod = tree->branches[i];
+        if ( !prod->isToken && !prod->isSkip ) return prod;
+    }
+    report2( "--search: there is no production that is neither TOKEN nor "
+        "SKIP" );
+    return 0;
+}
+
+static void build_search( void ) {
+    treenode_t* start = searchStart = start_production();
+    numSearchLits = 0;
+    start->first = 2;
+    if ( first_literals( start->branches[0] ) ) {
+        report2( "--search: '%s' can match the empty string, so every "
+            "offset would be a candidate", start->text );
+    }
+    start->first = 0;
+    if ( numSearchLits == 0 ) {
+        report2( "--search: '%s' cannot start with any literal", start->text );
+    }
+    // the trie, shortest literals first, so that literals that start with
+    // another one can be left out
+    qsort( searchLits, (size_t) numSearchLits, sizeof(searchlit_t),
+        compare_search_literals );
+    int  alloc = 16, numStates = 1;
+    int* trans = (int*) xmalloc( sizeof(int) * 256U * (size_t) alloc );
+    int* len   = (int*) xmalloc( sizeof(int) * (size_t) alloc );
+    for ( int c=0; c < 256; ++c ) trans[c] = -1;
+    len[0] = 0;
+    maxSearchLen = 0;
+    for ( int i=0; i < numSearchLits; ++i ) {
+        const searchlit_t* lit = &searchLits[i];
+        int st = 0, k;
+        for ( k=0; k < lit->len && len[st] == 0; ++k ) {
+            int t = trans[ st*256 + lit->text[k] ];
+            if ( t < 0 ) {
+                if ( numStates == MAX_DFA_STATES ) {
+                    report2( "--search: the FIRST literals of '%s' need more "
+                        "than %d DFA states", start->text, MAX_DFA_STATES );
+                }
+                if ( numStates == alloc ) {
+                    alloc *= 2;
+                    xrealloc( (void**)(&trans), sizeof(int) * 256U *
+                        (size_t) alloc );
+                    xrealloc( (void**)(&len), sizeof(int) * (size_t) alloc );
+                }
+                t = numStates++;
+                for ( int c=0; c < 256; ++c ) trans[ t*256 + c ] = -1;
+                len[t] = 0;
+                trans[ st*256 + lit->text[k] ] = t;
+            }
+            st = t;
+        }
+        if ( len[st] != 0 ) continue;       // starts with a shorter literal
+        len[st] = lit->len;
+        if ( lit->len > maxSearchLen ) maxSearchLen = lit->len;
+    }
+    // failure links breadth-first: a missing transition goes where the
+    // failure state goes, and a state ends the literals its failure state
+    // ends, of which only the longest is kept
+    int* fail  = (int*) xmalloc( sizeof(int) * (size_t) numStates );
+    int* queue = (int*) xmalloc( sizeof(int) * (size_t) numStates );
+    int  head = 0, tail = 0;
+    for ( int c=0; c < 256; ++c ) {
+        int t = trans[c];
+        if ( t < 0 ) {
+            trans[c] = 0;
+        } else {
+            fail[t] = 0; queue[ tail++ ] = t;
+        }
+    }
+    while ( head < tail ) {
+        int st = queue[ head++ ];
+        if ( len[st] == 0 ) len[st] = len[ fail[st] ];
+        for ( int c=0; c < 256; ++c ) {
+            int t = trans[ st*256 + c ], f = trans[ fail[st]*256 + c ];
+            if ( t < 0 ) {
+                trans[ st*256 + c ] = f;
+            } else {
+                fail[t] = f; queue[ tail++ ] = t;
+            }
+        }
+    }
+    free( fail ); free( queue );
+    if ( numDfas >= dfaAlloc ) {
+        dfaAlloc = dfaAlloc ? dfaAlloc * 2 : 16;
+        xrealloc( (void**)(&dfas), sizeof(dfa_t) * (size_t) dfaAlloc );
+    }
+    dfa_t* dfa = &dfas[numDfas];
+    for ( int st=0; st < numStates; ++st ) {
+        if ( len[st] == 0 ) len[st] = -1;
+    }
+    dfa->numStates = numStates;
+    dfa->trans     = trans;
+    dfa->accept    = len;
+    dfa->numStarts = 1;
+    dfa->starts    = (int*) xmalloc( sizeof(int) );
+    dfa->starts[0] = 0;
+    dfa->lazy      = false;
+    numDfaStatesTotal += numStates;
+    searchDfa = numDfas++;
+}
+
+static const char* dfa_name( int i ) {
+    // for comments in the generated tables
+    static char buf[32];
+    if ( i == lexerDfa ) return "lexer";
+    if ( i == skipDfa ) return "skip";
+    if ( i == searchDfa ) return "search";
+    snprintf( buf, sizeof(buf), "regex %d", i );
+    return buf;
+}
+
+static FILE* impfp = 0;
+static FILE* hdrfp = 0;
+static char  impfile[256] = { 0, }, hdrfile[256] = { 0, };
+static const char* fileStem = 0;
+
+static void help( void ) {
+    printf( "%s",
+        "usage: ebnfcomp [options] <file-stem>\n"
+        "options:\n"
+        "    --help, -h                 (this)\n"
+        "    --tree, -t                 output syntax tree\n"
+        "    --asm , -a                 output assembly language, not C\n"
+        "    --stats, -s                print table statistics\n"
+        "    --compact, -c              output a packed parsing table\n"
+        "    --soa                      output the parsing table as parallel arrays\n"
+        "    --order=ORDER              number nodes in dfs (default), bfs,\n"
+        "                               clustered or rpo order\n"
+        "    --emit-binary              also write the tables to <file-stem>.ebt\n"
+        "    --incbin                   write the large tables to <file-stem>.bin\n"
+        "                               and include them with incbin (implies\n"
+        "                               --compact unless --soa is given)\n"
+        "    --idmap=FILE               keep node ids and node type values\n"
+        "                               stable across grammar edits; reads\n"
+        "                               and updates FILE\n"
+        "    --elf                      write the tables as an x86-64 ELF object\n"
+        "                               <file-stem>.o instead of C source\n"
+        "                               (implies --compact unless --soa is given)\n"
+        "    --lazy-dfa=N               match regexes whose DFA would have more\n"
+        "                               than N states (default 4096) by building\n"
+        "                               DFA states at run time\n"
+        "    --search                   build an automaton over the literals a\n"
+        "                               record of the first production starts\n"
+        "                               with, to find records in other input\n"
+        "default behavior:\n"
+        "    compiles EBNF specified on standard input to internal form,\n"
+        "    then outputs C or assembly language code for a parsing table to\n"
+        "    a header and implementation file named using <file-stem>.\n"
+    );
+}
+
+static void name_to_C_enum( char buf[256], const char* name ) {
+    snprintf( buf, 256U, "NT_%s", name );
+    size_t len = strlen( buf );
+    for ( size_t i=0U; i < len; ++i ) {
+        if ( buf[i] == '-' ) buf[i] = '_';
+        if ( buf[i] >= 'a' && buf[i] <= 'z' ) buf[i] -= 'a'-'A';
+    }
+}
+
+static bool is_export_node( treenode_t* node ) {
+    switch ( node->token ) {
+        case T_PRODUCTION:
+        case T_STR_LITERAL:
+        case T_REG_EX:
+        case T_BIN_DATA:
+        case T_BIN_FIELD:
+        case T_BIN_FIELD_COUNT:
+        case T_BIN_FIELD_TIMES:
+        case T_AND_EXPR:
+        case T_OR_EXPR:
+        case T_BRACK_EXPR:
+        case T_BRACE_EXPR:
+        case T_COUNT_EXPR:
+        case T_LITERAL_SET:
+            return true;
+        default: break;
+    }
+    return false;
+}
+
+static bool is_name( const char* text ) {
+    const char* p = text;
+    while ( ( *p >= 'a' && *p <= 'z' ) || ( *p >= 'A' && *p <= 'Z' ) || ( *p >= '0' && *p <= '9' ) || *p == '_' ) ++p;
+    if ( *p == '\0' ) return true;
+    return false;
+}
+
+static const char* name_to_label( const char* text ) {
+    static char buf[256];
+    snprintf( buf, sizeof(buf), "%s", text );
+    char* p = buf;
+    while ( *p != '\0' ) {
+        if ( *p >= 'a' && *p <= 'z' ) *p -= 'a'-'A';
+        ++p;
+    }
+    return buf;
+}
+
+typedef struct _op2label_t {
+    const char* op;
+    const char* label;
+} op2label_t;
+
+static const char* operator_to_label( const char* text ) {
+    static const op2label_t map[] = {
+        { "<>", "NE", }, { "!=", "CNE" }, { "==", "DEQ" }, { "=", "EQ" }, { ">=", "GE" }, { "<=", "LE" }, { "<", "LT" }, { ">", "GT" },
+        { "&", "AND" }, { "&&", "LOGAND" }, { "|", "OR" }, { "||", "LOGOR" }, { ";", "SEMIC" }, { ",", "COMMA" }, { ":", "COLON" },
+        { "(", "LPAREN" }, { ")", "RPAREN" }, { "[", "LBRACK" }, { "]", "RBRACK" }, { "{", "LBRACE" }, { "}", "RBRACE" }, { "^", "XOR" },
+        { "^^", "LOGXOR" }, { "*", "STAR" }, { "**", "DBLSTAR" }, { "/", "SLASH" }, { "+", "PLUS" }, { "-", "MINUS" },
+        { ":=", "ASSIGN" }, { "::=", "ASSIGN2" }, { "~=", "APPLY" }, { "++", "PLUSPLUS" }, { "--", "MINUSMINUS" }, { "+=", "PLUSEQ" },
+        { "-=", "MINUSEQ" }, { "*=", "STAREQ" }, { "/=", "SLASHEQ" }, { "&=", "ANDEQ" }, { "|=", "OREQ" }, { "^=", "XOREQ" },
+        { ".", "DOT" }, { "!", "EXCLAM" }, { "<<", "LSHIFT" }, { ">>", "RSHIFT" }, { "%", "MODULO" }, { "%=", "MODULOEQ" },
+        { "...", "ELLIPSIS" }, { "..", "RANGE" }, { 0, 0 }
+    };
+    for ( int i=0; map[i].op; ++i ) {
+        if ( strcmp( map[i].op, text ) == 0 ) return map[i].label;
+    }
+    return 0;
+}
+
+typedef struct _havelabel_t {
+    struct _havelabel_t* next;
+    char*                text;
+    int                  value;
+} havelabel_t;
+
+static havelabel_t* havelabel_first = 0;
+static havelabel_t* havelabel_last  = 0;
+
+static int check_have_label( const char* text, int value ) {
+    // returns the value of a known label, or records text with value and
+    // returns -1
+    havelabel_t* lab = havelabel_first;
+    while ( lab ) {
+        if ( strcmp( lab->text, text ) == 0 ) return lab->value;
+        lab = lab->next;
+    }
+    lab = (havelabel_t*) xmalloc( sizeof(havelabel_t) );
+    lab->next  = 0;
+    lab->text  = xstrdup( text );
+    lab->value = value;
+    if ( havelabel_first == 0 ) {
+        havelabel_first = havelabel_last = lab;
+    } else {
+        havelabel_last->next = lab;
+        havelabel_last       = lab;
+    }
+    return -1;
+}
+
+static int id = 0;
+static int numNodeTypes = 1;    // including _NT_GENERIC
+
+static void name_to_C_name( char buf[256], const char* name, const char* prefix ) {
+    snprintf( buf, 256U, "%s%s", prefix, name );
+    size_t len = strlen( buf );
+    for ( size_t i=0U; i < len; ++i ) {
+        if ( buf[i] == '-' ) buf[i] = '_';
+    }
+}
+
+// -- node ordering -----------------------------------------------------------
+
+// ids are first assigned in DFS pre-order while the node type enums are
+// written; order_nodes() then renumbers the nodes as selected by --order and
+// assigns the branch slices in id order, so each slice lies next to the
+// slices of the nodes numbered around its owner.
+
+enum {
+    ORDER_DFS,
+    ORDER_BFS,
+    ORDER_CLUSTERED,
+    ORDER_RPO
+};
+
+static int          nodeOrder    = ORDER_DFS;
+static treenode_t** nodeTable    = 0;
+static int*         branchTable  = 0;   // resolved branch targets
+static int*         branchOwner  = 0;   // node whose list starts at [i], or -1
+static treenode_t** branchSource = 0;   // branch nodes, for comments
+static int          branches_ix  = 0;
+static int          branchesUnshared = 0;
+
+static void collect_nodes( treenode_t* node, treenode_t** byId ) {
+    if ( node == 0 ) return;
+    if ( node->id >= 0 ) byId[node->id] = node;
+    for ( size_t i=0; i < node->numBranches; ++i ) {
+        collect_nodes( node->branches[i], byId );
+    }
+}
+
+static treenode_t* branch_ref( treenode_t* branch ) {
+    // the node a branch leads to, following references to productions
+    if ( branch->id >= 0 ) return branch;
+    if ( branch->token == T_IDENTIFIER ) return find_production( branch->text );
+    return 0;
+}
+
+static void order_bfs( treenode_t* root, treenode_t** order, int* num,
+    bool* seen ) {
+    // appends the unseen nodes below root (itself included), level by
+    // level; root 0 enqueues all productions first
+    int head = *num;
+    if ( root == 0 ) {
+        for ( size_t i=0; i < tree->numBranches; ++i ) {
+            seen[ tree->branches[i]->id ] = true;
+            order[(*num)++] = tree->branches[i];
+        }
+    } else if ( !seen[root->id] ) {
+        seen[root->id] = true;
+        order[(*num)++] = root;
+    }
+    while ( head < *num ) {
+        treenode_t* node = order[head++];
+        for ( size_t i=0; i < node->numBranches; ++i ) {
+            treenode_t* b = node->branches[i];
+            if ( b->id >= 0 && !seen[b->id] ) {
+                seen[b->id] = true;
+                order[(*num)++] = b;
+            }
+        }
+    }
+}
+
+static void order_productions( treenode_t* node, treenode_t** prods,
+    int* num, bool* seen ) {
+    // productions in DFS order of first reference
+    if ( node->token == T_PRODUCTION ) {
+        if ( seen[node->id] ) return;
+        seen[node->id] = true;
+        prods[(*num)++] = node;
+    }
+    for ( size_t i=0; i < node->numBranches; ++i ) {
+        treenode_t* b = node->branches[i];
+        treenode_t* target = branch_ref( b );
+        if ( target != 0 && target != b && target->id >= 0 ) {
+            order_productions( target, prods, num, seen );
+        } else if ( b->id >= 0 ) {
+            order_productions( b, prods, num, seen );
+        }
+    }
+}
+
+static void order_postorder( treenode_t* node, treenode_t** order, int* num,
+    bool* seen ) {
+    seen[node->id] = true;
+    for ( size_t i=0; i < node->numBranches; ++i ) {
+        treenode_t* target = branch_ref( node->branches[i] );
+        if ( target != 0 && target->id >= 0 && !seen[target->id] ) {
+            order_postorder( target, order, num, seen );
+        }
+    }
+    order[(*num)++] = node;
+}
+
+static int find_prod_id( treenode_t* node, const char* name ) {
+    if ( node == 0 ) return -1;
+    if ( node->token == T_PRODUCTION && strcmp( node->text, name ) == 0 ) return node->id;
+    for ( size_t i=0; i < node->numBranches; ++i ) {
+        int id = find_prod_id( node->branches[i], name );
+        if ( id >= 0 ) return id;
+    }
+    return -1;
+}
+
+static int branch_target( treenode_t* node, treenode_t* branch ) {
+    // id of the branch; -1 if it can't be resolved, -2 for the parameter
+    // of a binary match
+    int id;
+    if ( branch->id >= 0 ) return branch->id;
+    if ( branch->token == T_IDENTIFIER &&
+        ( id = find_prod_id( tree, branch->text ) ) >= 0 ) return id;
+    if ( node->token != T_BIN_DATA && ( node->token < T_BIN_FIELD ||
+        node->token > T_BIN_FIELD_TIMES ) ) {
+        if ( branch->token == T_IDENTIFIER ) {
+            report2( "production '%s' not found", branch->text );
+        }
+        return -1;
+    }
+    return -2;
+}
+
+// branch lists are interned: a list that equals another list, or is a
+// suffix of it, shares its entries.  The remaining slices are laid out in
+// order of their first owner.
+
+typedef struct _branchlist_t {
+    treenode_t*     node;
+    int*            targets;
+    int             len;
+    int             head;       // list that stores the entries
+    int             offset;     // of this list within the head's entries
+    int             owner;      // lowest node id among a head's users
+} branchlist_t;
+
+static int compare_branch_lists( const void* a, const void* b ) {
+    // descending by reversed list, so every list directly follows the
+    // lists it is a suffix of
+    const branchlist_t* x = (const branchlist_t*) a;
+    const branchlist_t* y = (const branchlist_t*) b;
+    int i = x->len, j = y->len;
+    while ( i > 0 && j > 0 ) {
+        int tx = x->targets[--i], ty = y->targets[--j];
+        if ( tx != ty ) return tx < ty ? 1 : -1;
+    }
+    if ( i != j ) return i > 0 ? -1 : 1;
+    return x->node->id - y->node->id;
+}
+
+static int compare_heads( const void* a, const void* b ) {
+    const branchlist_t* x = *(const branchlist_t* const*) a;
+    const branchlist_t* y = *(const branchlist_t* const*) b;
+    return x->owner - y->owner;
+}
+
+static void assign_branch_slices( void ) {
+    branchlist_t*  lists = (branchlist_t*) xmalloc( sizeof(branchlist_t) *
+        ( (size_t) id + 1U ) );
+    branchlist_t** heads = (branchlist_t**) xmalloc( sizeof(branchlist_t*) *
+        ( (size_t) id + 1U ) );
+    int numLists = 0, numHeads = 0;
+    branchesUnshared = 0;
+    for ( int i=0; i < id; ++i ) {
+        treenode_t* node = nodeTable[i];
+        if ( node->numBranches == 0U ) continue;
+        branchlist_t* l = &lists[numLists++];
+        l->node    = node;
+        l->len     = (int) node->numBranches;
+        l->targets = (int*) xmalloc( sizeof(int) * node->numBranches );
+        for ( int k=0; k < l->len; ++k ) {
+            l->targets[k] = branch_target( node, node->branches[k] );
+        }
+        branchesUnshared += l->len;
+    }
+    qsort( lists, (size_t) numLists, sizeof(branchlist_t),
+        compare_branch_lists );
+    for ( int i=0; i < numLists; ++i ) {
+        branchlist_t* l = &lists[i]; branchlist_t* prev = i ? &lists[i-1] : 0;
+        if ( prev != 0 && l->len <= prev->len && memcmp( l->targets,
+            &prev->targets[ prev->len - l->len ],
+            sizeof(int) * (size_t) l->len ) == 0 ) {
+            l->head   = prev->head;
+            l->offset = prev->offset + prev->len - l->len;
+            if ( l->node->id < lists[l->head].owner ) {
+                lists[l->head].owner = l->node->id;
+            }
+        } else {
+            l->head   = i;
+            l->offset = 0;
+            l->owner  = l->node->id;
+            heads[numHeads++] = l;
+        }
+    }
+    qsort( heads, (size_t) numHeads, sizeof(branchlist_t*), compare_heads );
+    branches_ix = 0;
+    for ( int h=0; h < numHeads; ++h ) {
+        heads[h]->node->branchesIx = branches_ix;     // slice start, for now
+        branches_ix += heads[h]->len;
+    }
+    branchTable  = (int*) xmalloc( sizeof(int) * ( (size_t) branches_ix + 1U ) );
+    branchOwner  = (int*) xmalloc( sizeof(int) * ( (size_t) branches_ix + 1U ) );
+    branchSource = (treenode_t**) xmalloc( sizeof(treenode_t*) *
+        ( (size_t) branches_ix + 1U ) );
+    for ( int h=0; h < numHeads; ++h ) {
+        int start = heads[h]->node->branchesIx;
+        for ( int k=0; k < heads[h]->len; ++k ) {
+            branchTable[start+k]  = heads[h]->targets[k];
+            branchOwner[start+k]  = k ? -1 : heads[h]->node->id;
+            branchSource[start+k] = heads[h]->node->branches[k];
+        }
+    }
+    for ( int i=0; i < numLists; ++i ) {
+        lists[i].node->branchesIx = lists[ lists[i].head ].node->branchesIx +
+            lists[i].offset;
+    }
+    for ( int i=0; i < numLists; ++i ) free( lists[i].targets );
+    free( lists );
+    free( heads );
+}
+
+static void order_nodes( void ) {
+    treenode_t** byId  = (treenode_t**) xmalloc( sizeof(treenode_t*) *
+        ( (size_t) id + 1U ) );
+    treenode_t** order = (treenode_t**) xmalloc( sizeof(treenode_t*) *
+        ( (size_t) id + 1U ) );
+    bool*        seen  = (bool*) xmalloc( (size_t) id + 1U );
+    int num = 0;
+    memset( seen, 0, (size_t) id + 1U );
+    collect_nodes( tree, byId );
+    switch ( nodeOrder ) {
+        case ORDER_BFS:
+            order_bfs( 0, order, &num, seen );
+            break;
+        case ORDER_CLUSTERED: {
+            // productions in order of first reference from the start
+            // production, each followed by its own nodes in BFS order
+            treenode_t** prods = (treenode_t**) xmalloc( sizeof(treenode_t*) *
+                ( tree->numBranches + 1U ) );
+            int numProds = 0;
+            for ( size_t i=0; i < tree->numBranches; ++i ) {
+                order_productions( tree->branches[i], prods, &numProds, seen );
+            }
+            memset( seen, 0, (size_t) id + 1U );
+            for ( int i=0; i < numProds; ++i ) {
+                order_bfs( prods[i], order, &num, seen );
+            }
+            free( prods );
+            break;
+        }
+        case ORDER_RPO:
+            for ( size_t i=0; i < tree->numBranches; ++i ) {
+                if ( !seen[ tree->branches[i]->id ] ) {
+                    order_postorder( tree->branches[i], order, &num, seen );
+                }
+            }
+            for ( int i=0; i < num / 2; ++i ) {
+                treenode_t* t = order[i];
+                order[i] = order[num-1-i];
+                order[num-1-i] = t;
+            }
+            break;
+        default:
+            memcpy( order, byId, sizeof(treenode_t*) * (size_t) id );
+            num = id;
+            break;
+    }
+    if ( num != id ) report( "internal error: %d of %d nodes ordered", num, id );
+    for ( int i=0; i < id; ++i ) order[i]->id = i;
+    nodeTable = order;
+    assign_branch_slices();
+    free( byId );
+    free( seen );
+}
+
+
+// -- id map ------------------------------------------------------------------
+
+// with --idmap=FILE, node ids and node type enum values are read from FILE
+// and written back to it, so editing the grammar doesn't renumber the nodes
+// it keeps.  Nodes are identified by a key: productions by name, string and
+// regex terminals by text, all other nodes by their path of branch indices
+// below their production.  New nodes first take the ids of removed nodes,
+// then get appended; if more nodes were removed than added, the highest ids
+// move into the gaps so the tables stay dense.  Enum values are never reused.
+
+typedef struct _idmapentry_t {
+    char*           key;
+    int             id;
+    int             nodeType;
+} idmapentry_t;
+
+static const char*   idMapFile    = 0;
+static idmapentry_t* idMap        = 0;
+static int           idMapLen     = 0;
+static int           idMapNext    = 1;      // next unused node type value
+static char**        idKeys       = 0;      // by node id
+static int           idMapKept    = 0;
+static int           idMapMoved   = 0;
+
+static int compare_id_map( const void* a, const void* b ) {
+    return strcmp( ( (const idmapentry_t*) a )->key,
+        ( (const idmapentry_t*) b )->key );
+}
+
+static idmapentry_t* find_id_map( const char* key ) {
+    idmapentry_t query;
+    if ( key == 0 || idMapLen == 0 ) return 0;
+    query.key = (char*) key;
+    return (idmapentry_t*) bsearch( &query, idMap, (size_t) idMapLen,
+        sizeof(idmapentry_t), compare_id_map );
+}
+
+static void read_id_map( void ) {
+    // lines are "next <value>" and "<id> <node type> <key>"; a missing file
+    // is an empty map
+    FILE* fp = fopen( idMapFile, "rt" );
+    char line[8192]; int alloc = 0, lno = 0;
+    if ( fp == 0 ) return;
+    while ( fgets( line, (int) sizeof(line), fp ) ) {
+        int nid, ntype, keyPos = 0;
+        size_t len = strlen( line );
+        ++lno;
+        if ( len > 0U && line[len-1] != '\n' && !feof( fp ) ) {
+            report2( "%s:%d: line too long", idMapFile, lno );
+        }
+        while ( len > 0U && ( line[len-1] == '\n' || line[len-1] == '\r' ) ) {
+            line[--len] = '\0';
+        }
+        if ( line[0] == '#' || line[0] == '\0' ) continue;
+        if ( sscanf( line, "next %d", &ntype ) == 1 ) {
+            if ( ntype > idMapNext ) idMapNext = ntype;
+            continue;
+        }
+        if ( sscanf( line, "%d %d %n", &nid, &ntype, &keyPos ) != 2 ||
+            nid < 0 || ntype < 0 || line[keyPos] == '\0' ) {
+            report2( "%s:%d: malformed id map entry", idMapFile, lno );
+        }
+        if ( idMapLen == alloc ) {
+            alloc = alloc ? alloc * 2 : 256;
+            idMap = (idmapentry_t*) realloc( idMap,
+                sizeof(idmapentry_t) * (size_t) alloc );
+            if ( idMap == 0 ) report2( "out of memory" );
+        }
+        idMap[idMapLen].key      = xstrdup( &line[keyPos] );
+        idMap[idMapLen].id       = nid;
+        idMap[idMapLen].nodeType = ntype;
+        ++idMapLen;
+        if ( ntype >= idMapNext ) idMapNext = ntype + 1;
+    }
+    fclose( fp );
+    qsort( idMap, (size_t) idMapLen, sizeof(idmapentry_t), compare_id_map );
+}
+
+static void id_map_key( char* buf, size_t size, char kind, const char* text ) {
+    // kind, a blank and text with blanks, controls, '\' and non-ASCII
+    // bytes as \xHH
+    size_t n = 0;
+    buf[n++] = kind; buf[n++] = ' ';
+    for ( const unsigned char* p = (const unsigned char*) text; *p &&
+        n + 5U < size; ++p ) {
+        if ( *p <= ' ' || *p >= 0x7f || *p == '\\' ) {
+            n += (size_t) snprintf( &buf[n], size - n, "\\x%02x", *p );
+        } else {
+            buf[n++] = (char) *p;
+        }
+    }
+    buf[n] = '\0';
+}
+
+static void collect_id_keys( treenode_t* node, const char* prod,
+    const char* path ) {
+    char key[4096], sub[2048];
+    if ( node == 0 ) return;
+    if ( node->token == T_PRODUCTION ) {
+        prod = node->text; path = "";
+    }
+    if ( node->id >= 0 && idKeys[node->id] == 0 ) {
+        if ( node->token == T_PRODUCTION ) {
+            id_map_key( key, sizeof(key), 'P', node->text );
+        } else if ( node->token == T_STR_LITERAL ) {
+            id_map_key( key, sizeof(key), 'S', node->text );
+        } else if ( node->token == T_REG_EX ) {
+            id_map_key( key, sizeof(key), 'R', node->text );
+        } else {
+            snprintf( sub, sizeof(sub), "%s%s", prod ? prod : "", path );
+            id_map_key( key, sizeof(key), 'N', sub );
+        }
+        idKeys[node->id] = xstrdup( key );
+    }
+    for ( size_t i=0; i < node->numBranches; ++i ) {
+        snprintf( sub, sizeof(sub), "%s/%zu", path, i );
+        collect_id_keys( node->branches[i], prod, sub );
+    }
+}
+
+static void apply_id_map( void ) {
+    // renumbers the nodes numbered by number_nodes() as recorded in the map
+    treenode_t** byId  = (treenode_t**) xmalloc( sizeof(treenode_t*) *
+        ( (size_t) id + 1U ) );
+    int*         newId = (int*) xmalloc( sizeof(int) * ( (size_t) id + 1U ) );
+    bool*        taken = (bool*) xmalloc( (size_t) id + 1U );
+    char**       keys  = (char**) xmalloc( sizeof(char*) * ( (size_t) id + 1U ) );
+    int gap = 0;
+    read_id_map();
+    idKeys = (char**) xmalloc( sizeof(char*) * ( (size_t) id + 1U ) );
+    memset( idKeys, 0, sizeof(char*) * ( (size_t) id + 1U ) );
+    memset( taken, 0, (size_t) id + 1U );
+    collect_id_keys( tree, 0, "" );
+    collect_nodes( tree, byId );
+    for ( int i=0; i < id; ++i ) {
+        idmapentry_t* e = find_id_map( idKeys[i] );
+        newId[i] = -1;
+        if ( e != 0 && e->id < id && !taken[e->id] ) {
+            newId[i] = e->id;
+            taken[e->id] = true;
+            ++idMapKept;
+        }
+    }
+    // gaps go to nodes whose id is beyond the table first, then to new nodes
+    for ( int pass=0; pass < 2; ++pass ) {
+        for ( int i=0; i < id; ++i ) {
+            if ( newId[i] >= 0 ) continue;
+            if ( ( find_id_map( idKeys[i] ) != 0 ) != ( pass == 0 ) ) continue;
+            while ( taken[gap] ) ++gap;
+            newId[i] = gap;
+            taken[gap] = true;
+            if ( pass == 0 ) ++idMapMoved;
+        }
+    }
+    for ( int i=0; i < id; ++i ) {
+        byId[i]->id = newId[i];
+        keys[newId[i]] = idKeys[i];
+    }
+    free( idKeys );
+    idKeys = keys;
+    free( byId );
+    free( newId );
+    free( taken );
+}
+
+static int id_map_node_type( treenode_t* node ) {
+    // the recorded enum value of a node, or the next unused one
+    idmapentry_t* e = find_id_map( idKeys[node->id] );
+    if ( e != 0 && e->nodeType > 0 ) return e->nodeType;
+    return idMapNext;
+}
+
+static void write_id_map( void ) {
+    FILE* fp = fopen( idMapFile, "wt" );
+    if ( fp == 0 ) report2( "failed to write id map '%s'", idMapFile );
+    fprintf( fp,
+        "# node ids and node type values, maintained by ebnfcomp\n"
+        "next %d\n", idMapNext );
+    for ( int i=0; i < id; ++i ) {
+        fprintf( fp, "%d %d %s\n", i, nodeTable[i]->nodeType, idKeys[i] );
+    }
+    fclose( fp );
+}
+
+// -- node type enums ---------------------------------------------------------
+
+static void number_nodes( treenode_t* node ) {
+    // ids in DFS pre-order
+    if ( node == 0 ) return;
+    if ( is_export_node( node ) && node->id == -1 ) node->id = id++;
+    for ( size_t i=0; i < node->numBranches; ++i ) {
+        number_nodes( node->branches[i] );
+    }
+}
+
+static void output_enums_helper( treenode_t* node, bool doasm ) {
+    if ( node == 0 ) return;
+    if ( is_export_node( node ) && node->nodeTypeEnum == 0 ) {
+        char tmp[512]; bool print = true; int known;
+        int value = idMapFile ? id_map_node_type( node ) : numNodeTypes;
+        if ( node->token == T_PRODUCTION ) {
+            name_to_C_enum( tmp, node->text );
+        } else if ( node->token == T_STR_LITERAL || node->token == T_REG_EX ) {
+            const char* text = 0;
+            if ( is_name( node->text ) ) {
+                text = name_to_label( node->text );
+                snprintf( tmp, 512U, "NT_TERMINAL_%s", text );
+                known = check_have_label( tmp, value );
+                if ( known >= 0 ) { print = false; node->nodeType = known; }
+            } else if ( ( text = operator_to_label( node->text ) ) ) {
+                snprintf( tmp, 512U, "NT_TERMINAL_%s", text );
+                known = check_have_label( tmp, value );
+                if ( known >= 0 ) { print = false; node->nodeType = known; }
+            } else if ( idMapFile ) {
+                // named after the pinned value, which outlives the node id;
+                // terminals with the same text share it
+                snprintf( tmp, 512U, "NT_TERMINAL_%d", value );
+                known = check_have_label( tmp, value );
+                if ( known >= 0 ) { print = false; node->nodeType = known; }
+            } else {
+                snprintf( tmp, 512U, "NT_TERMINAL_%d", node->id );
+            }
+        } else {
+            snprintf( tmp, 512U, "%s", "_NT_GENERIC" );
+            print = false;
+            node->nodeType = 0;
+        }
+        set_node_type_enum( node, tmp );
+        if ( print ) {
+            if ( doasm ) {
+                // 00000000001111111111222222222233333333334444444444
+                // 01234567890123456789012345678901234567890123456789
+                // _NT_GENERIC             equ         0
+                fprintf( hdrfp, "%-23s equ         %d\n", tmp, value );
+            } else if ( idMapFile ) {
+                fprintf( hdrfp, "    %s = %d,\n", tmp, value );
+            } else {
+                fprintf( hdrfp, "    %s,\n", tmp );
+            }
+            node->nodeType = value;
+            if ( value >= numNodeTypes ) numNodeTypes = value + 1;
+            if ( value >= idMapNext ) idMapNext = value + 1;
+        }
+    }
+    for ( size_t i=0; i < node->numBranches; ++i ) {
+        output_enums_helper( node->branches[i], doasm );
+    }
+}
+
+static void output_enums( bool doasm ) {
+    number_nodes( tree );
+    if ( idMapFile ) apply_id_map();
+    output_enums_helper( tree, doasm );
+}
+
+static void output_decls_helper( treenode_t* node ) {
+    if ( node == 0 ) return;
+    if ( node->id >= 0 && node->exportIdent == 0 ) {
+        const char* prefix = ""; bool numId = node->token != T_PRODUCTION;
+        switch ( node->token ) {
+            case T_PRODUCTION:      prefix = "production_"; break;
+            case T_STR_LITERAL:     prefix = "string_terminal_"; break;
+            case T_REG_EX:          prefix = "regex_terminal_"; break;
+            case T_AND_EXPR:        prefix = "mandatory_expr_"; break;
+            case T_OR_EXPR:         prefix = "alternative_expr_"; break;
+            case T_BRACK_EXPR:      prefix = "optional_expr_"; break;
+            case T_BRACE_EXPR:      prefix = "optional_repetitive_expr_"; break;
+            case T_COUNT_EXPR:      prefix = "counted_repetitive_expr_"; break;
+            case T_LITERAL_SET:     prefix = "literal_set_"; break;
+            default: break;
+        }
+        char nameText[256];
+        if ( numId ) {
+            snprintf( nameText, 256U, "%s%d", prefix, node->id );
+        } else {
+            name_to_C_name( nameText, node->text, prefix );
+        }
+        set_export_ident( node, nameText );
+        if ( node->token == T_LITERAL_SET ) {
+            node->aux = build_literal_trie( node );
+        } else if ( node->token == T_REG_EX ) {
+            node->aux = build_regex_dfa( node );
+        } else if ( node->token == T_COUNT_EXPR ) {
+            node->aux = add_repeat_count( node->minCount, node->maxCount );
+        }
+    }
+    for ( size_t i=0; i < node->numBranches; ++i ) {
+        output_decls_helper( node->branches[i] );
+    }
+}
+
+// -- table model -------------------------------------------------------------
+
+// the node properties as they appear in the tables, shared by all layouts
+
+static void node_kind( treenode_t* node, const char** pNodeClass,
+    const char** pTermType ) {
+    const char* termType = "TT_UNDEF"; const char* nodeClass = "???";
+    switch ( node->token ) {
+        case T_PRODUCTION:      nodeClass = "NC_PRODUCTION"; break;
+        case T_STR_LITERAL:     nodeClass = "NC_TERMINAL"; termType = "TT_STRING"; break;
+        case T_REG_EX:          nodeClass = "NC_TERMINAL"; termType = "TT_REGEX"; break;
+        case T_BIN_DATA:
+        case T_BIN_FIELD:
+        case T_BIN_FIELD_COUNT:
+        case T_BIN_FIELD_TIMES: nodeClass = "NC_TERMINAL"; termType = "TT_BINARY"; break;
+        case T_AND_EXPR:        nodeClass = "NC_MANDATORY"; break;
+        case T_OR_EXPR:         nodeClass = "NC_ALTERNATIVE"; break;
+        case T_BRACK_EXPR:      nodeClass = "NC_OPTIONAL"; break;
+        case T_BRACE_EXPR:      nodeClass = "NC_OPTIONAL_REPETITIVE"; break;
+        case T_COUNT_EXPR:      nodeClass = "NC_COUNTED_REPETITIVE"; break;
+        case T_LITERAL_SET:     nodeClass = "NC_LITERAL_SET"; termType = "TT_STRING"; break;
+        default: break;
+    }
+    *pNodeClass = nodeClass;
+    *pTermType  = termType;
+}
+
+static size_t node_text_size( treenode_t* node ) {
+    // the size of a buffer that holds the text node_text() returns
+    return node->text != 0 ? strlen( node->text ) + 1U : 1U;
+}
+
+static int node_text( treenode_t* node, char* buf ) {
+    // returns the length of the matched text in buf (of node_text_size()
+    // bytes), or -1 if there is none
+    if ( node->token == T_PRODUCTION || node->text == 0 ) return -1;
+    if ( node->token == T_STR_LITERAL || node->token == T_REG_EX ) {
+        size_t len = strlen( node->text );
+        memcpy( buf, node->text, len );
+        return (int) len;
+    } else if ( node->token == T_BIN_DATA ) {
+        const char* s  = node->text;
+        size_t      nb = strlen( s ) / 2U;
+        for ( size_t i=0; i < nb; ++i ) {
+            char c[3]; int x = 0;
+            c[0] = *s++;
+            c[1] = *s++;
+            c[2] = '\0';
+            sscanf( c, "%x", &x );
+            buf[i] = (char) x;
+        }
+        return (int) nb;
+    } else if ( node->token >= T_BIN_FIELD &&
+        node->token <= T_BIN_FIELD_TIMES ) {
+        int v = 0;
+        if ( strcmp( node->text, "BYTE" ) == 0 ) {
+            v |= TB_BYTE;
+        }
+        else if ( strcmp( node->text, "WORD" ) == 0 ) {
+            v |= TB_WORD;
+        }
+        else if ( strcmp( node->text, "DWORD" ) == 0 ) {
+            v |= TB_DWORD;
+        }
+        else if ( strcmp( node->text, "QWORD" ) == 0 ) {
+            v |= TB_QWORD;
+        }
+        if ( node->numBranches > 0U ) {
+            v |= TBF_PARAM;
+        }
+        if ( node->token == T_BIN_FIELD_COUNT ) {
+            v |= TBF_WRITE;
+        }
+        buf[0] = (char) v;
+        return 1;
+    }
+    return -1;
+}
+
+// -- text pool ---------------------------------------------------------------
+
+// the texts of all terminals are stored back to back in <stem>_text, and nodes
+// refer to them by offset and length, so binary data may contain NUL bytes.
+// A text that is a suffix of another text shares its bytes.
+
+typedef struct _pooltext_t {
+    treenode_t*     node;
+    char*           text;
+    int             len;
+} pooltext_t;
+
+static char*     textPool          = 0;
+static int       textPoolLen       = 0;
+static int       textPoolUnmerged  = 0;
+static int*      textPoolStarts    = 0;     // offsets of the stored texts
+static int       numTextPoolStarts = 0;
+
+static int compare_pool_texts( const void* a, const void* b ) {
+    // descending by reversed text, so every text directly follows the
+    // texts it is a suffix of
+    const pooltext_t* x = (const pooltext_t*) a;
+    const pooltext_t* y = (const pooltext_t*) b;
+    int i = x->len, j = y->len;
+    while ( i > 0 && j > 0 ) {
+        unsigned char cx = (unsigned char) x->text[--i];
+        unsigned char cy = (unsigned char) y->text[--j];
+        if ( cx != cy ) return cx < cy ? 1 : -1;
+    }
+    if ( i != j ) return i > 0 ? -1 : 1;
+    return x->node->id - y->node->id;
+}
+
+static void build_text_pool( void ) {
+    pooltext_t* texts = (pooltext_t*) xmalloc( sizeof(pooltext_t) *
+        ( (size_t) id + 1U ) );
+    int numTexts = 0;
+    textPoolLen = textPoolUnmerged = numTextPoolStarts = 0;
+    for ( int i=0; i < id; ++i ) {
+        nodeTable[i]->textOff = 0;
+        texts[numTexts].text  = (char*) xmalloc(
+            node_text_size( nodeTable[i] ) );
+        nodeTable[i]->textLen = node_text( nodeTable[i], texts[numTexts].text );
+        if ( nodeTable[i]->textLen < 0 ) {
+            free( texts[numTexts].text );
+            continue;
+        }
+        texts[numTexts].node = nodeTable[i];
+        texts[numTexts].len  = nodeTable[i]->textLen;
+        textPoolUnmerged += texts[numTexts++].len;
+    }
+    qsort( texts, (size_t) numTexts, sizeof(pooltext_t), compare_pool_texts );
+    textPool       = (char*) xmalloc( (size_t) textPoolUnmerged + 1U );
+    textPoolStarts = (int*) xmalloc( sizeof(int) * ( (size_t) numTexts + 1U ) );
+    for ( int i=0; i < numTexts; ++i ) {
+        pooltext_t* prev = i ? &texts[i-1] : 0;
+        pooltext_t* cur  = &texts[i];
+        if ( cur->len == 0 ) continue;     // offset 0, nothing to store
+        if ( prev != 0 && cur->len <= prev->len && memcmp( cur->text,
+            &prev->text[ prev->len - cur->len ], (size_t) cur->len ) == 0 ) {
+            cur->node->textOff = prev->node->textOff + prev->len - cur->len;
+            continue;
+        }
+        cur->node->textOff = textPoolLen;
+        textPoolStarts[ numTextPoolStarts++ ] = textPoolLen;
+        memcpy( &textPool[textPoolLen], cur->text, (size_t) cur->len );
+        textPoolLen += cur->len;
+    }
+    for ( int i=0; i < numTexts; ++i ) free( texts[i].text );
+    free( texts );
+}
+
+static int text_pool_size( void ) {
+    // the declared size of <stem>_text, which can't be an empty array
+    return textPoolLen ? textPoolLen : 1;
+}
+
+// -- literal prefix words ---------------------------------------------------
+
+// every string terminal refers to an entry in <stem>_literals by its aux
+// field: the first (up to) 8 bytes of its text as a little-endian word, and a
+// mask selecting them, so most literals can be accepted or rejected with one
+// unaligned load and compare.
+
+typedef struct _literalword_t {
+    unsigned long long  prefix;
+    unsigned long long  mask;
+    treenode_t*         node;
+} literalword_t;
+
+static literalword_t* literalWords    = 0;
+static int            numLiteralWords = 0;
+
+static void build_literal_words( void ) {
+    literalWords = (literalword_t*) xmalloc( sizeof(literalword_t) *
+        ( (size_t) id + 1U ) );
+    numLiteralWords = 0;
+    for ( int i=0; i < id; ++i ) {
+        treenode_t* node = nodeTable[i];
+        if ( node->token != T_STR_LITERAL || node->textLen < 0 ) continue;
+        literalword_t* w = &literalWords[ numLiteralWords ];
+        int n = node->textLen < 8 ? node->textLen : 8;
+        w->prefix = 0ULL;
+        for ( int k=0; k < n; ++k ) {
+            w->prefix |= (unsigned long long)(unsigned char)
+                textPool[ node->textOff + k ] << ( 8 * k );
+        }
+        w->mask = n == 8 ? ~0ULL : ( 1ULL << ( 8 * n ) ) - 1ULL;
+        w->node = node;
+        node->aux = numLiteralWords++;
+    }
+}
+
+// -- shift-and matchers ------------------------------------------------------
+
+// a regex with at most 63 positions (the byte sets of its Thompson NFA, left
+// to right) can instead be simulated bit-parallel in one 64-bit word, bit j
+// being set while position j may match the next byte.  Per such regex,
+// <stem>_shiftAnd holds the positions each byte may match, the positions
+// that follow themselves, those that end a match, and the maximal blocks of
+// optional positions, which the extended shift-and fills in with one
+// subtraction (so that x? and x* cost nothing extra).  The tables are only
+// kept when they reproduce the follow sets of the Glushkov automaton exactly.
+
+#define MAX_SHIFT_AND   255     // SHIFT_AND_NONE marks the rest
+
+typedef struct _shiftand_t {
+    unsigned long long  masks[256];
+    unsigned long long  repeat;
+    unsigned long long  optional;
+    unsigned long long  blockStart;
+    unsigned long long  blockEnd;
+    unsigned long long  last;
+} shiftand_t;
+
+static shiftand_t* shiftAnds    = 0;
+static int         numShiftAnds = 0;
+static int         numSpanMatchers = 0;
+
+static unsigned long long nfa_positions( const treenode_t* node, int from,
+    const int* posOf, unsigned* set, int* stack, bool* accepts ) {
+    // the positions in the closure of NFA state 'from' (absolute), and
+    // whether it contains the accepting state
+    int count = node->nfaCount;
+    unsigned long long ps = 0ULL;
+    memset( set, 0, sizeof(unsigned) * (size_t)( count / 32 + 1 ) );
+    *accepts = false;
+    if ( from < 0 ) return ps;
+    from -= node->nfaBase;
+    set[from>>5] |= 1U << (from&31);
+    nfa_closure( set, node->nfaBase, count, stack );
+    for ( int i=0; i < count; ++i ) {
+        if ( !( set[i>>5] & ( 1U << (i&31) ) ) ) continue;
+        if ( posOf[i] >= 0 ) ps |= 1ULL << posOf[i];
+        if ( nfaStates[ node->nfaBase + i ].tag >= 0 ) *accepts = true;
+    }
+    return ps;
+}
+
+static unsigned long long shift_and_fill( const shiftand_t* sa,
+    unsigned long long e ) {
+    unsigned long long f = e | sa->blockEnd;
+    return e | ( sa->optional & ( ~( f - sa->blockStart ) ^ f ) );
+}
+
+static bool build_shift_and_node( const treenode_t* node, shiftand_t* sa ) {
+    int count = node->nfaCount, m = 0;
+    int* posOf  = (int*) xmalloc( sizeof(int) * ( (size_t) count + 1U ) );
+    int* stack  = (int*) xmalloc( sizeof(int) * ( (size_t) count + 1U ) );
+    unsigned* set = (unsigned*) xmalloc( sizeof(unsigned) *
+        (size_t)( count / 32 + 1 ) );
+    unsigned long long follow[64], first, all;
+    bool accepts, ok = true;
+    for ( int i=0; i < count; ++i ) {
+        posOf[i] = nfaStates[ node->nfaBase + i ].consuming && m < 64 ? m++ : -1;
+    }
+    memset( sa, 0, sizeof(*sa) );
+    if ( m == 0 || m > 63 ) ok = false;
+    first = ok ? nfa_positions( node, node->nfaStart, posOf, set, stack,
+        &accepts ) : 0ULL;
+    if ( ok && accepts ) ok = false;    // matches the empty string
+    for ( int i=0; ok && i < count; ++i ) {
+        int j = posOf[i];
+        if ( j < 0 ) continue;
+        const nfastate_t* st = &nfaStates[ node->nfaBase + i ];
+        follow[j] = nfa_positions( node, st->out, posOf, set, stack, &accepts );
+        if ( accepts ) sa->last |= 1ULL << j;
+        if ( follow[j] & ( 1ULL << j ) ) sa->repeat |= 1ULL << j;
+        for ( int c=0; c < 256; ++c ) {
+            if ( st->set[c>>3] & ( 1U << (c&7) ) ) sa->masks[c] |= 1ULL << j;
+        }
+    }
+    // position j is optional when whatever leads to it may also skip it;
+    // bit m stands for the end of the regex
+    for ( int j=0, a=-1; ok && j <= m; ++j ) {
+        bool opt = false;
+        if ( j + 1 < m ) {
+            opt = ( ( j == 0 ? first : follow[j-1] ) >> ( j + 1 ) ) & 1U;
+        } else if ( j + 1 == m && j > 0 ) {
+            opt = ( sa->last >> ( j - 1 ) ) & 1U;
+        }
+        if ( opt && a < 0 ) a = j;
+        if ( !opt && a >= 0 ) {
+            sa->optional   |= ( ~0ULL >> ( 63 - j ) ) & ~( ( 1ULL << a ) - 1ULL );
+            sa->blockStart |= 1ULL << a;
+            sa->blockEnd   |= 1ULL << j;
+            a = -1;
+        }
+    }
+    // check every step against the Glushkov automaton: the simulation is
+    // linear in the set of active positions, so single positions suffice
+    all = !ok ? 0ULL : m < 64 ? ( 1ULL << m ) - 1ULL : ~0ULL;
+    if ( ok && ( shift_and_fill( sa, 1ULL ) & all ) != first ) ok = false;
+    for ( int j=0; ok && j < m; ++j ) {
+        unsigned long long d = 1ULL << j;
+        unsigned long long e = ( d << 1 ) | ( d & sa->repeat );
+        if ( ( shift_and_fill( sa, e ) & all ) != follow[j] ) ok = false;
+    }
+    free( posOf );
+    free( stack );
+    free( set );
+    return ok;
+}
+
+static bool dfa_is_span( const dfa_t* dfa ) {
+    // [set]+ : the start state goes to an accepting state on the bytes of
+    // set, which loops on exactly these bytes
+    if ( dfa->numStates != 2 || dfa->accept[0] >= 0 || dfa->accept[1] < 0 ) {
+        return false;
+    }
+    for ( int c=0; c < 256; ++c ) {
+        int t = dfa->trans[c];
+        if ( ( t >= 0 && t != 1 ) || dfa->trans[ 256 + c ] != t ) return false;
+    }
+    return true;
+}
+
+static void build_shift_ands( void ) {
+    shiftAnds = (shiftand_t*) xmalloc( sizeof(shiftand_t) *
+        ( (size_t) numRegexDfas + 1U ) );
+    numShiftAnds = numSpanMatchers = 0;
+    for ( int i=0; i < numRegexDfas; ++i ) {
+        regexhint_t* h = &regexHints[i];
+        if ( h->firstSet != SPAN_NONE && dfa_is_span( &dfas[i] ) ) {
+            h->matcher = MK_SPAN;
+            ++numSpanMatchers;
+        }
+    }
+    for ( int k=0; k < id; ++k ) {
+        treenode_t* node = nodeTable[k];
+        if ( node->token != T_REG_EX || node->aux < 0 ) continue;
+        regexhint_t* h = &regexHints[ node->aux ];
+        if ( h->matcher == MK_SPAN || h->matcher == MK_SHIFT_AND ||
+            numShiftAnds == MAX_SHIFT_AND ) continue;
+        if ( !build_shift_and_node( node, &shiftAnds[numShiftAnds] ) ) continue;
+        h->matcher  = MK_SHIFT_AND;
+        h->shiftAnd = numShiftAnds++;
+    }
+}
+
+// -- lazy DFAs ---------------------------------------------------------------
+
+// a regex terminal without a DFA (MK_LAZY_DFA) keeps its Thompson NFA in
+// <stem>_nfaStates instead, located by <stem>_regexNfas, with the byte set
+// of every consuming state in <stem>_spanSets.  The generated runtime builds
+// DFA states from it as the input needs them (see <stem>_lazy_match()).
+
+typedef struct _regexnfa_t {
+    int         numStates;  // 0 if the regex has no NFA here
+    int         states;     // first in lazyStates
+    int         start;      // relative to states
+} regexnfa_t;
+
+typedef struct _lazystate_t {
+    int         out;        // relative to the regex's first state, or -1
+    int         out1;
+    int         set;        // spanSets index, or SPAN_NONE if not consuming
+    bool        accept;
+} lazystate_t;
+
+static regexnfa_t*  regexNfas     = 0;      // by regex
+static lazystate_t* lazyStates    = 0;
+static int          numLazyStates = 0;
+static int          numLazyDfas   = 0;
+static int          maxLazyStates = 1;      // of any one regex
+
+static void build_regex_nfas( void ) {
+    regexNfas = (regexnfa_t*) xmalloc( sizeof(regexnfa_t) *
+        ( (size_t) numRegexDfas + 1U ) );
+    memset( regexNfas, 0, sizeof(regexnfa_t) * ( (size_t) numRegexDfas + 1U ) );
+    numLazyStates = numLazyDfas = 0;
+    maxLazyStates = 1;
+    for ( int k=0; k < id; ++k ) {
+        treenode_t* node = nodeTable[k];
+        if ( node->token != T_REG_EX || node->aux < 0 ) continue;
+        regexnfa_t* rn = &regexNfas[ node->aux ];
+        if ( regexHints[ node->aux ].matcher != MK_LAZY_DFA ||
+            rn->numStates > 0 ) continue;
+        int base = node->nfaBase, count = node->nfaCount;
+        xrealloc( (void**)(&lazyStates), sizeof(lazystate_t) *
+            (size_t)( numLazyStates + count ) );
+        rn->numStates = count;
+        rn->states    = numLazyStates;
+        rn->start     = node->nfaStart - base;
+        for ( int i=0; i < count; ++i ) {
+            const nfastate_t* st = &nfaStates[ base + i ];
+            lazystate_t* ls = &lazyStates[ numLazyStates++ ];
+            ls->out    = st->out  < 0 ? -1 : st->out  - base;
+            ls->out1   = st->out1 < 0 ? -1 : st->out1 - base;
+            ls->set    = SPAN_NONE;
+            ls->accept = st->tag >= 0;
+            if ( !st->consuming ) continue;
+            unsigned char set[32];
+            memset( set, 0, sizeof(set) );
+            for ( int c=0; c < 256; ++c ) {
+                if ( set_has( st->set, c ) ) byte_set_add( set, c );
+            }
+            ls->set = intern_span_set( set );
+            if ( ls->set == SPAN_NONE ) {
+                report2( "regular expression /%s/ needs more than %d byte sets",
+                    node->text, MAX_SPAN_SETS );
+            }
+        }
+        if ( count > maxLazyStates ) maxLazyStates = count;
+        ++numLazyDfas;
+    }
+}
+
+// -- compact table layouts ---------------------------------------------------
+
+// with --compact, each node is a record of unsigned integers as narrow as the
+// counts of this grammar allow, and values that are -1 (or -2) in the default
+// layout become all ones (minus 1).  With --soa, the same fields are emitted
+// as parallel arrays, one per field.
+
+enum {
+    LAYOUT_AOS,
+    LAYOUT_COMPACT,
+    LAYOUT_SOA
+};
+
+enum {
+    PF_TEXT,
+    PF_TEXT_LEN,
+    PF_BRANCHES,
+    PF_AUX,
+    PF_NODE_TYPE,
+    PF_NUM_BRANCHES,
+    PF_NODE_CLASS,
+    PF_TERM_TYPE,
+    PF_COUNT
+};
+
+typedef struct _pnfield_t {
+    const char*     name;
+    const char*     soaName;
+    const char*     accessor;
+    const char*     type;       // of the accessor's result
+    int             bytes;
+    bool            widen;      // -1 is stored as all ones
+} pnfield_t;
+
+static int       layout        = LAYOUT_AOS;
+static pnfield_t pnFields[PF_COUNT];
+static int       pnOrder[PF_COUNT];     // fields by decreasing width
+static int       pnRecordBytes = 0;
+static int       nodeIdBytes   = 0;
+
+static int width_for( long maxValue ) {
+    // the two largest values of each width are reserved for -1 and -2
+    if ( maxValue <= 0xfdL ) return 1;
+    if ( maxValue <= 0xfffdL ) return 2;
+    return 4;
+}
+
+static unsigned long field_value( long v, int bytes ) {
+    unsigned long ones = bytes == 1 ? 0xffUL : bytes == 2 ? 0xffffUL :
+        0xffffffffUL;
+    return v < 0 ? ones + 1UL + (unsigned long) v : (unsigned long) v;
+}
+
+static void plan_compact_layout( void ) {
+    long maxAux = 0, maxNumBranches = 0, maxTextLen = 0;
+    for ( int i=0; i < id; ++i ) {
+        if ( nodeTable[i]->aux > maxAux ) maxAux = nodeTable[i]->aux;
+        if ( nodeTable[i]->textLen > maxTextLen ) {
+            maxTextLen = nodeTable[i]->textLen;
+        }
+        if ( (long) nodeTable[i]->numBranches > maxNumBranches ) {
+            maxNumBranches = (long) nodeTable[i]->numBranches;
+        }
+    }
+    static const pnfield_t fields[PF_COUNT] = {
+        { "text",        "textOff",     "TEXT_OFF",     "int",  0, false },
+        { "textLen",     "textLen",     "TEXT_LEN",     "int",  0, true  },
+        { "branches",    "branchStart", "BRANCHES",     "int",  0, true  },
+        { "aux",         "aux",         "AUX",          "int",  0, true  },
+        { "nodeType",    "nodeType",    "NODE_TYPE",    "nodetype_t", 0, false },
+        { "numBranches", "branchCount", "NUM_BRANCHES", "int",  0, false },
+        { "nodeClass",   "nodeClass",   "NODE_CLASS",   "nodeclass_t", 1, false },
+        { "termType",    "termType",    "TERM_TYPE", "terminaltype_t", 1, false },
+    };
+    memcpy( pnFields, fields, sizeof(fields) );
+    pnFields[PF_TEXT].bytes         = width_for( textPoolLen );
+    pnFields[PF_TEXT_LEN].bytes     = width_for( maxTextLen );
+    pnFields[PF_BRANCHES].bytes     = width_for( branches_ix );
+    pnFields[PF_AUX].bytes          = width_for( maxAux );
+    pnFields[PF_NODE_TYPE].bytes    = width_for( numNodeTypes );
+    pnFields[PF_NUM_BRANCHES].bytes = width_for( maxNumBranches );
+    nodeIdBytes = width_for( id );
+    // widest first, so every field is naturally aligned without padding
+    int n = 0;
+    for ( int bytes = 4; bytes >= 1; bytes /= 2 ) {
+        for ( int f=0; f < PF_COUNT; ++f ) {
+            if ( pnFields[f].bytes == bytes ) pnOrder[n++] = f;
+        }
+    }
+    pnRecordBytes = 0;
+    for ( int f=0; f < PF_COUNT; ++f ) pnRecordBytes += pnFields[f].bytes;
+    int align = pnFields[ pnOrder[0] ].bytes;
+    pnRecordBytes = ( pnRecordBytes + align - 1 ) / align * align;
+}
+
+static const char* uint_type( int bytes ) {
+    return bytes == 1 ? "uint8_t" : bytes == 2 ? "uint16_t" : "uint32_t";
+}
+
+static void pn_field_source( char buf[256], treenode_t* node, int f ) {
+    const char* nodeClass; const char* termType;
+    node_kind( node, &nodeClass, &termType );
+    switch ( f ) {
+        case PF_TEXT:
+            snprintf( buf, 256U, "%d", node->textOff ); break;
+        case PF_TEXT_LEN:
+            snprintf( buf, 256U, "0x%lx", field_value( node->textLen,
+                pnFields[f].bytes ) ); break;
+        case PF_BRANCHES:
+            snprintf( buf, 256U, "0x%lx", field_value( node->branchesIx,
+                pnFields[f].bytes ) ); break;
+        case PF_AUX:
+            snprintf( buf, 256U, "0x%lx", field_value( node->aux,
+                pnFields[f].bytes ) ); break;
+        case PF_NODE_TYPE:
+            snprintf( buf, 256U, "%s", node->nodeTypeEnum ); break;
+        case PF_NUM_BRANCHES:
+            snprintf( buf, 256U, "%d", (int) node->numBranches ); break;
+        case PF_NODE_CLASS:
+            snprintf( buf, 256U, "%s", nodeClass ); break;
+        default:
+            snprintf( buf, 256U, "%s", termType ); break;
+    }
+}
+
+// -- binary output -----------------------------------------------------------
+
+// tables written as raw bytes (--emit-binary, --incbin) are assembled in
+// binBuf, little-endian
+
+static unsigned char* binBuf     = 0;
+static size_t         binLen     = 0;
+static size_t         binAlloc   = 0;
+
+static void bin_u8( unsigned v ) {
+    if ( binLen == binAlloc ) {
+        binAlloc = binAlloc ? binAlloc * 2U : 4096U;
+        xrealloc( (void**)(&binBuf), binAlloc );
+    }
+    binBuf[binLen++] = (unsigned char) v;
+}
+
+static void bin_u16( unsigned v ) {
+    bin_u8( v & 0xffU );
+    bin_u8( ( v >> 8 ) & 0xffU );
+}
+
+static void bin_u32( unsigned long v ) {
+    bin_u16( (unsigned)( v & 0xffffUL ) );
+    bin_u16( (unsigned)( ( v >> 16 ) & 0xffffUL ) );
+}
+
+static void bin_u64( unsigned long long v ) {
+    bin_u32( (unsigned long)( v & 0xffffffffULL ) );
+    bin_u32( (unsigned long)( v >> 32 ) );
+}
+
+static void bin_u32_at( size_t off, unsigned long v ) {
+    for ( int i=0; i < 4; ++i ) binBuf[off+(size_t)i] = (unsigned char)( v >> (8*i) );
+}
+
+static void bin_align( void ) {
+    while ( binLen & 7U ) bin_u8( 0 );
+}
+
+static void write_bin_file( const char* path ) {
+    FILE* fp = fopen( path, "wb" );
+    if ( fp == 0 ) report( "failed to create binary file '%s'", path );
+    if ( fwrite( binBuf, 1U, binLen, fp ) != binLen || fclose( fp ) != 0 ) {
+        report( "failed to write binary file '%s'", path );
+    }
+}
+
+static void bin_regex_hint( const regexhint_t* h ) {
+    // as regexhint_t of the generated header, 24 bytes
+    bin_u64( h->prefix );
+    bin_u64( h->mask );
+    bin_u32( (unsigned long) h->required );
+    bin_u8( (unsigned) h->prefixLen );
+    bin_u8( (unsigned) h->firstSet );
+    bin_u8( (unsigned) h->matcher );
+    bin_u8( (unsigned) h->shiftAnd );
+}
+
+static void bin_shift_and( const shiftand_t* sa ) {
+    // as shiftand_t of the generated header, 2088 bytes
+    for ( int c=0; c < 256; ++c ) bin_u64( sa->masks[c] );
+    bin_u64( sa->repeat );
+    bin_u64( sa->optional );
+    bin_u64( sa->blockStart );
+    bin_u64( sa->blockEnd );
+    bin_u64( sa->last );
+}
+
+static void bin_regex_nfa( const regexnfa_t* rn ) {
+    // as regexnfa_t of the generated header, 12 bytes
+    bin_u32( (unsigned long) rn->numStates );
+    bin_u32( (unsigned long) rn->states );
+    bin_u32( (unsigned long) rn->start );
+}
+
+static void bin_repeat_count( const repeatcount_t* rc ) {
+    // as repeatinfo_t of the generated header, 8 bytes
+    bin_u32( (unsigned long) rc->min );
+    bin_u32( (unsigned long) rc->max );
+}
+
+static void bin_lazy_state( const lazystate_t* ls ) {
+    // as nfastate_t of the generated header, 12 bytes
+    bin_u32( (unsigned long) ls->out );
+    bin_u32( (unsigned long) ls->out1 );
+    bin_u8( (unsigned) ls->set );
+    bin_u8( ls->accept ? 1U : 0U );
+    bin_u16( 0 );
+}
+
+// -- binary table file -------------------------------------------------------
+
+// with --emit-binary, the tables are also written to <stem>.ebt, in a format
+// that doesn't depend on the grammar: a header with a directory of sections,
+// then the sections, all little-endian, 8-byte aligned and addressed by file
+// offset, so that a loader can map the file and use the tables in place.
+// The checksum is FNV-1a over everything after the (padded) header.
+
+#define EBT_VERSION         9
+#define EBT_HEADER_BYTES    432     // 28 + 16 per section, padded to 8
+
+enum {
+    EBT_NODES,
+    EBT_BRANCHES,
+    EBT_TEXT,
+    EBT_TRIE_STATES,
+    EBT_TRIE_EDGES,
+    EBT_REGEXES,
+    EBT_BYTE_CLASS,
+    EBT_DFA_TRANS,
+    EBT_DFA_ACCEPT,
+    EBT_LEXER,
+    EBT_LEXER_TOKEN,
+    EBT_LEXER_MODES,
+    EBT_LITERALS,
+    EBT_DFA_SPAN,
+    EBT_SPAN_SETS,
+    EBT_REGEX_HINTS,
+    EBT_SHIFT_AND,
+    EBT_REGEX_NFAS,
+    EBT_NFA_STATES,
+    EBT_REPEATS,
+    EBT_SEARCH,
+    EBT_SEARCH_LEN,
+    EBT_SKIP,
+    EBT_SKIP_MODES,
+    EBT_SKIP_BLANKS,
+    EBT_SECTIONS
+};
+
+static const char* nodeClassNames[] = {
+    "NC_TERMINAL", "NC_PRODUCTION", "NC_MANDATORY", "NC_ALTERNATIVE",
+    "NC_OPTIONAL", "NC_OPTIONAL_REPETITIVE", "NC_LITERAL_SET",
+    "NC_COUNTED_REPETITIVE", 0
+};
+
+static const char* termTypeNames[] = {
+    "TT_UNDEF", "TT_STRING", "TT_REGEX", "TT_BINARY", 0
+};
+
+static bool           emitBinary = false;
+
+static int name_index( const char** names, const char* name ) {
+    for ( int i=0; names[i] != 0; ++i ) {
+        if ( strcmp( names[i], name ) == 0 ) return i;
+    }
+    return -1;
+}
+
+static unsigned long fnv1a( const unsigned char* p, size_t n ) {
+    unsigned long h = 2166136261UL;
+    for ( size_t i=0; i < n; ++i ) {
+        h = ( ( h ^ p[i] ) * 16777619UL ) & 0xffffffffUL;
+    }
+    return h;
+}
+
+static void ebt_section( int sect, size_t start, unsigned long count ) {
+    bin_u32_at( 28U + 16U * (size_t) sect, count );
+    bin_u32_at( 32U + 16U * (size_t) sect, start );
+    bin_u32_at( 36U + 16U * (size_t) sect, binLen - start );
+    bin_u32_at( 40U + 16U * (size_t) sect, count ? ( binLen - start ) / count :
+        0U );
+    bin_align();
+}
+
+static void write_binary_tables( void ) {
+    char path[256]; size_t start;
+    binLen = 0;
+    bin_u8( 'E' ); bin_u8( 'B' ); bin_u8( 'T' ); bin_u8( 0x1a );
+    bin_u32( 0x01020304UL );            // byte order mark
+    bin_u32( EBT_VERSION );
+    bin_u32( 0 );                       // file bytes
+    bin_u32( 0 );                       // checksum
+    bin_u32( EBT_SECTIONS );
+    bin_u32( (unsigned long) numByteClasses );
+    for ( int i=0; i < 4 * EBT_SECTIONS; ++i ) bin_u32( 0 );
+    bin_align();
+    if ( binLen != EBT_HEADER_BYTES ) report( "internal error: EBT header" );
+
+    start = binLen;
+    for ( int i=0; i < id; ++i ) {
+        const char* nodeClass; const char* termType;
+        treenode_t* node = nodeTable[i];
+        node_kind( node, &nodeClass, &termType );
+        bin_u32( (unsigned long) name_index( nodeClassNames, nodeClass ) );
+        bin_u32( (unsigned long) node->nodeType );
+        bin_u32( (unsigned long) name_index( termTypeNames, termType ) );
+        bin_u32( (unsigned long) node->textOff );
+        bin_u32( (unsigned long) node->textLen );
+        bin_u32( (unsigned long) node->numBranches );
+        bin_u32( (unsigned long) node->branchesIx );
+        bin_u32( (unsigned long) node->aux );
+    }
+    ebt_section( EBT_NODES, start, (unsigned long) id );
+    start = binLen;
+    for ( int i=0; i < branches_ix; ++i ) {
+        bin_u32( (unsigned long) branchTable[i] );
+    }
+    ebt_section( EBT_BRANCHES, start, (unsigned long) branches_ix );
+    start = binLen;
+    for ( int i=0; i < textPoolLen; ++i ) bin_u8( (unsigned char) textPool[i] );
+    ebt_section( EBT_TEXT, start, (unsigned long) textPoolLen );
+    start = binLen;
+    for ( int st=0; st < numTrieStates; ++st ) {
+        bin_u32( (unsigned long) trieStates[st].accept );
+        bin_u32( (unsigned long) trieStates[st].numEdges );
+        bin_u32( (unsigned long) trieStates[st].edges );
+    }
+    ebt_section( EBT_TRIE_STATES, start, (unsigned long) numTrieStates );
+    start = binLen;
+    for ( int st=0; st < numTrieStates; ++st ) {
+        for ( int c=0; c < 256; ++c ) {
+            if ( trieStates[st].child[c] == 0 ) continue;
+            bin_u8( (unsigned) c ); bin_u8( 0 ); bin_u16( 0 );
+            bin_u32( (unsigned long) trieStates[st].child[c] );
+        }
+    }
+    ebt_section( EBT_TRIE_EDGES, start, (unsigned long) numTrieEdges );
+    start = binLen;
+    for ( int i=0; i < numRegexDfas; ++i ) {
+        bin_u32( (unsigned long) dfas[i].numStates );
+        bin_u32( (unsigned long) dfa_first_state( i ) );
+    }
+    ebt_section( EBT_REGEXES, start, (unsigned long) numRegexDfas );
+    start = binLen;
+    for ( int c=0; c < 256; ++c ) bin_u8( byteClass[c] );
+    ebt_section( EBT_BYTE_CLASS, start, 256UL );
+    start = binLen;
+    for ( int i=0; i < numDfas; ++i ) {
+        for ( int st=0; st < dfas[i].numStates; ++st ) {
+            for ( int k=0; k < numByteClasses; ++k ) {
+                int t = dfas[i].trans[ st*256 + classRep[k] ];
+                bin_u16( t < 0 ? 0xffffU : (unsigned) t );
+            }
+        }
+    }
+    ebt_section( EBT_DFA_TRANS, start, (unsigned long) numDfaStatesTotal *
+        (unsigned long) numByteClasses );
+    start = binLen;
+    for ( int i=0; i < numDfas; ++i ) {
+        for ( int st=0; st < dfas[i].numStates; ++st ) {
+            bin_u8( dfas[i].accept[st] >= 0 ? 1U : 0U );
+        }
+    }
+    ebt_section( EBT_DFA_ACCEPT, start, (unsigned long) numDfaStatesTotal );
+    start = binLen;
+    int numLexerStates = lexerDfa >= 0 ? dfas[lexerDfa].numStates : 0;
+    bin_u32( (unsigned long) numLexerStates );
+    bin_u32( (unsigned long)( lexerDfa >= 0 ? dfa_first_state( lexerDfa ) :
+        numDfaStatesTotal ) );
+    ebt_section( EBT_LEXER, start, 1UL );
+    start = binLen;
+    for ( int st=0; st < numLexerStates; ++st ) {
+        int tag = dfas[lexerDfa].accept[st];
+        bin_u32( tag >= 0 ? (unsigned long) lexerTokens[tag]->nodeType : 0UL );
+    }
+    ebt_section( EBT_LEXER_TOKEN, start, (unsigned long) numLexerStates );
+    start = binLen;
+    for ( int m=0; m < numLexerModes; ++m ) {
+        int st = lexerDfa >= 0 ? dfas[lexerDfa].starts[m] : -1;
+        bin_u16( st < 0 ? 0xffffU : (unsigned) st );
+    }
+    ebt_section( EBT_LEXER_MODES, start, (unsigned long) numLexerModes );
+    start = binLen;
+    for ( int i=0; i < numLiteralWords; ++i ) {
+        bin_u64( literalWords[i].prefix );
+        bin_u64( literalWords[i].mask );
+    }
+    ebt_section( EBT_LITERALS, start, (unsigned long) numLiteralWords );
+    start = binLen;
+    for ( int i=0; i < numDfaStatesTotal; ++i ) bin_u8( dfaSpan[i] );
+    ebt_section( EBT_DFA_SPAN, start, (unsigned long) numDfaStatesTotal );
+    start = binLen;
+    for ( int k=0; k < numSpanSets; ++k ) {
+        for ( int j=0; j < 32; ++j ) bin_u8( spanSets[k][j] );
+    }
+    ebt_section( EBT_SPAN_SETS, start, (unsigned long) numSpanSets );
+    start = binLen;
+    for ( int i=0; i < numRegexDfas; ++i ) bin_regex_hint( &regexHints[i] );
+    ebt_section( EBT_REGEX_HINTS, start, (unsigned long) numRegexDfas );
+    start = binLen;
+    for ( int k=0; k < numShiftAnds; ++k ) bin_shift_and( &shiftAnds[k] );
+    ebt_section( EBT_SHIFT_AND, start, (unsigned long) numShiftAnds );
+    start = binLen;
+    for ( int i=0; i < numRegexDfas; ++i ) bin_regex_nfa( &regexNfas[i] );
+    ebt_section( EBT_REGEX_NFAS, start, (unsigned long) numRegexDfas );
+    start = binLen;
+    for ( int i=0; i < numLazyStates; ++i ) bin_lazy_state( &lazyStates[i] );
+    ebt_section( EBT_NFA_STATES, start, (unsigned long) numLazyStates );
+    start = binLen;
+    for ( int i=0; i < numRepeatCounts; ++i ) bin_repeat_count( &repeatCounts[i] );
+    ebt_section( EBT_REPEATS, start, (unsigned long) numRepeatCounts );
+    start = binLen;
+    bin_u32( (unsigned long)( skipDfa >= 0 ? dfas[skipDfa].numStates : 0 ) );
+    bin_u32( (unsigned long)( skipDfa >= 0 ? dfa_first_state( skipDfa ) :
+        numDfaStatesTotal ) );
+    ebt_section( EBT_SKIP, start, 1UL );
+    start = binLen;
+    for ( int m=0; m < numLexerModes; ++m ) {
+        int st = skipDfa >= 0 ? dfas[skipDfa].starts[m] : -1;
+        bin_u16( st < 0 ? 0xffffU : (unsigned) st );
+    }
+    ebt_section( EBT_SKIP_MODES, start, (unsigned long) numLexerModes );
+    start = binLen;
+    for ( int m=0; m < numLexerModes; ++m ) bin_u8( skipBlanks[m] );
+    ebt_section( EBT_SKIP_BLANKS, start, (unsigned long) numLexerModes );
+    start = binLen;
+    int numSearchStates = searchDfa >= 0 ? dfas[searchDfa].numStates : 0;
+    bin_u32( (unsigned long) numSearchStates );
+    bin_u32( (unsigned long)( searchDfa >= 0 ? dfa_first_state( searchDfa ) :
+        numDfaStatesTotal ) );
+    ebt_section( EBT_SEARCH, start, 1UL );
+    start = binLen;
+    for ( int st=0; st < numSearchStates; ++st ) {
+        int len = dfas[searchDfa].accept[st];
+        bin_u8( len >= 0 ? (unsigned) len : 0U );
+    }
+    ebt_section( EBT_SEARCH_LEN, start, (unsigned long) numSearchStates );
+
+    bin_u32_at( 12U, (unsigned long) binLen );
+    bin_u32_at( 16U, fnv1a( &binBuf[EBT_HEADER_BYTES], binLen - EBT_HEADER_BYTES ) );
+    snprintf( path, 256U, "%s.ebt", fileStem );
+    write_bin_file( path );
+}
+
+// -- table blobs -------------------------------------------------------------
+
+// with --incbin, the large tables are written to <stem>.bin in exactly the
+// layout of the generated declarations, and the generated code includes them
+// with the assembler's incbin directive instead of initializers, which are
+// slow to compile for large grammars.  With --elf, all tables are laid out
+// the same way and written to an object file directly.  Only the compact and
+// soa layouts have a fixed record layout, so both imply --compact.
+
+typedef struct _blobtable_t {
+    char            name[64];       // symbol, without the <stem>_ prefix
+    size_t          offset;
+    size_t          bytes;
+} blobtable_t;
+
+static bool          incbin          = false;
+static blobtable_t   blobTables[PF_COUNT + 32];
+static int           numBlobTables   = 0;
+static char          incbinFile[256] = { 0, };
+
+static void bin_uint( unsigned long v, int bytes ) {
+    if ( bytes == 1 ) {
+        bin_u8( (unsigned) v );
+    } else if ( bytes == 2 ) {
+        bin_u16( (unsigned) v );
+    } else {
+        bin_u32( v );
+    }
+}
+
+static void blob_table( const char* name ) {
+    // ends the previous table and starts the next one, 8-byte aligned
+    if ( numBlobTables > 0 ) {
+        blobtable_t* t = &blobTables[ numBlobTables - 1 ];
+        t->bytes = binLen - t->offset;
+    }
+    bin_align();
+    if ( name == 0 ) return;
+    if ( numBlobTables == (int)( sizeof(blobTables) / sizeof(blobTables[0]) ) ) {
+        report2( "internal error: too many tables" );
+    }
+    blobtable_t* t = &blobTables[ numBlobTables++ ];
+    snprintf( t->name, 64U, "%s", name );
+    t->offset = binLen;
+}
+
+static long pn_field_value( treenode_t* node, int f ) {
+    const char* nodeClass; const char* termType;
+    node_kind( node, &nodeClass, &termType );
+    switch ( f ) {
+        case PF_TEXT:           return node->textOff;
+        case PF_TEXT_LEN:       return node->textLen;
+        case PF_BRANCHES:       return node->branchesIx;
+        case PF_AUX:            return node->aux;
+        case PF_NODE_TYPE:      return node->nodeType;
+        case PF_NUM_BRANCHES:   return (long) node->numBranches;
+        case PF_NODE_CLASS:     return name_index( nodeClassNames, nodeClass );
+        default:                return name_index( termTypeNames, termType );
+    }
+}
+
+static void build_table_blob( bool all ) {
+    // all: include the small tables, too
+    binLen = 0;
+    numBlobTables = 0;
+    blob_table( "branches" );
+    for ( int i=0; i < branches_ix; ++i ) {
+        bin_uint( field_value( branchTable[i], nodeIdBytes ), nodeIdBytes );
+    }
+    if ( layout == LAYOUT_SOA ) {
+        for ( int f=0; f < PF_COUNT; ++f ) {
+            blob_table( pnFields[f].soaName );
+            for ( int i=0; i < id; ++i ) {
+                bin_uint( field_value( pn_field_value( nodeTable[i], f ),
+                    pnFields[f].bytes ), pnFields[f].bytes );
+            }
+        }
+    } else {
+        blob_table( "parsingTable" );
+        for ( int i=0; i < id; ++i ) {
+            size_t start = binLen;
+            for ( int k=0; k < PF_COUNT; ++k ) {
+                int f = pnOrder[k];
+                bin_uint( field_value( pn_field_value( nodeTable[i], f ),
+                    pnFields[f].bytes ), pnFields[f].bytes );
+            }
+            while ( binLen < start + (size_t) pnRecordBytes ) bin_u8( 0 );
+        }
+    }
+    blob_table( "text" );
+    for ( int i=0; i < text_pool_size(); ++i ) {
+        bin_u8( i < textPoolLen ? (unsigned char) textPool[i] : 0U );
+    }
+    blob_table( "literals" );
+    for ( int i=0; i < numLiteralWords; ++i ) {
+        bin_u64( literalWords[i].prefix );
+        bin_u64( literalWords[i].mask );
+    }
+    blob_table( "trieStates" );
+    for ( int st=0; st < numTrieStates; ++st ) {
+        bin_u32( (unsigned long) trieStates[st].accept );
+        bin_u32( (unsigned long) trieStates[st].numEdges );
+        bin_u32( (unsigned long) trieStates[st].edges );
+    }
+    blob_table( "trieEdges" );
+    for ( int st=0; st < numTrieStates; ++st ) {
+        for ( int c=0; c < 256; ++c ) {
+            if ( trieStates[st].child[c] == 0 ) continue;
+            bin_u8( (unsigned) c ); bin_u8( 0 ); bin_u16( 0 );
+            bin_u32( (unsigned long) trieStates[st].child[c] );
+        }
+    }
+    blob_table( "byteClass" );
+    for ( int c=0; c < 256; ++c ) bin_u8( byteClass[c] );
+    blob_table( "dfaTrans" );
+    for ( int i=0; i < numDfas; ++i ) {
+        for ( int st=0; st < dfas[i].numStates; ++st ) {
+            for ( int k=0; k < numByteClasses; ++k ) {
+                bin_uint( dfa_target( &dfas[i], st, k ), dfaStateBytes );
+            }
+        }
+    }
+    blob_table( "dfaAccept" );
+    for ( int i=0; i < numDfas; ++i ) {
+        for ( int st=0; st < dfas[i].numStates; ++st ) {
+            bin_u8( dfas[i].accept[st] >= 0 ? 1U : 0U );
+        }
+    }
+    blob_table( "regexHints" );
+    for ( int i=0; i < numRegexDfas; ++i ) {
+        bin_regex_hint( &regexHints[i] );
+    }
+    blob_table( "shiftAnd" );
+    for ( int k=0; k < numShiftAnds; ++k ) bin_shift_and( &shiftAnds[k] );
+    blob_table( "regexNfas" );
+    for ( int i=0; i < numRegexDfas; ++i ) bin_regex_nfa( &regexNfas[i] );
+    blob_table( "nfaStates" );
+    for ( int i=0; i < numLazyStates; ++i ) bin_lazy_state( &lazyStates[i] );
+    blob_table( "repeats" );
+    for ( int i=0; i < numRepeatCounts; ++i ) bin_repeat_count( &repeatCounts[i] );
+    blob_table( "dfaSpan" );
+    for ( int i=0; i < numDfaStatesTotal; ++i ) bin_u8( dfaSpan[i] );
+    blob_table( "spanSets" );
+    for ( int k=0; k < numSpanSets; ++k ) {
+        for ( int j=0; j < 32; ++j ) bin_u8( spanSets[k][j] );
+    }
+    if ( all ) {
+        blob_table( "regexes" );
+        for ( int i=0; i < numRegexDfas; ++i ) {
+            bin_u32( (unsigned long) dfas[i].numStates );
+            bin_u32( (unsigned long) dfa_first_state( i ) );
+        }
+        int numLexerStates = lexerDfa >= 0 ? dfas[lexerDfa].numStates : 0;
+        blob_table( "lexer" );
+        bin_u32( (unsigned long) numLexerStates );
+        bin_u32( (unsigned long)( lexerDfa >= 0 ? dfa_first_state( lexerDfa ) :
+            numDfaStatesTotal ) );
+        blob_table( "lexerToken" );
+        for ( int st=0; st < numLexerStates; ++st ) {
+            int tag = dfas[lexerDfa].accept[st];
+            bin_u32( tag >= 0 ? (unsigned long) lexerTokens[tag]->nodeType : 0UL );
+        }
+        blob_table( "lexerModes" );
+        for ( int m=0; m < numLexerModes; ++m ) {
+            int st = lexerDfa >= 0 ? dfas[lexerDfa].starts[m] : -1;
+            bin_uint( field_value( st, dfaStateBytes ), dfaStateBytes );
+        }
+        blob_table( "skipDfa" );
+        bin_u32( (unsigned long)( skipDfa >= 0 ? dfas[skipDfa].numStates : 0 ) );
+        bin_u32( (unsigned long)( skipDfa >= 0 ? dfa_first_state( skipDfa ) :
+            numDfaStatesTotal ) );
+        blob_table( "skipModes" );
+        for ( int m=0; m < numLexerModes; ++m ) {
+            int st = skipDfa >= 0 ? dfas[skipDfa].starts[m] : -1;
+            bin_uint( field_value( st, dfaStateBytes ), dfaStateBytes );
+        }
+        blob_table( "skipBlanks" );
+        for ( int m=0; m < numLexerModes; ++m ) bin_u8( skipBlanks[m] );
+        int numSearchStates = searchDfa >= 0 ? dfas[searchDfa].numStates : 0;
+        blob_table( "searchDfa" );
+        bin_u32( (unsigned long) numSearchStates );
+        bin_u32( (unsigned long)( searchDfa >= 0 ?
+            dfa_first_state( searchDfa ) : numDfaStatesTotal ) );
+        blob_table( "searchLen" );
+        for ( int st=0; st < numSearchStates; ++st ) {
+            int len = dfas[searchDfa].accept[st];
+            bin_u8( len >= 0 ? (unsigned) len : 0U );
+        }
+    }
+    blob_table( 0 );
+}
+
+static void write_incbin_tables( void ) {
+    build_table_blob( false );
+    snprintf( incbinFile, 256U, "%s.bin", fileStem );
+    write_bin_file( incbinFile );
+}
+
+// -- ELF object output -------------------------------------------------------
+
+// with --elf, the tables are written to <stem>.o, a relocatable x86-64 ELF
+// object with one .rodata section and a global symbol per table; the tables
+// hold no pointers, so no relocations are needed.
+
+enum {
+    ELF_NULL,
+    ELF_RODATA,
+    ELF_SYMTAB,
+    ELF_STRTAB,
+    ELF_SHSTRTAB,
+    ELF_NOTE_STACK,
+    ELF_SECTIONS
+};
+
+static bool elfObject = false;
+
+static void bin_bytes( const void* p, size_t n ) {
+    for ( size_t i=0; i < n; ++i ) bin_u8( ( (const unsigned char*) p )[i] );
+}
+
+static void elf_section_header( unsigned long name, unsigned long type,
+    unsigned long flags, size_t offset, size_t size, unsigned long link,
+    unsigned long info, unsigned long align, unsigned long entsize ) {
+    bin_u32( name );
+    bin_u32( type );
+    bin_u64( flags );
+    bin_u64( 0UL );                 // address
+    bin_u64( (unsigned long) offset );
+    bin_u64( (unsigned long) size );
+    bin_u32( link );
+    bin_u32( info );
+    bin_u64( align );
+    bin_u64( entsize );
+}
+
+static void write_elf_object( FILE* fp ) {
+    static const char shstrtab[] =
+        "\0.rodata\0.symtab\0.strtab\0.shstrtab\0.note.GNU-stack";
+    static const unsigned long shname[ELF_SECTIONS] = { 0, 1, 9, 17, 25, 35 };
+    size_t off[ELF_SECTIONS], size[ELF_SECTIONS], strtabLen = 1;
+    char* strtab; unsigned char* rodata;
+
+    build_table_blob( true );
+    rodata = (unsigned char*) xmalloc( binLen + 1U );
+    memcpy( rodata, binBuf, binLen );
+    size[ELF_RODATA] = binLen;
+    for ( int i=0; i < numBlobTables; ++i ) {
+        strtabLen += strlen( fileStem ) + strlen( blobTables[i].name ) + 2U;
+    }
+    strtab = (char*) xmalloc( strtabLen );
+    strtab[0] = '\0';
+
+    binLen = 0;
+    bin_u8( 0x7f ); bin_u8( 'E' ); bin_u8( 'L' ); bin_u8( 'F' );
+    bin_u8( 2 );                        // 64 bit
+    bin_u8( 1 );                        // little-endian
+    bin_u8( 1 );                        // version
+    for ( int i=7; i < 16; ++i ) bin_u8( 0 );
+    bin_u16( 1 );                       // ET_REL
+    bin_u16( 62 );                      // EM_X86_64
+    bin_u32( 1 );
+    bin_u64( 0 );                       // entry
+    bin_u64( 0 );                       // program headers
+    bin_u64( 0 );                       // section headers, patched below
+    bin_u32( 0 );                       // flags
+    bin_u16( 64 );
+    bin_u16( 0 );
+    bin_u16( 0 );
+    bin_u16( 64 );
+    bin_u16( ELF_SECTIONS );
+    bin_u16( ELF_SHSTRTAB );
+
+    bin_align();
+    off[ELF_RODATA] = binLen;
+    bin_bytes( rodata, size[ELF_RODATA] );
+    bin_align();
+    off[ELF_SYMTAB] = binLen;
+    for ( int i=0; i < 24; ++i ) bin_u8( 0 );         // null symbol
+    size_t name = 1;
+    for ( int i=0; i < numBlobTables; ++i ) {
+        name += (size_t) sprintf( &strtab[name], "%s_%s", fileStem,
+            blobTables[i].name ) + 1U;
+    }
+    name = 1;
+    for ( int i=0; i < numBlobTables; ++i ) {
+        bin_u32( (unsigned long) name );
+        bin_u8( 0x11 );                 // STB_GLOBAL, STT_OBJECT
+        bin_u8( 0 );                    // default visibility
+        bin_u16( ELF_RODATA );
+        bin_u64( (unsigned long) blobTables[i].offset );
+        bin_u64( (unsigned long) blobTables[i].bytes );
+        name += strlen( &strtab[name] ) + 1U;
+    }
+    size[ELF_SYMTAB] = binLen - off[ELF_SYMTAB];
+    off[ELF_STRTAB] = binLen;
+    bin_bytes( strtab, strtabLen );
+    size[ELF_STRTAB] = strtabLen;
+    off[ELF_SHSTRTAB] = binLen;
+    bin_bytes( shstrtab, sizeof(shstrtab) );
+    size[ELF_SHSTRTAB] = sizeof(shstrtab);
+    off[ELF_NOTE_STACK] = binLen;
+    size[ELF_NOTE_STACK] = 0;
+    bin_align();
+
+    bin_u32_at( 40U, (unsigned long) binLen );      // e_shoff, below 4 GiB
+    for ( int i=0; i < 64; ++i ) bin_u8( 0 );         // null section
+    elf_section_header( shname[ELF_RODATA], 1, 2, off[ELF_RODATA],
+        size[ELF_RODATA], 0, 0, 8, 0 );             // PROGBITS, ALLOC
+    elf_section_header( shname[ELF_SYMTAB], 2, 0, off[ELF_SYMTAB],
+        size[ELF_SYMTAB], ELF_STRTAB, 1, 8, 24 );   // first global: 1
+    elf_section_header( shname[ELF_STRTAB], 3, 0, off[ELF_STRTAB],
+        size[ELF_STRTAB], 0, 0, 1, 0 );
+    elf_section_header( shname[ELF_SHSTRTAB], 3, 0, off[ELF_SHSTRTAB],
+        size[ELF_SHSTRTAB], 0, 0, 1, 0 );
+    elf_section_header( shname[ELF_NOTE_STACK], 1, 0, off[ELF_NOTE_STACK],
+        0, 0, 0, 1, 0 );
+    if ( fwrite( binBuf, 1U, binLen, fp ) != binLen ) {
+        report( "failed to write object file '%s'", impfile );
+    }
+    free( rodata );
+    free( strtab );
+}
+
+// -- default output: C -------------------------------------------------------
+
+static void output_branches( void ) {
+    for ( int i=0; i < branches_ix; ++i ) {
+        if ( branchOwner[i] >= 0 ) {
+            fprintf( impfp, "%s    // %d: %s branches\n    ", i ? "\n" : "",
+                i, nodeTable[ branchOwner[i] ]->exportIdent );
+        }
+        if ( layout != LAYOUT_AOS ) {
+            fprintf( impfp, "0x%lx, ", field_value( branchTable[i],
+                nodeIdBytes ) );
+        } else if ( branchTable[i] >= 0 ) {
+            fprintf( impfp, "%d, ", branchTable[i] );
+        } else {
+            fprintf( impfp, "%d /* %s */, ", branchTable[i],
+                token2text( branchSource[i]->token ) );
+        }
+    }
+    if ( branches_ix ) fprintf( impfp, "\n" );
+}
+
+static bool output_impls_helper( treenode_t* node, int id ) {
+    if ( node == 0 ) return false;
+    if ( node->id == id ) {
+        const char* termType; const char* nodeClass;
+        node_kind( node, &nodeClass, &termType );
+        fprintf( impfp,
+            "    // %d: %s\n"
+            "    { %s, %s, %s, %d, %d, %d, %d, %d },\n"
+            , node->id, node->exportIdent
+            , nodeClass, node->nodeTypeEnum, termType, node->textOff
+            , node->textLen, (int) node->numBranches, node->branchesIx
+            , node->aux
+        );
+        return true;
+    }
+    for ( size_t i=0; i < node->numBranches; ++i ) {
+        if ( output_impls_helper( node->branches[i], id ) ) return true;
+    }
+    return false;
+}
+
+static void output_impls( void ) {
+    for ( int i=0; i < id; ++i ) {
+        output_impls_helper( tree, i );
+    }
+}
+
+// ISO C has no empty arrays, so a table without entries gets a single zero
+// entry instead
+
+static int c_table_len( int n ) {
+    return n > 0 ? n : 1;
+}
+
+static void output_zero_entry( int n, const char* entry ) {
+    if ( n == 0 ) fprintf( impfp, "    %s // none\n", entry );
+}
+
+static void output_literals( void ) {
+    fprintf( impfp, "const literalinfo_t %s_literals[%d] = {\n", fileStem,
+        c_table_len( numLiteralWords ) );
+    output_zero_entry( numLiteralWords, "{ 0, 0 }," );
+    for ( int i=0; i < numLiteralWords; ++i ) {
+        fprintf( impfp, "    { 0x%016llxULL, 0x%016llxULL }, // %d: %s\n",
+            literalWords[i].prefix, literalWords[i].mask,
+            literalWords[i].node->id, literalWords[i].node->exportIdent );
+    }
+    fprintf( impfp, "};\n\n" );
 }
 
-typedef struct _havelabel_t {
-    struct _havelabel_t* next;
-    char*                text;
-} havelabel_t;
+static void output_tries( void ) {
+    fprintf( impfp, "const triestate_t %s_trieStates[%d] = {\n", fileStem,
+        c_table_len( numTrieStates ) );
+    output_zero_entry( numTrieStates, "{ 0, 0, 0 }," );
+    for ( int st=0; st < numTrieStates; ++st ) {
+        fprintf( impfp, "    { %d, %d, %d },\n", trieStates[st].accept,
+            trieStates[st].numEdges, trieStates[st].edges );
+    }
+    fprintf( impfp, "};\n\n"
+        "const trieedge_t %s_trieEdges[%d] = {\n", fileStem,
+        c_table_len( numTrieEdges ) );
+    output_zero_entry( numTrieEdges, "{ 0, 0 }," );
+    for ( int st=0; st < numTrieStates; ++st ) {
+        if ( trieStates[st].numEdges == 0 ) continue;
+        fprintf( impfp, "    // state %d\n    ", st );
+        for ( int c=0; c < 256; ++c ) {
+            if ( trieStates[st].child[c] == 0 ) continue;
+            fprintf( impfp, "{ 0x%02x, %d }, ", c, trieStates[st].child[c] );
+        }
+        fprintf( impfp, "\n" );
+    }
+    fprintf( impfp, "};\n\n" );
+}
 
-static havelabel_t* havelabel_first = 0;
-static havelabel_t* havelabel_last  = 0;
+static void output_regexes( void ) {
+    fprintf( impfp, "const regexinfo_t %s_regexes[%d] = {\n", fileStem,
+        c_table_len( numRegexDfas ) );
+    output_zero_entry( numRegexDfas, "{ 0, 0 }," );
+    for ( int i=0; i < numRegexDfas; ++i ) {
+        fprintf( impfp, "    { %d, %d },\n", dfas[i].numStates,
+            dfa_first_state( i ) );
+    }
+    fprintf( impfp, "};\n\n" );
+}
 
-static bool check_have_label( const char* text ) {
-    havelabel_t* lab = havelabel_first;
-    while ( lab ) {
-        if ( strcmp( lab->text, text ) == 0 ) return true;
-        lab = lab->next;
+static void output_dfas( void ) {
+    fprintf( impfp, "const unsigned char %s_byteClass[256] = {", fileStem );
+    for ( int c=0; c < 256; ++c ) {
+        fprintf( impfp, "%s%d,", ( c & 15 ) ? " " : "\n    ", byteClass[c] );
     }
-    lab = (havelabel_t*) xmalloc( sizeof(havelabel_t) );
-    lab->next = 0;
-    lab->text = xstrdup( text );
-    if ( havelabel_first == 0 ) {
-        havelabel_first = havelabel_last = lab;
-    } else {
-        havelabel_last->next = lab;
-        havelabel_last       = lab;
+    fprintf( impfp, "\n};\n\n" );
+    output_regexes();
+    fprintf( impfp,
+        "const dfastate_t %s_dfaTrans[%d][DFA_CLASSES] = {\n", fileStem,
+        c_table_len( numDfaStatesTotal ) );
+    output_zero_entry( numDfaStatesTotal, "{ 0 }," );
+    for ( int i=0; i < numDfas; ++i ) {
+        for ( int st=0; st < dfas[i].numStates; ++st ) {
+            fprintf( impfp, "    // %s, state %d\n    {", dfa_name( i ), st );
+            for ( int k=0; k < numByteClasses; ++k ) {
+                fprintf( impfp, "%s0x%0*x,", ( k & 15 ) ? " " : "\n        ",
+                    dfaStateBytes * 2, dfa_target( &dfas[i], st, k ) );
+            }
+            fprintf( impfp, "\n    },\n" );
+        }
     }
-    return false;
+    fprintf( impfp, "};\n\n"
+        "const unsigned char %s_dfaAccept[%d] = {\n", fileStem,
+        c_table_len( numDfaStatesTotal ) );
+    output_zero_entry( numDfaStatesTotal, "0," );
+    for ( int i=0; i < numDfas; ++i ) {
+        fprintf( impfp, "    // %s\n    ", dfa_name( i ) );
+        for ( int st=0; st < dfas[i].numStates; ++st ) {
+            fprintf( impfp, "%d, ", dfas[i].accept[st] >= 0 ? 1 : 0 );
+        }
+        fprintf( impfp, "\n" );
+    }
+    fprintf( impfp, "};\n\n" );
 }
 
-static int id = 0;
+static void output_regex_hints( void ) {
+    fprintf( impfp, "const regexhint_t %s_regexHints[%d] = {\n", fileStem,
+        c_table_len( numRegexDfas ) );
+    output_zero_entry( numRegexDfas, "{ 0, 0, 0, 0, 0, 0, 0 }," );
+    for ( int i=0; i < numRegexDfas; ++i ) {
+        const regexhint_t* h = &regexHints[i];
+        fprintf( impfp, "    { 0x%016llxULL, 0x%016llxULL, %d, %d, 0x%02x, %d,"
+            " 0x%02x }, // regex %d\n", h->prefix, h->mask, h->required,
+            h->prefixLen, h->firstSet, h->matcher, h->shiftAnd, i );
+    }
+    fprintf( impfp, "};\n\n" );
+}
 
-static void output_enums_helper( treenode_t* node, bool doasm ) {
-    if ( node == 0 ) return;
-    if ( is_export_node( node ) && node->id == -1 ) {
-        char tmp[512]; bool print = true;
-        if ( node->token == T_PRODUCTION ) {
-            name_to_C_enum( tmp, node->text );
-        } else if ( node->token == T_STR_LITERAL || node->token == T_REG_EX ) {
-            const char* text = 0;
-            if ( is_name( node->text ) ) {
-                text = name_to_label( node->text );
-                snprintf( tmp, 512U, "NT_TERMINAL_%s", text );
-                if ( check_have_label( tmp ) ) print = false;
-            } else if ( ( text = operator_to_label( node->text ) ) ) {
-                snprintf( tmp, 512U, "NT_TERMINAL_%s", text );
-                if ( check_have_label( tmp ) ) print = false;
-            } else {
-                snprintf( tmp, 512U, "NT_TERMINAL_%d", id );
-            }
-        } else {
-            snprintf( tmp, 512U, "%s", "_NT_GENERIC" );
-            print = false;
+static void output_shift_ands( void ) {
+    fprintf( impfp, "const shiftand_t %s_shiftAnd[%d] = {\n", fileStem,
+        c_table_len( numShiftAnds ) );
+    output_zero_entry( numShiftAnds, "{ { 0 }, 0, 0, 0, 0, 0 }," );
+    for ( int k=0; k < numShiftAnds; ++k ) {
+        const shiftand_t* sa = &shiftAnds[k];
+        fprintf( impfp, "    // %d\n    {\n        {", k );
+        for ( int c=0; c < 256; ++c ) {
+            fprintf( impfp, "%s0x%llxULL,", ( c & 3 ) ? " " : "\n            ",
+                sa->masks[c] );
         }
-        set_node_type_enum( node, tmp );
-        if ( print ) {
-            if ( doasm ) {
-                static int cnt = 1;
-                // 00000000001111111111222222222233333333334444444444
-                // 01234567890123456789012345678901234567890123456789
-                // _NT_GENERIC             equ         0
-                fprintf( hdrfp, "%-23s equ         %d\n", tmp, cnt++ );
-            } else {
-                fprintf( hdrfp, "    %s,\n", tmp );
-            }
+        fprintf( impfp, "\n        },\n        0x%llxULL, 0x%llxULL, 0x%llxULL,"
+            " 0x%llxULL, 0x%llxULL\n    },\n", sa->repeat, sa->optional,
+            sa->blockStart, sa->blockEnd, sa->last );
+    }
+    fprintf( impfp, "};\n\n" );
+}
 
+static void output_spans( void ) {
+    int row = 0;
+    fprintf( impfp, "const unsigned char %s_dfaSpan[%d] = {\n", fileStem,
+        c_table_len( numDfaStatesTotal ) );
+    output_zero_entry( numDfaStatesTotal, "0," );
+    for ( int i=0; i < numDfas; ++i ) {
+        fprintf( impfp, "    // %s\n    ", dfa_name( i ) );
+        for ( int st=0; st < dfas[i].numStates; ++st ) {
+            fprintf( impfp, "0x%02x, ", dfaSpan[ row++ ] );
         }
-        node->id = id++;
+        fprintf( impfp, "\n" );
     }
-    for ( size_t i=0; i < node->numBranches; ++i ) {
-        output_enums_helper( node->branches[i], doasm );
+    fprintf( impfp, "};\n\n"
+        "const unsigned char %s_spanSets[%d][32] = {\n", fileStem,
+        c_table_len( numSpanSets ) );
+    output_zero_entry( numSpanSets, "{ 0 }," );
+    for ( int k=0; k < numSpanSets; ++k ) {
+        fprintf( impfp, "    // %d\n    {", k );
+        for ( int j=0; j < 32; ++j ) {
+            fprintf( impfp, "%s0x%02x,", ( j & 15 ) ? " " : "\n        ",
+                spanSets[k][j] );
+        }
+        fprintf( impfp, "\n    },\n" );
     }
+    fprintf( impfp, "};\n\n" );
 }
 
-static void name_to_C_name( char buf[256], const char* name, const char* prefix ) {
-    snprintf( buf, 256U, "%s%s", prefix, name );
-    size_t len = strlen( buf );
-    for ( size_t i=0U; i < len; ++i ) {
-        if ( buf[i] == '-' ) buf[i] = '_';
+static void output_span_scan( void ) {
+    // pshufb yields 0 for indexes with bit 7 set, so one shuffle looks up
+    // bytes below 0x80 in the low half of the table, the other the rest
+    fprintf( impfp,
+        "// span scan, see %s_dfaSpan\n\n"
+        "#if defined(__GNUC__) && defined(__AVX2__)\n"
+        "#include <immintrin.h>\n"
+        "#elif defined(__GNUC__) && defined(__SSSE3__)\n"
+        "#include <tmmintrin.h>\n"
+        "#endif\n\n"
+        "size_t %s_span( const unsigned char set[32], const unsigned char* p,\n"
+        "    size_t n ) {\n"
+        "    size_t i = 0;\n"
+        "#if defined(__GNUC__) && defined(__AVX2__)\n"
+        "    const __m256i lo   = _mm256_broadcastsi128_si256(\n"
+        "        _mm_loadu_si128( (const __m128i*) set ) );\n"
+        "    const __m256i hi   = _mm256_broadcastsi128_si256(\n"
+        "        _mm_loadu_si128( (const __m128i*) ( set + 16 ) ) );\n"
+        "    const __m256i bits = _mm256_setr_epi8(\n"
+        "        1, 2, 4, 8, 16, 32, 64, -128, 1, 2, 4, 8, 16, 32, 64, -128,\n"
+        "        1, 2, 4, 8, 16, 32, 64, -128, 1, 2, 4, 8, 16, 32, 64, -128 );\n"
+        "    const __m256i m8f  = _mm256_set1_epi8( (char) 0x8f );\n"
+        "    const __m256i m80  = _mm256_set1_epi8( (char) 0x80 );\n"
+        "    const __m256i m0f  = _mm256_set1_epi8( 0x0f );\n"
+        "    for ( ; i + 32U <= n; i += 32U ) {\n"
+        "        __m256i v   = _mm256_loadu_si256( (const __m256i*) ( p + i ) );\n"
+        "        __m256i ix  = _mm256_and_si256( v, m8f );\n"
+        "        __m256i row = _mm256_or_si256( _mm256_shuffle_epi8( lo, ix ),\n"
+        "            _mm256_shuffle_epi8( hi, _mm256_xor_si256( ix, m80 ) ) );\n"
+        "        __m256i bit = _mm256_shuffle_epi8( bits,\n"
+        "            _mm256_and_si256( _mm256_srli_epi16( v, 4 ), m0f ) );\n"
+        "        unsigned out = ~(unsigned) _mm256_movemask_epi8(\n"
+        "            _mm256_cmpeq_epi8( _mm256_and_si256( row, bit ), bit ) );\n"
+        "        if ( out != 0U ) return i + (size_t) __builtin_ctz( out );\n"
+        "    }\n"
+        "#elif defined(__GNUC__) && defined(__SSSE3__)\n"
+        "    const __m128i lo   = _mm_loadu_si128( (const __m128i*) set );\n"
+        "    const __m128i hi   = _mm_loadu_si128( (const __m128i*) ( set + 16 ) );\n"
+        "    const __m128i bits = _mm_setr_epi8(\n"
+        "        1, 2, 4, 8, 16, 32, 64, -128, 1, 2, 4, 8, 16, 32, 64, -128 );\n"
+        "    const __m128i m8f  = _mm_set1_epi8( (char) 0x8f );\n"
+        "    const __m128i m80  = _mm_set1_epi8( (char) 0x80 );\n"
+        "    const __m128i m0f  = _mm_set1_epi8( 0x0f );\n"
+        "    for ( ; i + 16U <= n; i += 16U ) {\n"
+        "        __m128i v   = _mm_loadu_si128( (const __m128i*) ( p + i ) );\n"
+        "        __m128i ix  = _mm_and_si128( v, m8f );\n"
+        "        __m128i row = _mm_or_si128( _mm_shuffle_epi8( lo, ix ),\n"
+        "            _mm_shuffle_epi8( hi, _mm_xor_si128( ix, m80 ) ) );\n"
+        "        __m128i bit = _mm_shuffle_epi8( bits,\n"
+        "            _mm_and_si128( _mm_srli_epi16( v, 4 ), m0f ) );\n"
+        "        unsigned out = ~(unsigned) _mm_movemask_epi8(\n"
+        "            _mm_cmpeq_epi8( _mm_and_si128( row, bit ), bit ) ) & 0xffffU;\n"
+        "        if ( out != 0U ) return i + (size_t) __builtin_ctz( out );\n"
+        "    }\n"
+        "#endif\n"
+        "    for ( ; i < n; ++i ) {\n"
+        "        unsigned c = p[i];\n"
+        "        if ( !( set[ ( c >> 7 ) * 16U + ( c & 15U ) ] &\n"
+        "            ( 1U << ( ( c >> 4 ) & 7U ) ) ) ) break;\n"
+        "    }\n"
+        "    return i;\n"
+        "}\n\n"
+        , fileStem, fileStem
+    );
+}
+
+static void output_shift_and_scan( void ) {
+    fprintf( impfp,
+        "long %s_shift_and( const shiftand_t* sa, const unsigned char* p,\n"
+        "    size_t n ) {\n"
+        "    uint64_t e = 1U, d, f;\n"
+        "    long len = -1;\n"
+        "    for ( size_t i=0; i < n; ++i ) {\n"
+        "        f = e | sa->blockEnd;\n"
+        "        e |= sa->optional & ( ~( f - sa->blockStart ) ^ f );\n"
+        "        d = e & sa->masks[ p[i] ];\n"
+        "        if ( d == 0U ) break;\n"
+        "        if ( d & sa->last ) len = (long)( i + 1U );\n"
+        "        e = ( d << 1 ) | ( d & sa->repeat );\n"
+        "    }\n"
+        "    return len;\n"
+        "}\n\n"
+        , fileStem
+    );
+}
+
+static void output_regex_nfas( void ) {
+    fprintf( impfp, "const regexnfa_t %s_regexNfas[%d] = {\n", fileStem,
+        c_table_len( numRegexDfas ) );
+    output_zero_entry( numRegexDfas, "{ 0, 0, 0 }," );
+    for ( int i=0; i < numRegexDfas; ++i ) {
+        const regexnfa_t* rn = &regexNfas[i];
+        fprintf( impfp, "    { %d, %d, %d }, // regex %d\n", rn->numStates,
+            rn->states, rn->start, i );
     }
+    fprintf( impfp, "};\n\n"
+        "const nfastate_t %s_nfaStates[%d] = {\n", fileStem,
+        c_table_len( numLazyStates ) );
+    output_zero_entry( numLazyStates, "{ 0, 0, 0, 0, 0 }," );
+    for ( int i=0; i < numLazyStates; ++i ) {
+        const lazystate_t* ls = &lazyStates[i];
+        fprintf( impfp, "    { %d, %d, 0x%02x, %d, 0 },\n", ls->out, ls->out1,
+            ls->set, ls->accept ? 1 : 0 );
+    }
+    fprintf( impfp, "};\n\n" );
 }
 
-static void text_to_C_text( char buf[512], const char* text, size_t len ) {
-    const char* s = text; const char* s2 = text + len;
-    char* d = &buf[0]; char* e = &buf[510];
-    while ( s < s2 ) {
-        if ( *s == '\"' ) {
-            if ( d+2 <= e ) {
-                *d++ = '\\';
-                *d++ = '\"';
-            }
-        } else if ( *s == '\\' ) {
-            if ( d+2 <= e ) {
-                *d++ = '\\';
-                *d++ = '\\';
-            }
-        } else if ( (*s&0x60)!=0 && d+1 <= e ) {
-            *d++ = *s;
-        } else if ( (*s&0x60)==0 && d+4 <= e ) {
-            *d++ = '\\';
-            *d++ = 'x';
-            *d++ = "0123456789abcdef"[(*s>>4)&15];
-            *d++ = "0123456789abcdef"[ *s    &15];
-        }
-        ++s;
+static void output_repeats( void ) {
+    fprintf( impfp, "const repeatinfo_t %s_repeats[%d] = {\n", fileStem,
+        c_table_len( numRepeatCounts ) );
+    output_zero_entry( numRepeatCounts, "{ 0, 0 }," );
+    for ( int i=0; i < numRepeatCounts; ++i ) {
+        fprintf( impfp, "    { %d, %d },\n", repeatCounts[i].min,
+            repeatCounts[i].max );
     }
-    *d = '\0';
+    fprintf( impfp, "};\n\n" );
 }
 
-static bool text_to_asm_text( char buf[512], const char* text, char qc ) {
-    const char* s = text; char* d = &buf[0]; char* e = &buf[510];
-    while ( *s != '\0' ) {
-        if ( *s == qc ) {
-            return false;
-        } else if ( d+1 <= e ) {
-            *d++ = *s;
-        }
-        ++s;
+static void output_lazy_dfa_decls( void ) {
+    fprintf( hdrfp,
+        "\n// %s_lazy_match() matches a MK_LAZY_DFA regex (after\n"
+        "// %s_lazy_init()) like its DFA would, building the DFA states it\n"
+        "// needs from the NFA into a cache of LAZY_CACHE_STATES (at most\n"
+        "// 32767); a full cache is flushed, and when it fills up again within\n"
+        "// LAZY_MIN_BYTES bytes, the rest of the input is matched by NFA\n"
+        "// simulation.  The counters accumulate until the next init.\n\n"
+        "#ifndef LAZY_CACHE_STATES\n"
+        "#define LAZY_CACHE_STATES   64\n"
+        "#endif\n"
+        "#ifndef LAZY_MIN_BYTES\n"
+        "#define LAZY_MIN_BYTES      ( 10 * LAZY_CACHE_STATES )\n"
+        "#endif\n"
+        "#define LAZY_NFA_STATES     %d\n"
+        "#define LAZY_WORDS          %d\n"
+        "#define LAZY_UNKNOWN        (-1)\n"
+        "#define LAZY_DEAD           (-2)\n\n"
+        "typedef struct _lazydfa_t {\n"
+        "    const nfastate_t*      states;\n"
+        "    const unsigned char  (*byteSets)[32];\n"
+        "    int32_t                numStates;\n"
+        "    int32_t                start;\n"
+        "    int32_t                startState;     // cached, or -1\n"
+        "    int32_t                numCached;\n"
+        "    uint64_t               built;          // DFA states built\n"
+        "    uint64_t               hits;           // cached transitions taken\n"
+        "    uint64_t               flushes;        // cache flushes\n"
+        "    uint64_t               nfaBytes;       // bytes simulated on the NFA\n"
+        "    int16_t                next[LAZY_CACHE_STATES][256];\n"
+        "    uint32_t               cache[LAZY_CACHE_STATES][LAZY_WORDS];\n"
+        "    uint32_t               hash[LAZY_CACHE_STATES];\n"
+        "    uint8_t                accept[LAZY_CACHE_STATES];\n"
+        "    uint32_t               work[2][LAZY_WORDS];\n"
+        "    int32_t                stack[LAZY_NFA_STATES];\n"
+        "} lazydfa_t;\n\n"
+        "void %s_lazy_init( lazydfa_t* lz, int regex );\n"
+        "long %s_lazy_match( lazydfa_t* lz, const unsigned char* p, size_t n );\n"
+        , fileStem, fileStem, maxLazyStates, ( maxLazyStates + 31 ) / 32
+        , fileStem, fileStem
+    );
+}
+
+static void output_lazy_dfa( void ) {
+    if ( numLazyDfas == 0 ) {
+        // stubs, as the tables they would index are empty
+        fprintf( impfp,
+            "// lazy DFA: no regex needs one (see --lazy-dfa)\n\n"
+            "void %s_lazy_init( lazydfa_t* lz, int regex ) {\n"
+            "    (void) lz; (void) regex;\n"
+            "}\n\n"
+            "long %s_lazy_match( lazydfa_t* lz, const unsigned char* p, size_t n ) {\n"
+            "    (void) lz; (void) p; (void) n;\n"
+            "    return -1;\n"
+            "}\n\n"
+            , fileStem, fileStem
+        );
+        return;
     }
-    *d = '\0';
-    return true;
+    fprintf( impfp, "%s",
+        "// lazy DFA, see <stem>_regexNfas\n\n"
+        "#include <string.h>\n\n"
+        "static void lazy_close( lazydfa_t* lz, uint32_t* set ) {\n"
+        "    int sp = 0;\n"
+        "    for ( int k=0; k < lz->numStates; ++k ) {\n"
+        "        if ( set[ k >> 5 ] & ( 1U << ( k & 31 ) ) ) lz->stack[ sp++ ] = k;\n"
+        "    }\n"
+        "    while ( sp > 0 ) {\n"
+        "        const nfastate_t* st = &lz->states[ lz->stack[ --sp ] ];\n"
+        "        int32_t outs[2] = { st->out, st->out1 };\n"
+        "        if ( st->set != SPAN_NONE ) continue;\n"
+        "        for ( int k=0; k < 2; ++k ) {\n"
+        "            int32_t o = outs[k];\n"
+        "            if ( o < 0 || ( set[ o >> 5 ] & ( 1U << ( o & 31 ) ) ) ) continue;\n"
+        "            set[ o >> 5 ] |= 1U << ( o & 31 );\n"
+        "            lz->stack[ sp++ ] = o;\n"
+        "        }\n"
+        "    }\n"
+        "}\n\n"
+        "static int lazy_step( lazydfa_t* lz, const uint32_t* cur, unsigned c,\n"
+        "    uint32_t* next ) {\n"
+        "    // the closed set of states after byte c; 0 if it is empty\n"
+        "    int any = 0;\n"
+        "    memset( next, 0, sizeof(uint32_t) * LAZY_WORDS );\n"
+        "    for ( int k=0; k < lz->numStates; ++k ) {\n"
+        "        const nfastate_t* st = &lz->states[k];\n"
+        "        if ( !( cur[ k >> 5 ] & ( 1U << ( k & 31 ) ) ) ||\n"
+        "            st->set == SPAN_NONE ) continue;\n"
+        "        if ( !( lz->byteSets[ st->set ][ ( c >> 7 ) * 16U + ( c & 15U ) ] &\n"
+        "            ( 1U << ( ( c >> 4 ) & 7U ) ) ) ) continue;\n"
+        "        next[ st->out >> 5 ] |= 1U << ( st->out & 31 );\n"
+        "        any = 1;\n"
+        "    }\n"
+        "    if ( any ) lazy_close( lz, next );\n"
+        "    return any;\n"
+        "}\n\n"
+        "static int lazy_accepts( const lazydfa_t* lz, const uint32_t* set ) {\n"
+        "    for ( int k=0; k < lz->numStates; ++k ) {\n"
+        "        if ( ( set[ k >> 5 ] & ( 1U << ( k & 31 ) ) ) &&\n"
+        "            lz->states[k].accept ) return 1;\n"
+        "    }\n"
+        "    return 0;\n"
+        "}\n\n"
+        "static int lazy_state( lazydfa_t* lz, const uint32_t* set ) {\n"
+        "    // the cached DFA state of set, or -1 if the cache is full\n"
+        "    uint32_t h = 2166136261U;\n"
+        "    int t;\n"
+        "    for ( int w=0; w < LAZY_WORDS; ++w ) h = ( h ^ set[w] ) * 16777619U;\n"
+        "    for ( t=0; t < lz->numCached; ++t ) {\n"
+        "        if ( lz->hash[t] == h &&\n"
+        "            memcmp( lz->cache[t], set, sizeof(lz->cache[t]) ) == 0 ) return t;\n"
+        "    }\n"
+        "    if ( t == LAZY_CACHE_STATES ) return -1;\n"
+        "    memcpy( lz->cache[t], set, sizeof(lz->cache[t]) );\n"
+        "    memset( lz->next[t], 0xff, sizeof(lz->next[t]) );    // LAZY_UNKNOWN\n"
+        "    lz->hash[t]   = h;\n"
+        "    lz->accept[t] = (uint8_t) lazy_accepts( lz, set );\n"
+        "    lz->numCached = t + 1;\n"
+        "    ++lz->built;\n"
+        "    return t;\n"
+        "}\n\n"
+        "static void lazy_flush( lazydfa_t* lz ) {\n"
+        "    lz->numCached  = 0;\n"
+        "    lz->startState = -1;\n"
+        "    ++lz->flushes;\n"
+        "}\n\n"
+        "static long lazy_simulate( lazydfa_t* lz, const unsigned char* p,\n"
+        "    size_t i, size_t n, long len ) {\n"
+        "    // goes on from the states in work[1], after p[i-1]\n"
+        "    uint32_t* cur = lz->work[1];\n"
+        "    uint32_t* nxt = lz->work[0];\n"
+        "    if ( lazy_accepts( lz, cur ) ) len = (long) i;\n"
+        "    for ( ; i < n; ++i ) {\n"
+        "        uint32_t* tmp;\n"
+        "        ++lz->nfaBytes;\n"
+        "        if ( !lazy_step( lz, cur, p[i], nxt ) ) break;\n"
+        "        tmp = cur; cur = nxt; nxt = tmp;\n"
+        "        if ( lazy_accepts( lz, cur ) ) len = (long)( i + 1U );\n"
+        "    }\n"
+        "    return len;\n"
+        "}\n\n"
+    );
+    fprintf( impfp,
+        "void %s_lazy_init( lazydfa_t* lz, int regex ) {\n"
+        "    const regexnfa_t* nfa = &%s_regexNfas[regex];\n"
+        "    lz->states     = %s_nfaStates + nfa->states;\n"
+        "    lz->byteSets   = %s_spanSets;\n"
+        "    lz->numStates  = nfa->numStates;\n"
+        "    lz->start      = nfa->start;\n"
+        "    lz->startState = -1;\n"
+        "    lz->numCached  = 0;\n"
+        "    lz->built = lz->hits = lz->flushes = lz->nfaBytes = 0U;\n"
+        "}\n\n"
+        "long %s_lazy_match( lazydfa_t* lz, const unsigned char* p, size_t n ) {\n"
+        "    long len = -1;\n"
+        "    size_t flushedAt = 0;\n"
+        "    int flushed = 0, st = lz->startState;\n"
+        "    if ( st < 0 ) {\n"
+        "        uint32_t* set = lz->work[0];\n"
+        "        memset( set, 0, sizeof(lz->work[0]) );\n"
+        "        set[ lz->start >> 5 ] |= 1U << ( lz->start & 31 );\n"
+        "        lazy_close( lz, set );\n"
+        "        st = lazy_state( lz, set );\n"
+        "        if ( st < 0 ) {\n"
+        "            lazy_flush( lz );\n"
+        "            st = lazy_state( lz, set );\n"
+        "        }\n"
+        "        lz->startState = st;\n"
+        "    }\n"
+        "    if ( lz->accept[st] ) len = 0;\n"
+        "    for ( size_t i=0; i < n; ++i ) {\n"
+        "        unsigned c = p[i];\n"
+        "        int t = lz->next[st][c];\n"
+        "        if ( t >= 0 ) {\n"
+        "            ++lz->hits;\n"
+        "        } else if ( t == LAZY_DEAD ) {\n"
+        "            break;\n"
+        "        } else if ( !lazy_step( lz, lz->cache[st], c, lz->work[1] ) ) {\n"
+        "            lz->next[st][c] = LAZY_DEAD;\n"
+        "            break;\n"
+        "        } else if ( ( t = lazy_state( lz, lz->work[1] ) ) >= 0 ) {\n"
+        "            lz->next[st][c] = (int16_t) t;\n"
+        "        } else {\n"
+        "            // the cache is full: flush it, unless that happens too often\n"
+        "            if ( flushed && i - flushedAt < (size_t) LAZY_MIN_BYTES ) {\n"
+        "                return lazy_simulate( lz, p, i + 1U, n, len );\n"
+        "            }\n"
+        "            lazy_flush( lz );\n"
+        "            flushed = 1; flushedAt = i;\n"
+        "            t = lazy_state( lz, lz->work[1] );\n"
+        "        }\n"
+        "        st = t;\n"
+        "        if ( lz->accept[st] ) len = (long)( i + 1U );\n"
+        "    }\n"
+        "    return len;\n"
+        "}\n\n"
+        , fileStem, fileStem, fileStem, fileStem, fileStem
+    );
 }
 
-static int branches_ix = 0;
+static void lexer_mode_enum( char buf[256], const char* name ) {
+    name_to_C_enum( buf, name );
+    buf[0] = 'L'; buf[1] = 'M';
+}
 
-static void output_decls_helper( treenode_t* node ) {
-    if ( node == 0 ) return;
-    if ( node->id >= 0 && node->exportIdent == 0 ) {
-        const char* prefix = ""; bool numId = node->token != T_PRODUCTION;
-        switch ( node->token ) {
-            case T_PRODUCTION:      prefix = "production_"; break;
-            case T_STR_LITERAL:     prefix = "string_terminal_"; break;
-            case T_REG_EX:          prefix = "regex_terminal_"; break;
-            case T_AND_EXPR:        prefix = "mandatory_expr_"; break;
-            case T_OR_EXPR:         prefix = "alternative_expr_"; break;
-            case T_BRACK_EXPR:      prefix = "optional_expr_"; break;
-            case T_BRACE_EXPR:      prefix = "optional_repetitive_expr_"; break;
-            default: break;
-        }
-        char nameText[256];
-        if ( numId ) {
-            snprintf( nameText, 256U, "%s%d", prefix, node->id );
-        } else {
-            name_to_C_name( nameText, node->text, prefix );
-        }
-        set_export_ident( node, nameText );
-        if ( node->numBranches != 0U ) {
-            node->branchesIx = branches_ix;
-            branches_ix += node->numBranches;
-        }
+static unsigned skip_mode_start( int m ) {
+    int st = skipDfa >= 0 ? dfas[skipDfa].starts[m] : -1;
+    if ( st < 0 ) return dfaStateBytes == 1 ? 0xffU : 0xffffU;
+    return (unsigned) st;
+}
+
+static unsigned lexer_mode_start( int m ) {
+    int st = lexerDfa >= 0 ? dfas[lexerDfa].starts[m] : -1;
+    if ( st < 0 ) return dfaStateBytes == 1 ? 0xffU : 0xffffU;
+    return (unsigned) st;
+}
+
+static const char* lexer_token_enum( int st ) {
+    int tag = dfas[lexerDfa].accept[st];
+    return tag >= 0 ? lexerTokens[tag]->nodeTypeEnum : "_NT_GENERIC";
+}
+
+static void output_lexer( void ) {
+    int numStates = lexerDfa >= 0 ? dfas[lexerDfa].numStates : 0;
+    fprintf( impfp,
+        "const regexinfo_t %s_lexer = { %d, %d };\n\n"
+        "const nodetype_t %s_lexerToken[%d] = {\n"
+        , fileStem, numStates, lexerDfa >= 0 ? dfa_first_state( lexerDfa ) :
+          numDfaStatesTotal, fileStem, c_table_len( numStates )
+    );
+    output_zero_entry( numStates, "_NT_GENERIC," );
+    for ( int st=0; st < numStates; ++st ) {
+        fprintf( impfp, "    %s,\n", lexer_token_enum( st ) );
     }
-    for ( size_t i=0; i < node->numBranches; ++i ) {
-        output_decls_helper( node->branches[i] );
+    fprintf( impfp, "};\n\n"
+        "const dfastate_t %s_lexerModes[%d] = {\n", fileStem, numLexerModes );
+    for ( int m=0; m < numLexerModes; ++m ) {
+        char tmp[256];
+        lexer_mode_enum( tmp, lexerModes[m] );
+        fprintf( impfp, "    0x%0*x, // %s\n", dfaStateBytes * 2,
+            lexer_mode_start( m ), tmp );
     }
+    fprintf( impfp, "};\n\n" );
 }
 
-static int find_prod_id( treenode_t* node, const char* name ) {
-    if ( node == 0 ) return -1;
-    if ( node->token == T_PRODUCTION && strcmp( node->text, name ) == 0 ) return node->id;
-    for ( size_t i=0; i < node->numBranches; ++i ) {
-        int id = find_prod_id( node->branches[i], name );
-        if ( id >= 0 ) return id;
+static void output_skip( void ) {
+    int numStates = skipDfa >= 0 ? dfas[skipDfa].numStates : 0;
+    fprintf( impfp,
+        "const regexinfo_t %s_skipDfa = { %d, %d };\n\n"
+        "const dfastate_t %s_skipModes[%d] = {\n"
+        , fileStem, numStates, skipDfa >= 0 ? dfa_first_state( skipDfa ) :
+          numDfaStatesTotal, fileStem, numLexerModes
+    );
+    for ( int m=0; m < numLexerModes; ++m ) {
+        char tmp[256];
+        lexer_mode_enum( tmp, lexerModes[m] );
+        fprintf( impfp, "    0x%0*x, // %s\n", dfaStateBytes * 2,
+            skip_mode_start( m ), tmp );
     }
-    return -1;
+    fprintf( impfp, "};\n\n"
+        "const unsigned char %s_skipBlanks[%d] = {\n", fileStem,
+        numLexerModes );
+    for ( int m=0; m < numLexerModes; ++m ) {
+        char tmp[256];
+        lexer_mode_enum( tmp, lexerModes[m] );
+        fprintf( impfp, "    0x%02x, // %s\n", skipBlanks[m], tmp );
+    }
+    fprintf( impfp, "};\n\n" );
 }
 
-static void report2( const char* fmt, ... ) {
-    va_list ap;
-    va_start( ap, fmt );
-    fprintf( stderr, "? " );
-    vfprintf( stderr, fmt, ap );
-    fprintf( stderr, "\n" );
-    va_end( ap );
-    exit( EXIT_FAILURE );
+static void output_skip_scan( void ) {
+    // blank bytes missing from a mode's set are replaced by one that is in
+    // it, so the vector loop always compares against all six; they are all
+    // below 64, so the scalar loop tests a bit set
+    if ( skipDfa < 0 ) {
+        fprintf( impfp,
+            "// skip rules: there are no SKIP productions\n\n"
+            "size_t %s_skip( int mode, const unsigned char* p, size_t n ) {\n"
+            "    (void) mode; (void) p; (void) n;\n"
+            "    return 0;\n"
+            "}\n\n"
+            , fileStem
+        );
+        return;
+    }
+    fprintf( impfp, "%s",
+        "// skip rules, see <stem>_skipDfa\n\n"
+        "#if defined(__GNUC__) && defined(__SSE2__)\n"
+        "#include <emmintrin.h>\n"
+        "#endif\n\n"
+        "static size_t skip_blanks( unsigned blanks, const unsigned char* p,\n"
+        "    size_t n ) {\n"
+        "    static const unsigned char bytes[6] = {\n"
+        "        ' ', '\\t', '\\n', '\\r', '\\v', '\\f'\n"
+        "    };\n"
+        "    unsigned char b[6];\n"
+        "    uint64_t set = 0U;\n"
+        "    size_t i = 0;\n"
+        "    int k, m = 0;\n"
+        "    for ( k=0; k < 6; ++k ) {\n"
+        "        if ( blanks & ( 1U << k ) ) {\n"
+        "            b[ m++ ] = bytes[k];\n"
+        "            set |= (uint64_t) 1U << bytes[k];\n"
+        "        }\n"
+        "    }\n"
+        "    for ( k=m; k < 6; ++k ) b[k] = b[0];\n"
+        "#if defined(__GNUC__) && defined(__SSE2__)\n"
+        "    {\n"
+        "        const __m128i b0 = _mm_set1_epi8( (char) b[0] );\n"
+        "        const __m128i b1 = _mm_set1_epi8( (char) b[1] );\n"
+        "        const __m128i b2 = _mm_set1_epi8( (char) b[2] );\n"
+        "        const __m128i b3 = _mm_set1_epi8( (char) b[3] );\n"
+        "        const __m128i b4 = _mm_set1_epi8( (char) b[4] );\n"
+        "        const __m128i b5 = _mm_set1_epi8( (char) b[5] );\n"
+        "        for ( ; i + 16U <= n; i += 16U ) {\n"
+        "            __m128i v = _mm_loadu_si128( (const __m128i*) ( p + i ) );\n"
+        "            __m128i e = _mm_or_si128(\n"
+        "                _mm_or_si128( _mm_cmpeq_epi8( v, b0 ), _mm_cmpeq_epi8( v, b1 ) ),\n"
+        "                _mm_or_si128( _mm_cmpeq_epi8( v, b2 ), _mm_cmpeq_epi8( v, b3 ) ) );\n"
+        "            unsigned out;\n"
+        "            e = _mm_or_si128( e, _mm_or_si128( _mm_cmpeq_epi8( v, b4 ),\n"
+        "                _mm_cmpeq_epi8( v, b5 ) ) );\n"
+        "            out = ~(unsigned) _mm_movemask_epi8( e ) & 0xffffU;\n"
+        "            if ( out != 0U ) return i + (size_t) __builtin_ctz( out );\n"
+        "        }\n"
+        "    }\n"
+        "#endif\n"
+        "    while ( i < n && p[i] < 64U && ( set >> p[i] & 1U ) ) ++i;\n"
+        "    return i;\n"
+        "}\n\n"
+    );
+    fprintf( impfp,
+        "size_t %s_skip( int mode, const unsigned char* p, size_t n ) {\n"
+        "    const dfastate_t (*trans)[DFA_CLASSES];\n"
+        "    const unsigned char* accept;\n"
+        "    const unsigned char* span;\n"
+        "    unsigned start = %s_skipModes[mode], blanks = %s_skipBlanks[mode];\n"
+        "    size_t i = 0;\n"
+        "    if ( %s_skipDfa.numStates == 0 || start == DFA_DEAD ) return 0;\n"
+        "    trans  = &%s_dfaTrans[ %s_skipDfa.states ];\n"
+        "    accept = &%s_dfaAccept[ %s_skipDfa.states ];\n"
+        "    span   = &%s_dfaSpan[ %s_skipDfa.states ];\n"
+        "    for ( ;; ) {\n"
+        "        unsigned st = start;\n"
+        "        size_t j, end;\n"
+        "        if ( blanks != 0U ) i += skip_blanks( blanks, p + i, n - i );\n"
+        "        for ( j = end = i; ; ) {\n"
+        "            if ( span[st] != SPAN_NONE ) {\n"
+        "                j += %s_span( %s_spanSets[ span[st] ], p + j, n - j );\n"
+        "                if ( accept[st] ) end = j;\n"
+        "            }\n"
+        "            if ( j == n ) break;\n"
+        "            st = trans[st][ %s_byteClass[ p[j++] ] ];\n"
+        "            if ( st == DFA_DEAD ) break;\n"
+        "            if ( accept[st] ) end = j;\n"
+        "        }\n"
+        "        if ( end == i ) return i;\n"
+        "        i = end;\n"
+        "    }\n"
+        "}\n\n"
+        , fileStem, fileStem, fileStem, fileStem, fileStem, fileStem, fileStem,
+        fileStem, fileStem, fileStem, fileStem, fileStem, fileStem
+    );
 }
 
-// -- default output: C -------------------------------------------------------
+static void output_search( void ) {
+    int numStates = searchDfa >= 0 ? dfas[searchDfa].numStates : 0;
+    fprintf( impfp,
+        "const regexinfo_t %s_searchDfa = { %d, %d };\n\n"
+        "const unsigned char %s_searchLen[%d] = {"
+        , fileStem, numStates, searchDfa >= 0 ? dfa_first_state( searchDfa ) :
+          numDfaStatesTotal, fileStem, c_table_len( numStates )
+    );
+    if ( numStates == 0 ) fprintf( impfp, "\n    0, // none" );
+    for ( int st=0; st < numStates; ++st ) {
+        int len = dfas[searchDfa].accept[st];
+        fprintf( impfp, "%s%d,", ( st & 15 ) ? " " : "\n    ",
+            len >= 0 ? len : 0 );
+    }
+    fprintf( impfp, "\n};\n\n" );
+}
 
-static int output_branches_helper( treenode_t* node, int index ) {
-    if ( node == 0 ) return 0;
-    if ( node->id >= 0 && node->branchesIx == index ) {
-        fprintf( impfp, "    // %d: %s branches\n    ", node->branchesIx,
-            node->exportIdent );
-        for ( size_t i=0; i < node->numBranches; ++i ) {
-            treenode_t* branch = node->branches[i]; int id;
-            if ( branch->id >= 0 ) {
-                fprintf( impfp, "%d, ", branch->id );
-            } else if ( branch->token == T_IDENTIFIER &&
-                ( id = find_prod_id( tree, branch->text ) ) >= 0 ) {
-                fprintf( impfp, "%d, ", id );
-            } else if ( node->token != T_BIN_DATA &&
-                ( node->token < T_BIN_FIELD ||
-                  node->token > T_BIN_FIELD_TIMES ) ) {
-                if ( branch->token == T_IDENTIFIER ) report2( "production '%s' not found", branch->text );
-                fprintf( impfp, "-1 /* %s */, ", token2text(branch->token) );
-            } else {
-                fprintf( impfp, "-2 /* %s */, ", token2text(branch->token) );
-            }
+static void output_search_scan( void ) {
+    // a literal that ends at best + SEARCH_MAX_LEN or later can't start
+    // before best, so the scan stops there
+    if ( searchDfa < 0 ) {
+        fprintf( impfp,
+            "// search: compiled without --search, so every offset is a "
+            "candidate\n\n"
+            "size_t %s_search( const unsigned char* p, size_t n, size_t from ) {\n"
+            "    (void) p;\n"
+            "    return from < n ? from : n;\n"
+            "}\n\n"
+            , fileStem
+        );
+        return;
+    }
+    fprintf( impfp,
+        "size_t %s_search( const unsigned char* p, size_t n, size_t from ) {\n"
+        "    const dfastate_t (*trans)[DFA_CLASSES];\n"
+        "    const unsigned char* len = %s_searchLen;\n"
+        "    unsigned st = 0, skip;\n"
+        "    size_t best = n, i = from;\n"
+        "    if ( from >= n ) return n;\n"
+        "    if ( %s_searchDfa.numStates == 0 ) return from;\n"
+        "    trans = &%s_dfaTrans[ %s_searchDfa.states ];\n"
+        "    skip  = %s_dfaSpan[ %s_searchDfa.states ];\n"
+        "    while ( i < n && ( best == n || i + 1U < best + SEARCH_MAX_LEN ) ) {\n"
+        "        if ( st == 0U && skip != SPAN_NONE ) {\n"
+        "            i += %s_span( %s_spanSets[skip], p + i, n - i );\n"
+        "            if ( i == n ) break;\n"
+        "        }\n"
+        "        st = trans[st][ %s_byteClass[ p[i++] ] ];\n"
+        "        if ( len[st] != 0U && i - len[st] < best ) best = i - len[st];\n"
+        "    }\n"
+        "    return best;\n"
+        "}\n\n"
+        , fileStem, fileStem, fileStem, fileStem, fileStem, fileStem, fileStem,
+        fileStem, fileStem, fileStem
+    );
+}
+
+static void output_impls_compact( void ) {
+    for ( int i=0; i < id; ++i ) {
+        treenode_t* node = nodeTable[i];
+        fprintf( impfp, "    // %d: %s\n    {", node->id, node->exportIdent );
+        for ( int k=0; k < PF_COUNT; ++k ) {
+            char tmp[256];
+            pn_field_source( tmp, node, pnOrder[k] );
+            fprintf( impfp, " %s,", tmp );
         }
-        fprintf( impfp, "\n" );
-        return node->numBranches;
+        fprintf( impfp, " },\n" );
     }
-    for ( size_t i=0; i < node->numBranches; ++i ) {
-        int n = output_branches_helper( node->branches[i], index );
-        if ( n ) return n;
+}
+
+static void output_soa( void ) {
+    for ( int f=0; f < PF_COUNT; ++f ) {
+        fprintf( impfp, "const %s %s_%s[%d] = {", uint_type( pnFields[f].bytes ),
+            fileStem, pnFields[f].soaName, id );
+        for ( int i=0; i < id; ++i ) {
+            char tmp[256];
+            pn_field_source( tmp, nodeTable[i], f );
+            fprintf( impfp, "%s%s,", ( i & 7 ) ? " " : "\n    ", tmp );
+        }
+        fprintf( impfp, "\n};\n\n" );
     }
-    return 0;
 }
 
-static void output_branches( void ) {
-    for ( int i=0; i < branches_ix; ) {
-        i += output_branches_helper( tree, i );
+static void output_accessors( void ) {
+    // the same macros for every layout, returning the values of the default
+    // layout, so that code using them doesn't depend on --compact or --soa
+    char prefix[128];
+    snprintf( prefix, 128U, "%s", fileStem );
+    for ( char* p = prefix; *p != '\0'; ++p ) {
+        if ( *p >= 'a' && *p <= 'z' ) *p -= 'a'-'A';
+    }
+    fprintf( hdrfp,
+        "\n// accessors for node i, independent of the table layout\n\n"
+        "#define %s_WIDEN(v,ones) ((long long)(v) >= (ones) - 1LL ? "
+        "(int)((long long)(v) - (ones) - 1LL) : (int)(v))\n", prefix );
+    for ( int f=0; f < PF_COUNT; ++f ) {
+        char field[256], def[256];
+        if ( layout == LAYOUT_SOA ) {
+            snprintf( field, 256U, "%s_%s[i]", fileStem, pnFields[f].soaName );
+        } else {
+            snprintf( field, 256U, "%s_parsingTable[i].%s", fileStem,
+                pnFields[f].name );
+        }
+        snprintf( def, 256U, "%s_%s(i)", prefix, pnFields[f].accessor );
+        if ( layout != LAYOUT_AOS && pnFields[f].widen ) {
+            fprintf( hdrfp, "#define %-24s %s_WIDEN(%s,0x%lxLL)\n", def,
+                prefix, field, field_value( -1L, pnFields[f].bytes ) );
+        } else {
+            fprintf( hdrfp, "#define %-24s ((%s) %s)\n", def,
+                pnFields[f].type, field );
+        }
+    }
+    char def[256];
+    snprintf( def, 256U, "%s_TEXT(i)", prefix );
+    fprintf( hdrfp, "#define %-24s (&%s_text[%s_TEXT_OFF(i)])\n", def,
+        fileStem, prefix );
+    snprintf( def, 256U, "%s_BRANCH(i,k)", prefix );
+    if ( layout == LAYOUT_AOS ) {
+        fprintf( hdrfp, "#define %-24s (%s_branches[%s_BRANCHES(i) + (k)])\n",
+            def, fileStem, prefix );
+    } else {
+        fprintf( hdrfp, "#define %-24s %s_WIDEN(%s_branches[%s_BRANCHES(i) + "
+            "(k)],0x%lxLL)\n", def, prefix, fileStem, prefix,
+            field_value( -1L, nodeIdBytes ) );
     }
 }
 
-static bool output_impls_helper( treenode_t* node, int id ) {
-    if ( node == 0 ) return false;
-    if ( node->id == id ) {
-        bool numId = node->token != T_PRODUCTION;
-        char text[1024]; const char* termType = "TT_UNDEF";
-        const char* nodeClass = "???";
-        text[0] = '0'; text[1] = '\0';
-        if ( numId ) {
-            if ( node->token == T_STR_LITERAL || node->token == T_REG_EX ||
-                node->token == T_BIN_DATA || ( node->token >= T_BIN_FIELD &&
-                node->token <= T_BIN_FIELD_TIMES ) ) {
-                nodeClass = "NC_TERMINAL";
-                if ( node->token == T_STR_LITERAL ) {
-                    termType = "TT_STRING";
-                } else if ( node->token == T_REG_EX ) {
-                    termType = "TT_REGEX";
-                } else { // T_BIN_DATA or T_BIN_FIELD
-                    termType = "TT_BINARY";
-                }
+static void output_text_pool( void ) {
+    // one string literal per stored text; octal escapes can't run into the
+    // following character
+    fprintf( impfp, "const unsigned char %s_text[%d] =", fileStem,
+        text_pool_size() );
+    if ( numTextPoolStarts == 0 ) fprintf( impfp, " \"\"" );
+    for ( int k=0; k < numTextPoolStarts; ++k ) {
+        int end = k + 1 < numTextPoolStarts ? textPoolStarts[k+1] :
+            textPoolLen;
+        fprintf( impfp, "\n    /* %4d */ \"", textPoolStarts[k] );
+        for ( int i=textPoolStarts[k]; i < end; ++i ) {
+            unsigned char c = (unsigned char) textPool[i];
+            if ( c == '"' || c == '\\' || c == '?' ) {
+                fprintf( impfp, "\\%c", c );
+            } else if ( c < 0x20 || c >= 0x7f ) {
+                fprintf( impfp, "\\%03o", c );
             } else {
-                switch ( node->token ) {
-                    case T_AND_EXPR:    nodeClass = "NC_MANDATORY"; break;
-                    case T_OR_EXPR:     nodeClass = "NC_ALTERNATIVE"; break;
-                    case T_BRACK_EXPR:  nodeClass = "NC_OPTIONAL"; break;
-                    case T_BRACE_EXPR:  nodeClass = "NC_OPTIONAL_REPETITIVE"; break;
-                    default: break;
-                }
-            }
-            if ( node->text ) {
-                char tmp[512];
-                tmp[0] = '\0';
-                if ( node->token == T_STR_LITERAL || node->token == T_REG_EX ) {
-                    text_to_C_text( tmp, node->text, strlen( node->text ) );
-                } else if ( node->token == T_BIN_DATA ) {
-                    const char* s   = node->text;
-                    size_t      len = strlen( s );
-                    size_t      nb  = len / 2U;
-                    size_t      i;
-                    char        tmp2[256];
-                    if ( nb > 256U ) nb = 256U;
-                    for ( i=0; i < nb; ++i ) {
-                        char c[3]; int x = 0;
-                        c[0] = *s++;
-                        c[1] = *s++;
-                        c[2] = '\0';
-                        sscanf( c, "%x", &x );
-                        tmp2[i] = (char) x;
-                    }
-                    text_to_C_text( tmp, tmp2, nb );
-                } else if ( node->token >= T_BIN_FIELD &&
-                    node->token <= T_BIN_FIELD_TIMES ) {
-                    int v = 0;
-                    if ( strcmp( node->text, "BYTE" ) == 0 ) {
-                        v |= TB_BYTE;
-                    }
-                    else if ( strcmp( node->text, "WORD" ) == 0 ) {
-                        v |= TB_WORD;
-                    }
-                    else if ( strcmp( node->text, "DWORD" ) == 0 ) {
-                        v |= TB_DWORD;
-                    }
-                    else if ( strcmp( node->text, "QWORD" ) == 0 ) {
-                        v |= TB_QWORD;
-                    }
-                    if ( node->numBranches > 0U ) {
-                        v |= TBF_PARAM;
-                    }
-                    if ( node->token == T_BIN_FIELD_COUNT ) {
-                        v |= TBF_WRITE;
-                    }
-                    char b = (char) v;
-                    text_to_C_text( tmp, &b, 1U );
-                }
-                snprintf( text, 1024U, "\"%s\"", tmp );
+                fputc( c, impfp );
             }
-        } else {
-            nodeClass = "NC_PRODUCTION";
         }
-        fprintf( impfp,
-            "    // %d: %s\n"
-            "    { %s, %s, %s, %s, %d, %d },\n"
-            , node->id, node->exportIdent
-            , nodeClass, node->nodeTypeEnum, termType, text
-            , (int) node->numBranches, node->branchesIx
-        );
-        return true;
-    }
-    for ( size_t i=0; i < node->numBranches; ++i ) {
-        if ( output_impls_helper( node->branches[i], id ) ) return true;
+        fprintf( impfp, "\"" );
     }
-    return false;
+    fprintf( impfp, ";\n\n" );
 }
 
-static void output_impls( void ) {
-    for ( int i=0; i < id; ++i ) {
-        output_impls_helper( tree, i );
+static void output_ebt_loader_decls( void ) {
+    fprintf( hdrfp, "%s",
+        "\n// binary table files (--emit-binary), see <stem>_ebt_load(); the\n"
+        "// format doesn't depend on the grammar, section contents match the\n"
+        "// tables above, except that all ids are int32_t, DFA states are\n"
+        "// uint16_t (0xffff is DFA_DEAD) and dfaTrans has numByteClasses\n"
+        "// columns\n\n"
+        "#ifndef EBT_VERSION\n"
+        "#define EBT_VERSION 9\n\n"
+        "enum {\n"
+        "    EBT_NODES,\n"
+        "    EBT_BRANCHES,\n"
+        "    EBT_TEXT,\n"
+        "    EBT_TRIE_STATES,\n"
+        "    EBT_TRIE_EDGES,\n"
+        "    EBT_REGEXES,\n"
+        "    EBT_BYTE_CLASS,\n"
+        "    EBT_DFA_TRANS,\n"
+        "    EBT_DFA_ACCEPT,\n"
+        "    EBT_LEXER,\n"
+        "    EBT_LEXER_TOKEN,\n"
+        "    EBT_LEXER_MODES,\n"
+        "    EBT_LITERALS,\n"
+        "    EBT_DFA_SPAN,\n"
+        "    EBT_SPAN_SETS,\n"
+        "    EBT_REGEX_HINTS,\n"
+        "    EBT_SHIFT_AND,\n"
+        "    EBT_REGEX_NFAS,\n"
+        "    EBT_NFA_STATES,\n"
+        "    EBT_REPEATS,\n"
+        "    EBT_SEARCH,\n"
+        "    EBT_SEARCH_LEN,\n"
+        "    EBT_SKIP,\n"
+        "    EBT_SKIP_MODES,\n"
+        "    EBT_SKIP_BLANKS,\n"
+        "    EBT_SECTIONS\n"
+        "};\n\n"
+        "typedef struct _ebtsection_t {\n"
+        "    uint32_t           count;\n"
+        "    uint32_t           offset;\n"
+        "    uint32_t           bytes;\n"
+        "    uint32_t           elemBytes;\n"
+        "} ebtsection_t;\n\n"
+        "typedef struct _ebtheader_t {\n"
+        "    unsigned char      magic[4];       // 'E', 'B', 'T', 0x1a\n"
+        "    uint32_t           byteOrder;      // 0x01020304\n"
+        "    uint32_t           version;\n"
+        "    uint32_t           fileBytes;\n"
+        "    uint32_t           checksum;       // FNV-1a after the header\n"
+        "    uint32_t           numSections;\n"
+        "    uint32_t           numByteClasses;\n"
+        "    ebtsection_t       sections[EBT_SECTIONS];\n"
+        "} ebtheader_t;\n\n"
+        "typedef struct _ebtnode_t {\n"
+        "    int32_t            nodeClass;\n"
+        "    int32_t            nodeType;\n"
+        "    int32_t            termType;\n"
+        "    int32_t            text;\n"
+        "    int32_t            textLen;\n"
+        "    int32_t            numBranches;\n"
+        "    int32_t            branches;\n"
+        "    int32_t            aux;\n"
+        "} ebtnode_t;\n\n"
+        "typedef struct _ebttables_t {\n"
+        "    const ebtheader_t*     header;\n"
+        "    size_t                 size;\n"
+        "    const ebtnode_t*       nodes;\n"
+        "    const int32_t*         branches;\n"
+        "    const unsigned char*   text;\n"
+        "    const triestate_t*     trieStates;\n"
+        "    const trieedge_t*      trieEdges;\n"
+        "    const regexinfo_t*     regexes;\n"
+        "    const unsigned char*   byteClass;\n"
+        "    const uint16_t*        dfaTrans;\n"
+        "    const unsigned char*   dfaAccept;\n"
+        "    const regexinfo_t*     lexer;\n"
+        "    const int32_t*         lexerToken;\n"
+        "    const uint16_t*        lexerModes;\n"
+        "    const literalinfo_t*   literals;\n"
+        "    const unsigned char*   dfaSpan;\n"
+        "    const unsigned char  (*spanSets)[32];\n"
+        "    const regexhint_t*     regexHints;\n"
+        "    const shiftand_t*      shiftAnd;\n"
+        "    const regexnfa_t*      regexNfas;\n"
+        "    const nfastate_t*      nfaStates;\n"
+        "    const repeatinfo_t*    repeats;\n"
+        "    const regexinfo_t*     search;\n"
+        "    const unsigned char*   searchLen;\n"
+        "    const regexinfo_t*     skip;\n"
+        "    const uint16_t*        skipModes;\n"
+        "    const unsigned char*   skipBlanks;\n"
+        "} ebttables_t;\n"
+        "#endif\n\n"
+    );
+    fprintf( hdrfp,
+        "int %s_ebt_load( const char* path, ebttables_t* tables );\n"
+        "void %s_ebt_unload( ebttables_t* tables );\n"
+        , fileStem, fileStem
+    );
+}
+
+static void output_ebt_loader( void ) {
+    fprintf( impfp,
+        "// binary table file loader: maps the file and points into it; returns\n"
+        "// 0, or -1 with errno set (EINVAL for a damaged or foreign file)\n\n"
+        "#include <errno.h>\n"
+        "#include <fcntl.h>\n"
+        "#include <string.h>\n"
+        "#include <sys/mman.h>\n"
+        "#include <sys/stat.h>\n"
+        "#include <unistd.h>\n\n"
+        "static int %s_ebt_check( const unsigned char* p, size_t size ) {\n"
+        "    const ebtheader_t* h = (const ebtheader_t*) p;\n"
+        "    size_t headerBytes = ( sizeof(ebtheader_t) + 7U ) & ~(size_t) 7U;\n"
+        "    uint32_t sum = 2166136261U;\n"
+        "    if ( size < headerBytes || memcmp( h->magic, \"EBT\\x1a\", 4U ) != 0 ||\n"
+        "        h->byteOrder != 0x01020304U || h->version != EBT_VERSION ||\n"
+        "        h->fileBytes != size || h->numSections != EBT_SECTIONS ) {\n"
+        "        return -1;\n"
+        "    }\n"
+        "    for ( int i=0; i < EBT_SECTIONS; ++i ) {\n"
+        "        const ebtsection_t* s = &h->sections[i];\n"
+        "        if ( ( s->offset & 7U ) != 0U || s->offset < headerBytes ||\n"
+        "            s->offset > size || s->bytes > size - s->offset ) {\n"
+        "            return -1;\n"
+        "        }\n"
+        "    }\n"
+        "    for ( size_t i=headerBytes; i < size; ++i ) {\n"
+        "        sum = ( sum ^ p[i] ) * 16777619U;\n"
+        "    }\n"
+        "    return sum == h->checksum ? 0 : -1;\n"
+        "}\n\n"
+        "int %s_ebt_load( const char* path, ebttables_t* tables ) {\n"
+        "    struct stat st; void* p; const ebtheader_t* h;\n"
+        "    int fd = open( path, O_RDONLY );\n"
+        "    if ( fd < 0 ) return -1;\n"
+        "    if ( fstat( fd, &st ) != 0 ) { close( fd ); return -1; }\n"
+        "    if ( st.st_size <= 0 ) { close( fd ); errno = EINVAL; return -1; }\n"
+        "    p = mmap( 0, (size_t) st.st_size, PROT_READ, MAP_PRIVATE, fd, 0 );\n"
+        "    close( fd );\n"
+        "    if ( p == MAP_FAILED ) return -1;\n"
+        "    if ( %s_ebt_check( (const unsigned char*) p,\n"
+        "        (size_t) st.st_size ) != 0 ) {\n"
+        "        munmap( p, (size_t) st.st_size );\n"
+        "        errno = EINVAL;\n"
+        "        return -1;\n"
+        "    }\n"
+        "    h = (const ebtheader_t*) p;\n"
+        "#define EBT_AT(sect) ((const void*)( (const unsigned char*) p +\\\n"
+        "    h->sections[sect].offset ))\n"
+        "    tables->header     = h;\n"
+        "    tables->size       = (size_t) st.st_size;\n"
+        "    tables->nodes      = (const ebtnode_t*) EBT_AT( EBT_NODES );\n"
+        "    tables->branches   = (const int32_t*) EBT_AT( EBT_BRANCHES );\n"
+        "    tables->text       = (const unsigned char*) EBT_AT( EBT_TEXT );\n"
+        "    tables->trieStates = (const triestate_t*) EBT_AT( EBT_TRIE_STATES );\n"
+        "    tables->trieEdges  = (const trieedge_t*) EBT_AT( EBT_TRIE_EDGES );\n"
+        "    tables->regexes    = (const regexinfo_t*) EBT_AT( EBT_REGEXES );\n"
+        "    tables->byteClass  = (const unsigned char*) EBT_AT( EBT_BYTE_CLASS );\n"
+        "    tables->dfaTrans   = (const uint16_t*) EBT_AT( EBT_DFA_TRANS );\n"
+        "    tables->dfaAccept  = (const unsigned char*) EBT_AT( EBT_DFA_ACCEPT );\n"
+        "    tables->lexer      = (const regexinfo_t*) EBT_AT( EBT_LEXER );\n"
+        "    tables->lexerToken = (const int32_t*) EBT_AT( EBT_LEXER_TOKEN );\n"
+        "    tables->lexerModes = (const uint16_t*) EBT_AT( EBT_LEXER_MODES );\n"
+        "    tables->literals   = (const literalinfo_t*) EBT_AT( EBT_LITERALS );\n"
+        "    tables->dfaSpan    = (const unsigned char*) EBT_AT( EBT_DFA_SPAN );\n"
+        "    tables->spanSets   = (const unsigned char (*)[32])\n"
+        "        EBT_AT( EBT_SPAN_SETS );\n"
+        "    tables->regexHints = (const regexhint_t*) EBT_AT( EBT_REGEX_HINTS );\n"
+        "    tables->shiftAnd   = (const shiftand_t*) EBT_AT( EBT_SHIFT_AND );\n"
+        "    tables->regexNfas  = (const regexnfa_t*) EBT_AT( EBT_REGEX_NFAS );\n"
+        "    tables->nfaStates  = (const nfastate_t*) EBT_AT( EBT_NFA_STATES );\n"
+        "    tables->repeats    = (const repeatinfo_t*) EBT_AT( EBT_REPEATS );\n"
+        "    tables->search     = (const regexinfo_t*) EBT_AT( EBT_SEARCH );\n"
+        "    tables->searchLen  = (const unsigned char*) EBT_AT( EBT_SEARCH_LEN );\n"
+        "    tables->skip       = (const regexinfo_t*) EBT_AT( EBT_SKIP );\n"
+        "    tables->skipModes  = (const uint16_t*) EBT_AT( EBT_SKIP_MODES );\n"
+        "    tables->skipBlanks = (const unsigned char*) EBT_AT( EBT_SKIP_BLANKS );\n"
+        "#undef EBT_AT\n"
+        "    return 0;\n"
+        "}\n\n"
+        "void %s_ebt_unload( ebttables_t* tables ) {\n"
+        "    if ( tables->header != 0 ) {\n"
+        "        munmap( (void*) tables->header, tables->size );\n"
+        "        tables->header = 0;\n"
+        "    }\n"
+        "}\n\n"
+        , fileStem, fileStem, fileStem, fileStem
+    );
+}
+
+static void output_incbin_stub( void ) {
+    fprintf( impfp,
+        "// the tables below are read from %s by the assembler, relative to\n"
+        "// the directory the compiler runs in (ELF targets)\n\n"
+        "__asm__(\n"
+        "    \"\\t.pushsection .rodata\\n\"\n"
+        , incbinFile
+    );
+    for ( int i=0; i < numBlobTables; ++i ) {
+        const blobtable_t* t = &blobTables[i];
+        fprintf( impfp,
+            "    \"\\t.balign 8\\n\"\n"
+            "    \"\\t.globl %s_%s\\n\"\n"
+            "    \"\\t.type %s_%s, @object\\n\"\n"
+            "    \"\\t.size %s_%s, %zu\\n\"\n"
+            "    \"%s_%s:\\n\"\n"
+            , fileStem, t->name, fileStem, t->name, fileStem, t->name, t->bytes
+            , fileStem, t->name
+        );
+        if ( t->bytes ) {
+            fprintf( impfp, "    \"\\t.incbin \\\"%s\\\", %zu, %zu\\n\"\n",
+                incbinFile, t->offset, t->bytes );
+        }
     }
+    fprintf( impfp,
+        "    \"\\t.popsection\\n\"\n"
+        ");\n\n"
+    );
 }
 
 static void output_code( void ) {
@@ -1163,6 +5718,8 @@ static void output_code( void ) {
         "    NC_ALTERNATIVE,\n"
         "    NC_OPTIONAL,\n"
         "    NC_OPTIONAL_REPETITIVE,\n"
+        "    NC_LITERAL_SET,\n"
+        "    NC_COUNTED_REPETITIVE,\n"
         "} nodeclass_t;\n\n"
         "typedef enum _terminaltype_t {\n"
         "    TT_UNDEF,\n"
@@ -1184,198 +5741,394 @@ static void output_code( void ) {
         "    _NT_GENERIC,\n",
         hdrsym, hdrsym
     );
-    output_enums_helper( tree, false );
+    output_enums( false );
+    fprintf( hdrfp, "%s",
+        "} nodetype_t;\n\n"
+        "// text is the offset of a terminal's text in <stem>_text and textLen\n"
+        "// its length in bytes, or -1 if the node has no text; the pool is\n"
+        "// not NUL-terminated, and texts may share bytes\n\n"
+        "// NC_LITERAL_SET: aux is the root state in <stem>_trieStates;\n"
+        "// edges of each state are sorted by character; accept is the id of\n"
+        "// the literal that ends in that state, or -1 (keep walking for the\n"
+        "// longest match)\n\n"
+        "typedef struct _triestate_t {\n"
+        "    int                accept;\n"
+        "    int                numEdges;\n"
+        "    int                edges;\n"
+        "} triestate_t;\n\n"
+        "typedef struct _trieedge_t {\n"
+        "    unsigned char      chr;\n"
+        "    int                target;\n"
+        "} trieedge_t;\n\n"
+        "// TT_REGEX: aux is the index in <stem>_regexes; the minimal DFA has\n"
+        "// numStates rows in <stem>_dfaTrans, starting at row 'states', and\n"
+        "// one column per <stem>_byteClass; state numbers are relative to\n"
+        "// that row, 0 is the start state and DFA_DEAD means no match is\n"
+        "// possible any more; a non-zero <stem>_dfaAccept entry marks an\n"
+        "// accepting state (keep going for the longest match); terminals\n"
+        "// that match the same language share an entry\n\n"
+        "typedef struct _regexinfo_t {\n"
+        "    int                numStates;\n"
+        "    int                states;\n"
+        "} regexinfo_t;\n\n"
+        "// <stem>_lexer is a longest-match DFA over all regular TOKEN\n"
+        "// productions, stored like a regular expression; <stem>_lexerToken\n"
+        "// gives the token accepted in each of its states (if several tokens\n"
+        "// match, the production listed first wins), or _NT_GENERIC;\n"
+        "// each lexer mode (TOKEN:mode) starts in <stem>_lexerModes[mode]\n\n"
+        "// <stem>_skipDfa is a longest-match DFA over the SKIP productions,\n"
+        "// stored like a regular expression; in lexer mode m it starts in\n"
+        "// <stem>_skipModes[m] (DFA_DEAD if the mode skips nothing), and\n"
+        "// bit k of <stem>_skipBlanks[m] is set if runs of byte k of\n"
+        "// \" \\t\\n\\r\\v\\f\" can be skipped without the DFA\n\n"
+        "// <stem>_searchDfa (--search) is an Aho-Corasick automaton over the\n"
+        "// literals that a record of the first production can start with,\n"
+        "// stored like a regular expression; it never dies, and\n"
+        "// <stem>_searchLen gives the length of the longest literal that ends\n"
+        "// in each of its states, or 0 (at most SEARCH_MAX_LEN)\n\n"
+        "typedef enum _lexermode_t {\n"
+    );
+    lexer_mode( "main" );
+    for ( int m=0; m < numLexerModes; ++m ) {
+        char tmp[256];
+        lexer_mode_enum( tmp, lexerModes[m] );
+        fprintf( hdrfp, "    %s,\n", tmp );
+    }
+    fprintf( hdrfp, "%s",
+        "} lexermode_t;\n\n"
+    );
+    order_nodes();
+    output_decls_helper( tree );
+    build_lexer();
+    build_skip();
+    if ( searchMode ) build_search();
+    compute_byte_classes();
+    build_span_sets();
+    build_regex_hints();
+    build_shift_ands();
+    build_regex_nfas();
+    fprintf( hdrfp,
+        "#include <stdint.h>\n\n"
+        "typedef %s dfastate_t;\n\n"
+        "#define DFA_DEAD    ((dfastate_t) %s)\n"
+        "#define DFA_CLASSES %d\n"
+        "#define SEARCH_MAX_LEN %d\n\n"
+        , dfaStateBytes == 1 ? "uint8_t" : "uint16_t"
+        , dfaStateBytes == 1 ? "0xff" : "0xffff", numByteClasses, maxSearchLen
+    );
     fprintf( hdrfp, "%s",
-        "} nodetype_t;\n\n"
-        "typedef struct _parsingnode_t {\n"
-        "    nodeclass_t        nodeClass;\n"
-        "    nodetype_t         nodeType;\n"
-        "    terminaltype_t     termType;\n"
-        "    const char*        text;\n"
-        "    size_t             numBranches;\n"
-        "    int                branches;\n"
-        "} parsingnode_t;\n\n"
+        "// TT_STRING: aux is the index in <stem>_literals; prefix holds the\n"
+        "// first (up to) 8 bytes of the text as a little-endian word and\n"
+        "// mask selects them, so (load64le(p) & mask) == prefix rejects most\n"
+        "// mismatches in one compare; the length is textLen, and texts\n"
+        "// longer than 8 bytes need their remaining bytes compared\n\n"
+        "typedef struct _literalinfo_t {\n"
+        "    uint64_t           prefix;\n"
+        "    uint64_t           mask;\n"
+        "} literalinfo_t;\n\n"
+        "// <stem>_regexHints[aux] of a TT_REGEX: every match starts with the\n"
+        "// prefixLen bytes of prefix (selected by mask, as in literalinfo_t)\n"
+        "// and contains the byte 'required' (-1 if there is no such byte), so\n"
+        "// a runtime can reject or memchr ahead before it runs the DFA;\n"
+        "// firstSet is the <stem>_spanSets entry of the possible first bytes,\n"
+        "// or SPAN_NONE; matcher tells how the regex is matched cheapest:\n"
+        "// MK_DFA by its DFA, MK_SPAN as a run of one or more bytes of\n"
+        "// firstSet, MK_SHIFT_AND by <stem>_shiftAnd[shiftAnd], MK_LAZY_DFA\n"
+        "// (the DFA was too large) from its NFA in <stem>_regexNfas[aux]\n\n"
+        "#define MK_DFA              0\n"
+        "#define MK_SPAN             1\n"
+        "#define MK_SHIFT_AND        2\n"
+        "#define MK_LAZY_DFA         3\n"
+        "#define SHIFT_AND_NONE      0xff\n\n"
+        "typedef struct _regexhint_t {\n"
+        "    uint64_t           prefix;\n"
+        "    uint64_t           mask;\n"
+        "    int32_t            required;\n"
+        "    uint8_t            prefixLen;\n"
+        "    uint8_t            firstSet;\n"
+        "    uint8_t            matcher;\n"
+        "    uint8_t            shiftAnd;\n"
+        "} regexhint_t;\n\n"
+        "// bit-parallel (extended shift-and) matcher of a regex with at most\n"
+        "// 63 positions: bit j of a state is position j of the regex, masks[c]\n"
+        "// the positions that match byte c; starting with e = 1, each byte c\n"
+        "//     f = e | blockEnd;  e |= optional & ( ~( f - blockStart ) ^ f );\n"
+        "//     d = e & masks[c];  (no match beyond here if d == 0)\n"
+        "//     (a match ends after c if d & last)\n"
+        "//     e = ( d << 1 ) | ( d & repeat );\n\n"
+        "typedef struct _shiftand_t {\n"
+        "    uint64_t           masks[256];\n"
+        "    uint64_t           repeat;\n"
+        "    uint64_t           optional;\n"
+        "    uint64_t           blockStart;\n"
+        "    uint64_t           blockEnd;\n"
+        "    uint64_t           last;\n"
+        "} shiftand_t;\n\n"
+        "// NFA of a MK_LAZY_DFA regex: numStates states from <stem>_nfaStates\n"
+        "// [states], start relative to them; a state with set != SPAN_NONE\n"
+        "// consumes a byte of <stem>_spanSets[set] and goes on with out, the\n"
+        "// others go on with out and out1 (unless -1) without consuming one;\n"
+        "// a match ends where an accepting state is reached\n\n"
+        "typedef struct _regexnfa_t {\n"
+        "    int32_t            numStates;\n"
+        "    int32_t            states;\n"
+        "    int32_t            start;\n"
+        "} regexnfa_t;\n\n"
+        "typedef struct _nfastate_t {\n"
+        "    int32_t            out;\n"
+        "    int32_t            out1;\n"
+        "    uint8_t            set;\n"
+        "    uint8_t            accept;\n"
+        "    uint16_t           reserved;\n"
+        "} nfastate_t;\n\n"
+        "// NC_COUNTED_REPETITIVE: aux is the index in <stem>_repeats; the\n"
+        "// only branch is matched at least min and at most max times (max\n"
+        "// is -1 if there is no limit), counting the matches in a loop\n\n"
+        "typedef struct _repeatinfo_t {\n"
+        "    int32_t            min;\n"
+        "    int32_t            max;\n"
+        "} repeatinfo_t;\n\n"
     );
-    output_decls_helper( tree );
-    fprintf( hdrfp, "extern const int %s_branches[%d];\n", fileStem,
-        branches_ix );
+    build_text_pool();
+    build_literal_words();
+    plan_compact_layout();
+    if ( layout != LAYOUT_AOS ) {
+        fprintf( hdrfp,
+            "// %s layout: textLen, branches and aux are all ones where they\n"
+            "// would be -1 in the default layout, and unresolved branch\n"
+            "// entries are all ones (-1) or all ones minus one (-2)\n\n"
+            "typedef %s nodeid_t;\n\n"
+            , layout == LAYOUT_SOA ? "soa" : "compact", uint_type( nodeIdBytes )
+        );
+    }
+    if ( layout == LAYOUT_SOA ) {
+        for ( int f=0; f < PF_COUNT; ++f ) {
+            fprintf( hdrfp, "extern const %s %s_%s[%d];\n",
+                uint_type( pnFields[f].bytes ), fileStem, pnFields[f].soaName,
+                id );
+        }
+        fprintf( hdrfp, "extern const nodeid_t %s_branches[%d];\n",
+            fileStem, branches_ix );
+    } else if ( layout == LAYOUT_COMPACT ) {
+        fprintf( hdrfp, "typedef struct _parsingnode_t {\n" );
+        for ( int k=0; k < PF_COUNT; ++k ) {
+            fprintf( hdrfp, "    %-18s %s;\n",
+                uint_type( pnFields[ pnOrder[k] ].bytes ),
+                pnFields[ pnOrder[k] ].name );
+        }
+        fprintf( hdrfp, "} parsingnode_t;\n\n" );
+        fprintf( hdrfp, "extern const nodeid_t %s_branches[%d];\n",
+            fileStem, branches_ix );
+    } else {
+        fprintf( hdrfp, "%s",
+            "typedef struct _parsingnode_t {\n"
+            "    nodeclass_t        nodeClass;\n"
+            "    nodetype_t         nodeType;\n"
+            "    terminaltype_t     termType;\n"
+            "    int                text;\n"
+            "    int                textLen;\n"
+            "    size_t             numBranches;\n"
+            "    int                branches;\n"
+            "    int                aux;\n"
+            "} parsingnode_t;\n\n"
+        );
+        fprintf( hdrfp, "extern const int %s_branches[%d];\n", fileStem,
+            branches_ix );
+    }
+    fprintf( hdrfp, "extern const unsigned char %s_text[%d];\n", fileStem,
+        text_pool_size() );
+    fprintf( hdrfp, "extern const literalinfo_t %s_literals[%d];\n", fileStem,
+        c_table_len( numLiteralWords ) );
+    if ( layout != LAYOUT_SOA ) {
+        fprintf( hdrfp, "extern const parsingnode_t %s_parsingTable[%d];\n",
+            fileStem, id );
+    }
+    fprintf( hdrfp, "extern const triestate_t %s_trieStates[%d];\n",
+        fileStem, c_table_len( numTrieStates ) );
+    fprintf( hdrfp, "extern const trieedge_t %s_trieEdges[%d];\n",
+        fileStem, c_table_len( numTrieEdges ) );
+    fprintf( hdrfp, "extern const regexinfo_t %s_regexes[%d];\n",
+        fileStem, c_table_len( numRegexDfas ) );
+    fprintf( hdrfp, "extern const regexhint_t %s_regexHints[%d];\n",
+        fileStem, c_table_len( numRegexDfas ) );
+    fprintf( hdrfp, "extern const shiftand_t %s_shiftAnd[%d];\n",
+        fileStem, c_table_len( numShiftAnds ) );
+    fprintf( hdrfp, "extern const regexnfa_t %s_regexNfas[%d];\n",
+        fileStem, c_table_len( numRegexDfas ) );
+    fprintf( hdrfp, "extern const nfastate_t %s_nfaStates[%d];\n",
+        fileStem, c_table_len( numLazyStates ) );
+    fprintf( hdrfp, "extern const repeatinfo_t %s_repeats[%d];\n",
+        fileStem, c_table_len( numRepeatCounts ) );
+    fprintf( hdrfp, "extern const unsigned char %s_byteClass[256];\n",
+        fileStem );
+    fprintf( hdrfp, "extern const dfastate_t %s_dfaTrans[%d][DFA_CLASSES];\n",
+        fileStem, c_table_len( numDfaStatesTotal ) );
+    fprintf( hdrfp, "extern const unsigned char %s_dfaAccept[%d];\n",
+        fileStem, c_table_len( numDfaStatesTotal ) );
+    fprintf( hdrfp, "extern const unsigned char %s_dfaSpan[%d];\n",
+        fileStem, c_table_len( numDfaStatesTotal ) );
+    fprintf( hdrfp, "extern const unsigned char %s_spanSets[%d][32];\n",
+        fileStem, c_table_len( numSpanSets ) );
+    fprintf( hdrfp, "extern const regexinfo_t %s_lexer;\n", fileStem );
+    fprintf( hdrfp, "extern const nodetype_t %s_lexerToken[%d];\n",
+        fileStem, c_table_len( lexerDfa >= 0 ? dfas[lexerDfa].numStates : 0 ) );
+    fprintf( hdrfp, "extern const dfastate_t %s_lexerModes[%d];\n",
+        fileStem, numLexerModes );
+    fprintf( hdrfp, "extern const regexinfo_t %s_skipDfa;\n", fileStem );
+    fprintf( hdrfp, "extern const dfastate_t %s_skipModes[%d];\n",
+        fileStem, numLexerModes );
+    fprintf( hdrfp, "extern const unsigned char %s_skipBlanks[%d];\n",
+        fileStem, numLexerModes );
+    fprintf( hdrfp, "extern const regexinfo_t %s_searchDfa;\n", fileStem );
+    fprintf( hdrfp, "extern const unsigned char %s_searchLen[%d];\n",
+        fileStem, c_table_len( searchDfa >= 0 ? dfas[searchDfa].numStates :
+        0 ) );
+    fprintf( hdrfp,
+        "\n// a DFA state whose <stem>_dfaSpan entry isn't SPAN_NONE loops on\n"
+        "// the bytes of that <stem>_spanSets entry, which %s_span() skips\n"
+        "// (SSSE3/AVX2 when compiled for them): it returns the number of\n"
+        "// leading bytes of p[0..n) in the set, after which the DFA goes on\n"
+        "// with p[result]\n\n"
+        "#define SPAN_NONE 0xff\n\n"
+        , fileStem
+    );
+    if ( !elfObject ) {
+        fprintf( hdrfp,
+            "size_t %s_span( const unsigned char set[32], const unsigned char* p,\n"
+            "    size_t n );\n"
+            "\n// the length of the longest match of a shiftand_t at p, or -1\n"
+            "long %s_shift_and( const shiftand_t* sa, const unsigned char* p,\n"
+            "    size_t n );\n"
+            , fileStem, fileStem
+        );
+        output_lazy_dfa_decls();
+        fprintf( hdrfp,
+            "\n// the number of bytes at p that the SKIP productions of lexer mode\n"
+            "// 'mode' skip, removing longest matches until none is left; runs of\n"
+            "// blank bytes are skipped 16 at a time (SSE2)\n"
+            "size_t %s_skip( int mode, const unsigned char* p, size_t n );\n"
+            , fileStem
+        );
+        fprintf( hdrfp,
+            "\n// the offset in p[from..n) of the first literal of <stem>_searchDfa,\n"
+            "// i.e. where the next record of the first production can start,\n"
+            "// or n; without --search, every offset is a candidate\n"
+            "size_t %s_search( const unsigned char* p, size_t n, size_t from );\n"
+            , fileStem
+        );
+    }
+    output_accessors();
+    if ( emitBinary ) output_ebt_loader_decls();
+    fprintf( hdrfp, "\n#endif\n" );
+    if ( elfObject ) {
+        write_elf_object( impfp );
+        if ( emitBinary ) write_binary_tables();
+        return;
+    }
     fprintf( impfp,
         "// code auto-generated by ebnfcomp; do not modify!\n"
         "// (code might get overwritten during next ebnfcomp invocation)\n\n"
         "#include \"%s\"\n\n"
-        "// branches\n\n"
-        "const int %s_branches[%d] = {\n"
-        , hdrfile, fileStem, branches_ix
-    );
-    output_branches();
-    fprintf( hdrfp, "extern const parsingnode_t %s_parsingTable[%d];\n\n",
-        fileStem, id );
-    fprintf( hdrfp, "#endif\n" );
-    fprintf( impfp,
-        "};\n\n"
-        "const parsingnode_t %s_parsingTable[%d] = {\n"
-        , fileStem, id
+        , hdrfile
     );
-    output_impls();
+    if ( incbin ) {
+        write_incbin_tables();
+        output_incbin_stub();
+        output_regexes();
+        output_lexer();
+        output_skip();
+        output_search();
+        output_span_scan();
+        output_shift_and_scan();
+        output_lazy_dfa();
+        output_skip_scan();
+        output_search_scan();
+        if ( emitBinary ) {
+            output_ebt_loader();
+            write_binary_tables();
+        }
+        return;
+    }
     fprintf( impfp,
-        "};\n\n"
+        "// branches\n\n"
+        "const %s %s_branches[%d] = {\n"
+        , layout != LAYOUT_AOS ? "nodeid_t" : "int", fileStem, branches_ix
     );
-}
-
-// -- optional output: Assembly Language --------------------------------------
-
-static int output_branches_helper_asm( treenode_t* node, int index ) {
-    if ( node == 0 ) return 0;
-    if ( node->id >= 0 && node->branchesIx == index ) {
+    output_branches();
+    fprintf( impfp, "};\n\n" );
+    if ( layout == LAYOUT_SOA ) {
+        output_soa();
+    } else {
         fprintf( impfp,
-                "                        ; %d: %s branches\n"
-                "                        dw          ",
-            node->branchesIx, node->exportIdent );
-        for ( size_t i=0; i < node->numBranches; ++i ) {
-            treenode_t* branch = node->branches[i]; int id;
-            bool last = i == node->numBranches - 1U;
-            if ( branch->id >= 0 ) {
-                fprintf( impfp, "%d%s ", branch->id, last?"":"," );
-            } else if ( branch->token == T_IDENTIFIER &&
-                ( id = find_prod_id( tree, branch->text ) ) >= 0 ) {
-                fprintf( impfp, "%d%s ", id, last?"":"," );
-            } else if ( node->token != T_BIN_DATA &&
-                ( node->token < T_BIN_FIELD ||
-                  node->token > T_BIN_FIELD_TIMES ) ) {
-                if ( branch->token == T_IDENTIFIER ) {
-                    report2( "production '%s' not found", branch->text );
-                }
-                fprintf( impfp, "-1 ; %s%s",
-                    token2text(branch->token),
-                    (last?"":"\n                        dw          ") );
-            } else {
-                fprintf( impfp, "-2 ; %s%s",
-                    token2text(branch->token),
-                    (last?"":"\n                        dw          ") );
-            }
+            "const parsingnode_t %s_parsingTable[%d] = {\n"
+            , fileStem, id
+        );
+        if ( layout == LAYOUT_COMPACT ) {
+            output_impls_compact();
+        } else {
+            output_impls();
         }
-        fprintf( impfp, "\n" );
-        return node->numBranches;
-    }
-    for ( size_t i=0; i < node->numBranches; ++i ) {
-        int n = output_branches_helper_asm( node->branches[i], index );
-        if ( n ) return n;
+        fprintf( impfp,
+            "};\n\n"
+        );
     }
-    return 0;
-}
-
-static void output_branches_asm( void ) {
-    for ( int i=0; i < branches_ix; ) {
-        i += output_branches_helper_asm( tree, i );
+    output_text_pool();
+    output_literals();
+    output_tries();
+    output_dfas();
+    output_regex_hints();
+    output_shift_ands();
+    output_regex_nfas();
+    output_repeats();
+    output_spans();
+    output_lexer();
+    output_skip();
+    output_search();
+    output_span_scan();
+    output_shift_and_scan();
+    output_lazy_dfa();
+    output_skip_scan();
+    output_search_scan();
+    if ( emitBinary ) {
+        output_ebt_loader();
+        write_binary_tables();
     }
 }
 
-static void text_as_source_asm( char* buf, size_t bufsz, const char* s ) {
-    char tmp[512];
-    if ( text_to_asm_text( tmp, s, '\'' ) ) {
-        snprintf( buf, bufsz, "'%s'", tmp );
-    } else if ( text_to_asm_text( tmp, s, '"' ) ) {
-        snprintf( buf, bufsz, "\"%s\"", tmp );
-    } else {
-        bool first = true;
-        char* d = buf; char* e = &buf[bufsz-1U];
-        while ( *s != '\0' ) {
-            if ( !first ) {
-                if ( d+1 < e ) *d++ = ',';
-            } else {
-                first = false;
-            }
-            if ( d+4 < e ) {
-                unsigned char hnyb = ( *s >> 4 ) & 15;
-                unsigned char lnyb = *s & 15;
-                *d++ = '0';
-                *d++ = 'x';
-                *d++ = "0123456789abcdef"[hnyb];
-                *d++ = "0123456789abcdef"[lnyb];
-            }
-            ++s;
-        }
-        *d = '\0';
-    }
-}
+// -- optional output: Assembly Language --------------------------------------
 
-static void dump_as_source_asm( char* buf, size_t bufsz, const char* s ) {
-    size_t len = strlen(s);
-    if ( len & 1U ) report( "unexpected odd length in string '%s'", s );
-    size_t nbytes = len / 2U;
-    char* p = buf; char* e = &buf[bufsz-1U];
-    if ( p + 7 < e ) {
-        strcpy( p, "TB_DATA" );
-        p += 7;
-    }
-    if ( p + 5 < e ) {
-        *p++ = ',';
-        *p++ = '0';
-        *p++ = 'x';
-        *p++ = "0123456789abcdef"[(nbytes>>4U)&15U];
-        *p++ = "0123456789abcdef"[ nbytes     &15U];
-    }
-    for ( size_t i=0; i < nbytes; ++i ) {
-        // bool last = i == nbytes-1U;
-        if ( p + 5 >= e ) {
-            report( "object too large during output at '%s'", s );
-        }
-        else {
-            *p++ = ',';
-            *p++ = '0';
-            *p++ = 'x';
-            *p++ = *s++;
-            *p++ = *s++;
-        }
-    }
-    *p = '\0';
+static const char* asm_data( int bytes ) {
+    return bytes == 1 ? "db" : bytes == 2 ? "dw" : "dd";
 }
 
-static void field_as_source_asm( char* buf, size_t bufsz, treenode_t* node ) {
-    snprintf( buf, bufsz, "TB_%s%s%s", node->text,
-        (node->numBranches?"|TBF_PARAM":""), (node->token==T_BIN_FIELD_COUNT?
-        "|TBF_WRITE":"") );
+static const char* asm_res( int bytes ) {
+    return bytes == 1 ? "resb" : bytes == 2 ? "resw" : "resd";
 }
 
-static bool output_texts_helper_asm( treenode_t* node, int id ) {
-    if ( node == 0 ) return false;
-    if ( node->id == id ) {
-        bool numId = node->token != T_PRODUCTION;
-        char text[1024], labl[256];
-        text[0] = '\0';
-        if ( numId ) {
-            if ( ( node->token == T_STR_LITERAL || node->token == T_REG_EX )
-                && node->text ) {
-                text_as_source_asm( text, 1024U, node->text );
-            } else if ( node->token == T_BIN_DATA ) {
-                dump_as_source_asm( text, 1024U, node->text );
-            } else if ( node->token >= T_BIN_FIELD &&
-                node->token <= T_BIN_FIELD_TIMES ) {
-                field_as_source_asm( text, 1024U, node );
-            }
+static void output_branches_asm( void ) {
+    const char* dx = layout == LAYOUT_AOS ? "dw" : asm_data( nodeIdBytes );
+    bool inLine = false;
+    for ( int i=0; i < branches_ix; ++i ) {
+        if ( branchOwner[i] >= 0 ) {
+            fprintf( impfp, "%s                        ; %d: %s branches\n",
+                inLine ? "\n" : "", i,
+                nodeTable[ branchOwner[i] ]->exportIdent );
+            inLine = false;
         }
-        if ( text[0] != '\0' && ( node->token == T_STR_LITERAL ||
-            node->token == T_REG_EX ) ) {
-            snprintf( labl, 256U, "prod_%d_text", node->id );
-            fprintf( impfp, "%-23s db          %s,0\n", labl, text );
-        } else if ( text[0] != '\0' && ( node->token == T_BIN_DATA ||
-            ( node->token >= T_BIN_FIELD &&
-              node->token <= T_BIN_FIELD_TIMES  ) ) ) {
-            snprintf( labl, 256U, "prod_%d_text", node->id );
-            fprintf( impfp, "%-23s db          %s\n", labl, text );
+        fprintf( impfp, inLine ? ", " : "                        %-11s ", dx );
+        inLine = true;
+        if ( layout != LAYOUT_AOS ) {
+            fprintf( impfp, "0x%lx", field_value( branchTable[i],
+                nodeIdBytes ) );
+        } else {
+            fprintf( impfp, "%d", branchTable[i] );
+        }
+        if ( branchTable[i] < 0 ) {
+            fprintf( impfp, " ; %s\n", token2text( branchSource[i]->token ) );
+            inLine = false;
         }
-        return true;
-    }
-    for ( size_t i=0; i < node->numBranches; ++i ) {
-        if ( output_texts_helper_asm( node->branches[i], id ) ) return true;
-    }
-    return false;
-}
-
-static void output_texts_asm( void ) {
-    for ( int i=0; i < id; ++i ) {
-        output_texts_helper_asm( tree, i );
     }
+    if ( inLine ) fprintf( impfp, "\n" );
 }
 
 static bool output_impls_helper_asm( treenode_t* node, int id ) {
@@ -1401,6 +6154,9 @@ static bool output_impls_helper_asm( treenode_t* node, int id ) {
                     case T_OR_EXPR:     nodeClass = "NC_ALTERNATIVE"; break;
                     case T_BRACK_EXPR:  nodeClass = "NC_OPTIONAL"; break;
                     case T_BRACE_EXPR:  nodeClass = "NC_OPTIONAL_REPETITIVE"; break;
+                    case T_COUNT_EXPR:  nodeClass = "NC_COUNTED_REPETITIVE"; break;
+                    case T_LITERAL_SET: nodeClass = "NC_LITERAL_SET";
+                                        termType  = "TT_STRING"; break;
                     default: break;
                 }
             }
@@ -1413,13 +6169,10 @@ static bool output_impls_helper_asm( treenode_t* node, int id ) {
             nodeClass, termType );
         fprintf( impfp, "                        dw          %s, %d, %d\n",
             node->nodeTypeEnum, (int) node->numBranches, node->branchesIx );
-        if ( numId && node->text != 0 ) {
-            fprintf( impfp,
-                "                        dq          prod_%d_text\n",
-                node->id );
-        } else {
-            fprintf( impfp, "                        dq          0\n" );
-        }
+        fprintf( impfp, "                        dd          %d, %d\n",
+            node->textOff, node->textLen );
+        fprintf( impfp, "                        dd          %d, 0\n",
+            node->aux );
         return true;
     }
     for ( size_t i=0; i < node->numBranches; ++i ) {
@@ -1434,6 +6187,322 @@ static void output_impls_asm( void ) {
     }
 }
 
+static void output_tries_asm( void ) {
+    fprintf( impfp,
+        "                        align       4,db 0\n\n"
+        "%s_trieStates:\n", fileStem );
+    for ( int st=0; st < numTrieStates; ++st ) {
+        fprintf( impfp, "                        dd          %d, %d, %d\n",
+            trieStates[st].accept, trieStates[st].numEdges,
+            trieStates[st].edges );
+    }
+    fprintf( impfp, "\n%s_trieEdges:\n", fileStem );
+    for ( int st=0; st < numTrieStates; ++st ) {
+        if ( trieStates[st].numEdges == 0 ) continue;
+        fprintf( impfp, "                        ; state %d\n", st );
+        for ( int c=0; c < 256; ++c ) {
+            if ( trieStates[st].child[c] == 0 ) continue;
+            fprintf( impfp,
+                "                        db          0x%02x,0,0,0\n"
+                "                        dd          %d\n",
+                c, trieStates[st].child[c] );
+        }
+    }
+    fprintf( impfp, "\n\n" );
+}
+
+static void output_regexes_asm( void ) {
+    fprintf( impfp,
+        "                        align       4,db 0\n\n"
+        "%s_regexes:\n", fileStem );
+    for ( int i=0; i < numRegexDfas; ++i ) {
+        fprintf( impfp, "                        dd          %d, %d\n",
+            dfas[i].numStates, dfa_first_state( i ) );
+    }
+}
+
+static void output_dfas_asm( void ) {
+    const char* dx = dfaStateBytes == 1 ? "db" : "dw";
+    fprintf( impfp, "%s_byteClass:", fileStem );
+    for ( int c=0; c < 256; ++c ) {
+        fprintf( impfp, "%s%d", ( c & 15 ) ?
+            ", " : "\n                        db          ", byteClass[c] );
+    }
+    fprintf( impfp, "\n\n" );
+    output_regexes_asm();
+    fprintf( impfp, "\n%s_dfaTrans:\n", fileStem );
+    for ( int i=0; i < numDfas; ++i ) {
+        for ( int st=0; st < dfas[i].numStates; ++st ) {
+            fprintf( impfp, "                        ; %s, state %d",
+                dfa_name( i ), st );
+            for ( int k=0; k < numByteClasses; ++k ) {
+                if ( k & 15 ) {
+                    fprintf( impfp, ", " );
+                } else {
+                    fprintf( impfp, "\n                        %s          ",
+                        dx );
+                }
+                fprintf( impfp, "0x%0*x", dfaStateBytes * 2,
+                    dfa_target( &dfas[i], st, k ) );
+            }
+            fprintf( impfp, "\n" );
+        }
+    }
+    fprintf( impfp, "\n%s_dfaAccept:\n", fileStem );
+    for ( int i=0; i < numDfas; ++i ) {
+        if ( dfas[i].numStates == 0 ) continue;
+        fprintf( impfp, "                        db          " );
+        for ( int st=0; st < dfas[i].numStates; ++st ) {
+            fprintf( impfp, "%d%s", dfas[i].accept[st] >= 0 ? 1 : 0,
+                st + 1 < dfas[i].numStates ? ", " : "" );
+        }
+        fprintf( impfp, " ; %s\n", dfa_name( i ) );
+    }
+    fprintf( impfp, "\n\n" );
+}
+
+static void output_regex_hints_asm( void ) {
+    fprintf( impfp,
+        "                        align       8,db 0\n\n"
+        "%s_regexHints:\n", fileStem );
+    for ( int i=0; i < numRegexDfas; ++i ) {
+        const regexhint_t* h = &regexHints[i];
+        fprintf( impfp,
+            "                        dq          0x%016llx, 0x%016llx\n"
+            "                        dd          %d\n"
+            "                        db          %d, 0x%02x\n"
+            "                        db          %d, 0x%02x ; regex %d\n",
+            h->prefix, h->mask, h->required, h->prefixLen, h->firstSet,
+            h->matcher, h->shiftAnd, i );
+    }
+    fprintf( impfp, "\n\n" );
+}
+
+static void output_shift_ands_asm( void ) {
+    fprintf( impfp,
+        "                        align       8,db 0\n\n"
+        "%s_shiftAnd:\n", fileStem );
+    for ( int k=0; k < numShiftAnds; ++k ) {
+        const shiftand_t* sa = &shiftAnds[k];
+        for ( int c=0; c < 256; ++c ) {
+            fprintf( impfp, "%s0x%llx", ( c & 3 ) ? ", " :
+                "                        dq          ", sa->masks[c] );
+            if ( ( c & 3 ) == 3 ) {
+                fprintf( impfp, c == 3 ? " ; %d\n" : "\n", k );
+            }
+        }
+        fprintf( impfp,
+            "                        dq          0x%llx, 0x%llx, 0x%llx\n"
+            "                        dq          0x%llx, 0x%llx\n",
+            sa->repeat, sa->optional, sa->blockStart, sa->blockEnd, sa->last );
+    }
+    fprintf( impfp, "\n\n" );
+}
+
+static void output_regex_nfas_asm( void ) {
+    fprintf( impfp,
+        "                        align       4,db 0\n\n"
+        "%s_regexNfas:\n", fileStem );
+    for ( int i=0; i < numRegexDfas; ++i ) {
+        const regexnfa_t* rn = &regexNfas[i];
+        fprintf( impfp, "                        dd          %d, %d, %d ; regex %d\n",
+            rn->numStates, rn->states, rn->start, i );
+    }
+    fprintf( impfp, "\n%s_nfaStates:\n", fileStem );
+    for ( int i=0; i < numLazyStates; ++i ) {
+        const lazystate_t* ls = &lazyStates[i];
+        fprintf( impfp,
+            "                        dd          %d, %d\n"
+            "                        db          0x%02x, %d\n"
+            "                        dw          0\n",
+            ls->out, ls->out1, ls->set, ls->accept ? 1 : 0 );
+    }
+    fprintf( impfp, "\n\n" );
+}
+
+static void output_repeats_asm( void ) {
+    fprintf( impfp,
+        "                        align       4,db 0\n\n"
+        "%s_repeats:\n", fileStem );
+    for ( int i=0; i < numRepeatCounts; ++i ) {
+        fprintf( impfp, "                        dd          %d, %d\n",
+            repeatCounts[i].min, repeatCounts[i].max );
+    }
+    fprintf( impfp, "\n\n" );
+}
+
+static void output_spans_asm( void ) {
+    int row = 0;
+    fprintf( impfp, "%s_dfaSpan:\n", fileStem );
+    for ( int i=0; i < numDfas; ++i ) {
+        if ( dfas[i].numStates == 0 ) continue;
+        fprintf( impfp, "                        db          " );
+        for ( int st=0; st < dfas[i].numStates; ++st ) {
+            fprintf( impfp, "0x%02x%s", dfaSpan[ row++ ],
+                st + 1 < dfas[i].numStates ? ", " : "" );
+        }
+        fprintf( impfp, " ; %s\n", dfa_name( i ) );
+    }
+    fprintf( impfp, "\n%s_spanSets:", fileStem );
+    for ( int k=0; k < numSpanSets; ++k ) {
+        for ( int j=0; j < 32; ++j ) {
+            fprintf( impfp, "%s0x%02x", ( j & 15 ) ? ", " :
+                "\n                        db          ", spanSets[k][j] );
+        }
+        fprintf( impfp, " ; %d", k );
+    }
+    fprintf( impfp, "\n\n\n" );
+}
+
+static void output_lexer_asm( void ) {
+    int numStates = lexerDfa >= 0 ? dfas[lexerDfa].numStates : 0;
+    fprintf( impfp,
+        "                        align       4,db 0\n\n"
+        "%s_lexer:                dd          %d, %d\n\n"
+        "%s_lexerToken:\n"
+        , fileStem, numStates, lexerDfa >= 0 ? dfa_first_state( lexerDfa ) :
+          numDfaStatesTotal, fileStem
+    );
+    for ( int st=0; st < numStates; ++st ) {
+        fprintf( impfp, "                        dw          %s\n",
+            lexer_token_enum( st ) );
+    }
+    fprintf( impfp, "\n%s_lexerModes:\n", fileStem );
+    for ( int m=0; m < numLexerModes; ++m ) {
+        char tmp[256];
+        lexer_mode_enum( tmp, lexerModes[m] );
+        fprintf( impfp, "                        %s          0x%0*x ; %s\n",
+            dfaStateBytes == 1 ? "db" : "dw", dfaStateBytes * 2,
+            lexer_mode_start( m ), tmp );
+    }
+    fprintf( impfp, "\n\n" );
+}
+
+static void output_skip_asm( void ) {
+    int numStates = skipDfa >= 0 ? dfas[skipDfa].numStates : 0;
+    fprintf( impfp,
+        "                        align       4,db 0\n\n"
+        "%s_skipDfa:              dd          %d, %d\n\n"
+        "%s_skipModes:\n"
+        , fileStem, numStates, skipDfa >= 0 ? dfa_first_state( skipDfa ) :
+          numDfaStatesTotal, fileStem
+    );
+    for ( int m=0; m < numLexerModes; ++m ) {
+        char tmp[256];
+        lexer_mode_enum( tmp, lexerModes[m] );
+        fprintf( impfp, "                        %s          0x%0*x ; %s\n",
+            dfaStateBytes == 1 ? "db" : "dw", dfaStateBytes * 2,
+            skip_mode_start( m ), tmp );
+    }
+    fprintf( impfp, "\n%s_skipBlanks:\n", fileStem );
+    for ( int m=0; m < numLexerModes; ++m ) {
+        char tmp[256];
+        lexer_mode_enum( tmp, lexerModes[m] );
+        fprintf( impfp, "                        db          0x%02x ; %s\n",
+            skipBlanks[m], tmp );
+    }
+    fprintf( impfp, "\n\n" );
+}
+
+static void output_search_asm( void ) {
+    int numStates = searchDfa >= 0 ? dfas[searchDfa].numStates : 0;
+    fprintf( impfp,
+        "                        align       4,db 0\n\n"
+        "%s_searchDfa:            dd          %d, %d\n\n"
+        "%s_searchLen:"
+        , fileStem, numStates, searchDfa >= 0 ? dfa_first_state( searchDfa ) :
+          numDfaStatesTotal, fileStem
+    );
+    for ( int st=0; st < numStates; ++st ) {
+        int len = dfas[searchDfa].accept[st];
+        fprintf( impfp, "%s%d", ( st & 15 ) ? ", " :
+            "\n                        db          ", len >= 0 ? len : 0 );
+    }
+    fprintf( impfp, "\n\n\n" );
+}
+
+static void output_impls_compact_asm( void ) {
+    for ( int i=0; i < id; ++i ) {
+        treenode_t* node = nodeTable[i];
+        int used = 0;
+        fprintf( impfp, "                        ; %d: %s\n", node->id,
+            node->exportIdent );
+        for ( int k=0; k < PF_COUNT; ++k ) {
+            char tmp[256];
+            pn_field_source( tmp, node, pnOrder[k] );
+            fprintf( impfp, "                        %-11s %s\n",
+                asm_data( pnFields[ pnOrder[k] ].bytes ), tmp );
+            used += pnFields[ pnOrder[k] ].bytes;
+        }
+        if ( used < pnRecordBytes ) {
+            fprintf( impfp, "                        times       %d db 0\n",
+                pnRecordBytes - used );
+        }
+    }
+}
+
+static void output_soa_asm( void ) {
+    for ( int f=0; f < PF_COUNT; ++f ) {
+        fprintf( impfp,
+            "                        align       %d,db 0\n\n"
+            "%s_%s:", pnFields[f].bytes, fileStem, pnFields[f].soaName );
+        for ( int i=0; i < id; ++i ) {
+            char tmp[256];
+            pn_field_source( tmp, nodeTable[i], f );
+            if ( i & 7 ) {
+                fprintf( impfp, ", %s", tmp );
+            } else {
+                fprintf( impfp, "\n                        %-11s %s",
+                    asm_data( pnFields[f].bytes ), tmp );
+            }
+        }
+        fprintf( impfp, "\n\n" );
+    }
+}
+
+static void output_text_pool_asm( void ) {
+    // one db line per stored text, printable runs quoted
+    fprintf( impfp, "%s_text:\n", fileStem );
+    if ( numTextPoolStarts == 0 ) {
+        fprintf( impfp, "                        db          0\n" );
+    }
+    for ( int k=0; k < numTextPoolStarts; ++k ) {
+        int end = k + 1 < numTextPoolStarts ? textPoolStarts[k+1] :
+            textPoolLen;
+        bool quoted = false;
+        fprintf( impfp, "                        db          " );
+        for ( int i=textPoolStarts[k]; i < end; ++i ) {
+            unsigned char c = (unsigned char) textPool[i];
+            bool printable = c >= 0x20 && c < 0x7f && c != '\'';
+            if ( printable && !quoted ) {
+                fprintf( impfp, "%s'", i > textPoolStarts[k] ? "," : "" );
+            } else if ( !printable && quoted ) {
+                fprintf( impfp, "'" );
+            }
+            if ( printable ) {
+                fputc( c, impfp );
+            } else {
+                fprintf( impfp, "%s0x%02x", i > textPoolStarts[k] ? "," : "",
+                    c );
+            }
+            quoted = printable;
+        }
+        fprintf( impfp, "%s ; %d\n", quoted ? "'" : "", textPoolStarts[k] );
+    }
+}
+
+static void output_literals_asm( void ) {
+    fprintf( impfp,
+        "                        align       8,db 0\n\n"
+        "%s_literals:\n", fileStem );
+    for ( int i=0; i < numLiteralWords; ++i ) {
+        fprintf( impfp,
+            "                        dq          0x%016llx, 0x%016llx ; %d: %s\n",
+            literalWords[i].prefix, literalWords[i].mask,
+            literalWords[i].node->id, literalWords[i].node->exportIdent );
+    }
+}
+
 static void output_code_asm( void ) {
     fprintf( hdrfp, "%s",
         "; code auto-generated by ebnfcomp; do not modify!\n"
@@ -1445,7 +6514,9 @@ static void output_code_asm( void ) {
         "NC_MANDATORY            equ         2\n"
         "NC_ALTERNATIVE          equ         3\n"
         "NC_OPTIONAL             equ         4\n"
-        "NC_OPTIONAL_REPETITIVE  equ         5\n\n"
+        "NC_OPTIONAL_REPETITIVE  equ         5\n"
+        "NC_LITERAL_SET          equ         6\n"
+        "NC_COUNTED_REPETITIVE   equ         7\n\n"
         "TT_UNDEF                equ         0\n"
         "TT_STRING               equ         1\n"
         "TT_REGEX                equ         2\n"
@@ -1460,19 +6531,119 @@ static void output_code_asm( void ) {
         "TBF_WRITE               equ         0x20\n\n"
         "_NT_GENERIC             equ         0\n"
     );
-    output_enums_helper( tree, true );
+    output_enums( true );
     fprintf( hdrfp, "%s",
         "\n"
-        "                        struc      parsingnode\n"
-        "                           pn_nodeClass:       resb    1\n"
-        "                           pn_termType:        resb    1\n"
-        "                           pn_nodeType:        resw    1\n"
-        "                           pn_numBranches:     resw    1\n"
-        "                           pn_branches:        resw    1\n"
-        "                           pn_text:            resq    1\n"
+        "                        struc      triestate\n"
+        "                           ts_accept:          resd    1\n"
+        "                           ts_numEdges:        resd    1\n"
+        "                           ts_edges:           resd    1\n"
+        "                        endstruc\n\n"
+        "                        struc      trieedge\n"
+        "                           te_chr:             resb    1\n"
+        "                           te_reserved:        resb    3\n"
+        "                           te_target:          resd    1\n"
+        "                        endstruc\n\n"
+        "                        struc      regexinfo\n"
+        "                           ri_numStates:       resd    1\n"
+        "                           ri_states:          resd    1\n"
+        "                        endstruc\n\n"
+        "                        struc      literalinfo\n"
+        "                           li_prefix:          resq    1\n"
+        "                           li_mask:            resq    1\n"
+        "                        endstruc\n\n"
+        "                        struc      regexhint\n"
+        "                           rh_prefix:          resq    1\n"
+        "                           rh_mask:            resq    1\n"
+        "                           rh_required:        resd    1\n"
+        "                           rh_prefixLen:       resb    1\n"
+        "                           rh_firstSet:        resb    1\n"
+        "                           rh_matcher:         resb    1\n"
+        "                           rh_shiftAnd:        resb    1\n"
+        "                        endstruc\n\n"
+        "                        struc      shiftand\n"
+        "                           sa_masks:           resq    256\n"
+        "                           sa_repeat:          resq    1\n"
+        "                           sa_optional:        resq    1\n"
+        "                           sa_blockStart:      resq    1\n"
+        "                           sa_blockEnd:        resq    1\n"
+        "                           sa_last:            resq    1\n"
+        "                        endstruc\n\n"
+        "                        struc      regexnfa\n"
+        "                           rn_numStates:       resd    1\n"
+        "                           rn_states:          resd    1\n"
+        "                           rn_start:           resd    1\n"
+        "                        endstruc\n\n"
+        "                        struc      nfastate\n"
+        "                           ns_out:             resd    1\n"
+        "                           ns_out1:            resd    1\n"
+        "                           ns_set:             resb    1\n"
+        "                           ns_accept:          resb    1\n"
+        "                           ns_reserved:        resw    1\n"
+        "                        endstruc\n\n"
+        "                        struc      repeatinfo\n"
+        "                           ri_min:             resd    1\n"
+        "                           ri_max:             resd    1\n"
         "                        endstruc\n\n"
     );
+    order_nodes();
     output_decls_helper( tree );
+    build_lexer();
+    build_skip();
+    if ( searchMode ) build_search();
+    compute_byte_classes();
+    build_span_sets();
+    build_regex_hints();
+    build_shift_ands();
+    build_regex_nfas();
+    fprintf( hdrfp,
+        "DFA_DEAD                equ         %s\n"
+        "DFA_CLASSES             equ         %d\n"
+        "SPAN_NONE               equ         0xff\n"
+        "MK_DFA                  equ         0\n"
+        "MK_SPAN                 equ         1\n"
+        "MK_SHIFT_AND            equ         2\n"
+        "MK_LAZY_DFA             equ         3\n"
+        "SHIFT_AND_NONE          equ         0xff\n"
+        "SEARCH_MAX_LEN          equ         %d\n\n"
+        , dfaStateBytes == 1 ? "0xff" : "0xffff", numByteClasses, maxSearchLen
+    );
+    build_text_pool();
+    build_literal_words();
+    plan_compact_layout();
+    if ( layout == LAYOUT_SOA ) {
+        // see the C header for the meaning of the soa arrays
+    } else if ( layout == LAYOUT_COMPACT ) {
+        // see the C header for the meaning of the compact fields
+        fprintf( hdrfp, "                        struc      parsingnode\n" );
+        for ( int k=0; k < PF_COUNT; ++k ) {
+            char tmp[64];
+            snprintf( tmp, 64U, "pn_%s:", pnFields[ pnOrder[k] ].name );
+            fprintf( hdrfp, "                           %-19s %-7s 1\n", tmp,
+                asm_res( pnFields[ pnOrder[k] ].bytes ) );
+        }
+        fprintf( hdrfp, "                        endstruc\n\n" );
+    } else {
+        fprintf( hdrfp, "%s",
+            "                        struc      parsingnode\n"
+            "                           pn_nodeClass:       resb    1\n"
+            "                           pn_termType:        resb    1\n"
+            "                           pn_nodeType:        resw    1\n"
+            "                           pn_numBranches:     resw    1\n"
+            "                           pn_branches:        resw    1\n"
+            "                           pn_text:            resd    1\n"
+            "                           pn_textLen:         resd    1\n"
+            "                           pn_aux:             resd    1\n"
+            "                           pn_reserved:        resd    1\n"
+            "                        endstruc\n\n"
+        );
+    }
+    for ( int m=0; m < numLexerModes; ++m ) {
+        char tmp[256];
+        lexer_mode_enum( tmp, lexerModes[m] );
+        fprintf( hdrfp, "%-23s equ         %d\n", tmp, m );
+    }
+    fprintf( hdrfp, "\n" );
     fprintf( impfp,
         "; code auto-generated by ebnfcomp; do not modify!\n"
         "; (code might get overwritten during next ebnfcomp invocation)\n\n"
@@ -1481,21 +6652,184 @@ static void output_code_asm( void ) {
         "                        %%include    \"%s\"\n\n"
         "                        section     .rodata\n\n"
         "                        global      %s_branches\n"
-        "                        global      %s_parsingTable\n\n"
-        "%s_branches:\n", hdrfile, fileStem, fileStem, fileStem
+        "                        global      %s_text\n"
+        "                        global      %s_literals\n"
+        "                        global      %s_trieStates\n"
+        "                        global      %s_trieEdges\n"
+        "                        global      %s_byteClass\n"
+        "                        global      %s_regexes\n"
+        "                        global      %s_dfaTrans\n"
+        "                        global      %s_dfaAccept\n"
+        "                        global      %s_regexHints\n"
+        "                        global      %s_shiftAnd\n"
+        "                        global      %s_regexNfas\n"
+        "                        global      %s_nfaStates\n"
+        "                        global      %s_repeats\n"
+        "                        global      %s_dfaSpan\n"
+        "                        global      %s_spanSets\n"
+        "                        global      %s_lexer\n"
+        "                        global      %s_lexerToken\n"
+        "                        global      %s_lexerModes\n"
+        "                        global      %s_skipDfa\n"
+        "                        global      %s_skipModes\n"
+        "                        global      %s_skipBlanks\n"
+        "                        global      %s_searchDfa\n"
+        "                        global      %s_searchLen\n"
+        , hdrfile, fileStem, fileStem, fileStem, fileStem, fileStem, fileStem,
+        fileStem, fileStem, fileStem, fileStem, fileStem, fileStem, fileStem,
+        fileStem, fileStem, fileStem, fileStem, fileStem, fileStem, fileStem,
+        fileStem, fileStem, fileStem, fileStem
     );
+    if ( layout == LAYOUT_SOA ) {
+        for ( int f=0; f < PF_COUNT; ++f ) {
+            fprintf( impfp, "                        global      %s_%s\n",
+                fileStem, pnFields[f].soaName );
+        }
+    } else {
+        fprintf( impfp, "                        global      %s_parsingTable\n",
+            fileStem );
+    }
+    if ( incbin ) {
+        write_incbin_tables();
+        fprintf( impfp, "\n" );
+        for ( int i=0; i < numBlobTables; ++i ) {
+            const blobtable_t* t = &blobTables[i];
+            fprintf( impfp,
+                "                        align       8,db 0\n\n"
+                "%s_%s:\n", fileStem, t->name );
+            if ( t->bytes ) {
+                fprintf( impfp,
+                    "                        incbin      \"%s\", %zu, %zu\n",
+                    incbinFile, t->offset, t->bytes );
+            }
+            fprintf( impfp, "\n" );
+        }
+        fprintf( impfp, "\n" );
+        output_regexes_asm();
+        fprintf( impfp, "\n\n" );
+        output_lexer_asm();
+        output_skip_asm();
+        output_search_asm();
+        if ( emitBinary ) write_binary_tables();
+        return;
+    }
+    fprintf( impfp, "\n%s_branches:\n", fileStem );
     output_branches_asm();
     fprintf( impfp, "\n\n" );
-    output_texts_asm();
-    fprintf( impfp,
-        "\n\n"
-        "                        align       8,db 0\n\n"
-        "%s_parsingTable:\n", fileStem
-    );
-    output_impls_asm();
+    output_text_pool_asm();
+    fprintf( impfp, "\n\n" );
+    output_literals_asm();
+    fprintf( impfp, "\n\n" );
+    if ( layout == LAYOUT_SOA ) {
+        output_soa_asm();
+    } else {
+        fprintf( impfp,
+            "                        align       %d,db 0\n\n"
+            "%s_parsingTable:\n", layout == LAYOUT_COMPACT ?
+            pnFields[ pnOrder[0] ].bytes : 8, fileStem
+        );
+        if ( layout == LAYOUT_COMPACT ) {
+            output_impls_compact_asm();
+        } else {
+            output_impls_asm();
+        }
+    }
     fprintf( impfp,
         "\n\n"
     );
+    output_tries_asm();
+    output_dfas_asm();
+    output_regex_hints_asm();
+    output_shift_ands_asm();
+    output_regex_nfas_asm();
+    output_repeats_asm();
+    output_spans_asm();
+    output_lexer_asm();
+    output_skip_asm();
+    output_search_asm();
+    if ( emitBinary ) write_binary_tables();
+}
+
+// -- statistics --------------------------------------------------------------
+
+static void print_stats( void ) {
+    printf( "parsing table: %d nodes, %d branches\n", id, branches_ix );
+    int soaBytes = 0;
+    for ( int f=0; f < PF_COUNT; ++f ) soaBytes += pnFields[f].bytes * id;
+    printf( "parsing table bytes: %zu default (%zu per node, %zu for "
+        "branches), %zu compact (%d per node, %d for branches, %d for texts)"
+        ", %d soa\n",
+        (size_t) id * 40U + (size_t) branches_ix * 4U, (size_t) 40U,
+        (size_t) branches_ix * 4U, (size_t)( id * pnRecordBytes +
+        branches_ix * nodeIdBytes + textPoolLen ), pnRecordBytes,
+        branches_ix * nodeIdBytes, textPoolLen, soaBytes +
+        branches_ix * nodeIdBytes + textPoolLen );
+    long distance = 0; int numEdges = 0, numNear = 0;
+    int perLine = pnRecordBytes ? 64 / pnRecordBytes : 1;
+    for ( int i=0; i < id; ++i ) {
+        for ( size_t k=0; k < nodeTable[i]->numBranches; ++k ) {
+            int target = branchTable[ nodeTable[i]->branchesIx + (int) k ];
+            if ( target < 0 ) continue;
+            distance += target > i ? target - i : i - target;
+            numNear  += target - i < perLine && i - target < perLine;
+            ++numEdges;
+        }
+    }
+    printf( "node order: mean id distance to branches %.1f, %d%% of branches "
+        "within %d ids\n", numEdges ? (double) distance / numEdges : 0.0,
+        numEdges ? numNear * 100 / numEdges : 0, perLine - 1 );
+    if ( idMapFile ) {
+        printf( "id map: %d of %d ids kept, %d moved into gaps\n",
+            idMapKept, id, idMapMoved );
+    }
+    printf( "branches: %d entries (%d before sharing equal lists and "
+        "suffixes)\n", branches_ix, branchesUnshared );
+    printf( "text pool: %d bytes (%d before merging suffixes)\n",
+        textPoolLen, textPoolUnmerged );
+    int numLong = 0;
+    for ( int i=0; i < numLiteralWords; ++i ) {
+        numLong += literalWords[i].node->textLen > 8;
+    }
+    printf( "literals: %d prefix words, %d literals longer than 8 bytes\n",
+        numLiteralWords, numLong );
+    printf( "DFAs: %d automata, %d states, %d byte classes, %d regexes "
+        "sharing the DFA of an equivalent one\n", numDfas, numDfaStatesTotal,
+        numByteClasses, numSharedDfas );
+    printf( "spans: %d DFA states loop on a byte set, %d distinct sets\n",
+        numSpanStates, numSpanSets );
+    int numPrefixes = 0;
+    for ( int i=0; i < numRegexDfas; ++i ) {
+        numPrefixes += regexHints[i].prefixLen > 0;
+    }
+    printf( "regex hints: %d of %d regexes have a mandatory prefix, %d a "
+        "required byte\n", numPrefixes, numRegexDfas, numRequiredBytes );
+    printf( "regex matchers: %d span, %d shift-and (%zu bytes), %d lazy DFA "
+        "(%d NFA states), %d DFA\n", numSpanMatchers, numShiftAnds,
+        sizeof(shiftand_t) * (size_t) numShiftAnds, numLazyDfas, numLazyStates,
+        numRegexDfas - numSpanMatchers - numShiftAnds - numLazyDfas );
+    int maxCount = 0;
+    for ( int i=0; i < numRepeatCounts; ++i ) {
+        int n = repeatCounts[i].max < 0 ? repeatCounts[i].min :
+            repeatCounts[i].max;
+        if ( n > maxCount ) maxCount = n;
+    }
+    printf( "counted repetitions: %d, counts up to %d\n", numRepeatCounts,
+        maxCount );
+    printf( "lexer: %d tokens, %d modes, %d states\n", numLexerTokens,
+        numLexerModes, lexerDfa >= 0 ? dfas[lexerDfa].numStates : 0 );
+    int numBlankModes = 0;
+    for ( int m=0; m < numLexerModes; ++m ) numBlankModes += skipBlanks[m] != 0;
+    printf( "skip: %d SKIP productions, %d states, blank fast path in %d of "
+        "%d modes\n", numSkipProds, skipDfa >= 0 ? dfas[skipDfa].numStates : 0,
+        numBlankModes, numLexerModes );
+    if ( searchDfa >= 0 ) {
+        printf( "search: %d FIRST literals, up to %d bytes, %d automaton "
+            "states\n", numSearchLits, maxSearchLen, dfas[searchDfa].numStates );
+    }
+    printf( "DFA tables: %zu bytes as [state][256] of int16, "
+        "%zu bytes as [state][class] of uint%d plus class map\n",
+        (size_t) numDfaStatesTotal * 256U * 2U, dfa_table_bytes(),
+        dfaStateBytes * 8 );
 }
 
 // -- main program ------------------------------------------------------------
@@ -1504,6 +6838,7 @@ int main( int argc, char** argv ) {
 
     bool printTree = false;
     bool printAsm  = false;
+    bool printStats = false;
 
     for ( int i=1; i < argc; ++i ) {
         const char* arg = argv[i];
@@ -1517,6 +6852,52 @@ int main( int argc, char** argv ) {
         else if ( strcmp( arg, "--asm" ) == 0 || strcmp( arg, "-a" ) == 0 ) {
             printAsm = true;
         }
+        else if ( strcmp( arg, "--stats" ) == 0 || strcmp( arg, "-s" ) == 0 ) {
+            printStats = true;
+        }
+        else if ( strcmp( arg, "--compact" ) == 0 || strcmp( arg, "-c" ) == 0 ) {
+            layout = LAYOUT_COMPACT;
+        }
+        else if ( strcmp( arg, "--soa" ) == 0 ) {
+            layout = LAYOUT_SOA;
+        }
+        else if ( strcmp( arg, "--emit-binary" ) == 0 ) {
+            emitBinary = true;
+        }
+        else if ( strcmp( arg, "--incbin" ) == 0 ) {
+            incbin = true;
+        }
+        else if ( strcmp( arg, "--elf" ) == 0 ) {
+            elfObject = true;
+        }
+        else if ( strcmp( arg, "--search" ) == 0 ) {
+            searchMode = true;
+        }
+        else if ( strncmp( arg, "--idmap=", 8U ) == 0 && arg[8] != '\0' ) {
+            idMapFile = &arg[8];
+        }
+        else if ( strncmp( arg, "--lazy-dfa=", 11U ) == 0 ) {
+            char* end;
+            long n = strtol( &arg[11], &end, 10 );
+            if ( end == &arg[11] || *end != '\0' || n < 0 || n > MAX_DFA_STATES ) {
+                report( "--lazy-dfa needs a number of states up to %d",
+                    MAX_DFA_STATES );
+            }
+            lazyDfaLimit = (int) n;
+        }
+        else if ( strncmp( arg, "--order=", 8U ) == 0 ) {
+            if ( strcmp( &arg[8], "dfs" ) == 0 ) {
+                nodeOrder = ORDER_DFS;
+            } else if ( strcmp( &arg[8], "bfs" ) == 0 ) {
+                nodeOrder = ORDER_BFS;
+            } else if ( strcmp( &arg[8], "clustered" ) == 0 ) {
+                nodeOrder = ORDER_CLUSTERED;
+            } else if ( strcmp( &arg[8], "rpo" ) == 0 ) {
+                nodeOrder = ORDER_RPO;
+            } else {
+                report( "unknown node order '%s'", &arg[8] );
+            }
+        }
         else if ( fileStem == 0 && arg[0] != '-' ) {
             fileStem = arg;
             printf( "file stem is '%s'\n", fileStem );
@@ -1536,14 +6917,27 @@ int main( int argc, char** argv ) {
         return EXIT_FAILURE;
     }
 
-    if ( printAsm ) {
+    if ( idMapFile && nodeOrder != ORDER_DFS ) {
+        fprintf( stderr, "--idmap cannot be combined with --order\n" );
+        return EXIT_FAILURE;
+    }
+
+    if ( elfObject && ( printAsm || incbin ) ) {
+        fprintf( stderr, "--elf cannot be combined with --asm or --incbin\n" );
+        return EXIT_FAILURE;
+    }
+
+    if ( elfObject ) {
+        snprintf( impfile, 256U, "%s.o", fileStem );
+        snprintf( hdrfile, 256U, "%s.h", fileStem );
+    } else if ( printAsm ) {
         snprintf( impfile, 256U, "%s.nasm", fileStem );
         snprintf( hdrfile, 256U, "%s.inc", fileStem );
     } else {
         snprintf( impfile, 256U, "%s.c", fileStem );
         snprintf( hdrfile, 256U, "%s.h", fileStem );
     }
-    impfp = fopen( impfile, "wt" );
+    impfp = fopen( impfile, elfObject ? "wb" : "wt" );
     if ( impfp == 0 ) {
         fprintf( stderr, "? failed to create implementation file '%s': %m\n",
             impfile );
@@ -1556,6 +6950,10 @@ int main( int argc, char** argv ) {
         return EXIT_FAILURE;
     }
 
+    if ( ( incbin || elfObject ) && layout == LAYOUT_AOS ) {
+        layout = LAYOUT_COMPACT;
+    }
+
     rdch();
     treenode_t* prodlist = read_prod_list();
     if ( prodlist == 0 ) report( "production list expected" );
@@ -1564,11 +6962,14 @@ int main( int argc, char** argv ) {
 
     tree = prodlist;
     deduplicate_literals( &tree, tree );
+    detect_literal_sets( tree );
     if ( printAsm ) {
         output_code_asm();
     } else {
         output_code();
     }
+    if ( idMapFile ) write_id_map();
+    if ( printStats ) print_stats();
 
     return EXIT_SUCCESS;
 }